@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/hdr/String.h"
+#include "../src/hdr/Vector.h"
+#include "../src/hdr/Application.h"
+#include "../src/hdr/Sort.h"
+#include "../src/hdr/Storage.h"
+#include "../src/hdr/MemoryAllocation.h"
+#include "Corpus.h"
+
+/*
+  Microbenchmarks of the hot paths of 'bunny'.
+  Usage: bunny_bench [--json] [--max poems] [--seed number]
+  For each corpus size 10^3, 10^4, ... up to '--max' (default: 10^6, at most 10^7),
+  a synthetic corpus is generated into a temporary directory and each benchmark is run on it.
+  Results are printed to 'stdout' as CSV (default) or JSON.
+*/
+
+/* Upper limit of the corpus size. */
+#define BENCH_MAX_POEMS 10000000UL
+/* Default upper limit of the corpus size. */
+#define BENCH_DEFAULT_MAX_POEMS 1000000UL
+/* Number of removals timed by the 'vector_remove_at' benchmark. */
+#define BENCH_REMOVALS 1000UL
+/* Number of random accesses timed by the compressed 'vector_get_at' benchmark, and how many make up a command. */
+#define BENCH_ACCESSES 100000UL
+#define BENCH_ACCESSES_PER_COMMAND 64
+
+typedef struct BenchResult {
+    const char* name;
+    size_t poems;
+    size_t operations;
+    unsigned long long nanoseconds;
+} BenchResult;
+
+static unsigned long long bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+static void bench_report(FILE* output, bool json, const BenchResult* const result, bool is_first)
+{
+    double per_operation = result->operations > 0 ? (double)result->nanoseconds / result->operations : 0.0;
+
+    if (json)
+    {
+        fprintf(output,
+                "%s  {\"benchmark\": \"%s\", \"poems\": %lu, \"operations\": %lu, \"total_ns\": %llu, \"ns_per_op\": %.1f}",
+                is_first ? "" : ",\n", result->name, result->poems, result->operations, result->nanoseconds, per_operation);
+    }
+    else
+    {
+        fprintf(output, "%s,%lu,%lu,%llu,%.1f\n",
+                result->name, result->poems, result->operations, result->nanoseconds, per_operation);
+    }
+
+    fflush(output);
+}
+
+static BenchResult bench_string_read_line(size_t poems)
+{
+    FILE* file = fopen(FILENAME, "r");
+
+    if (file == NULL)
+    {
+        perror("Error: opening the corpus failed.");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t lines = 0;
+    unsigned long long start = bench_now();
+
+    for (;;)
+    {
+        String* line = string_read_line(file);
+        // the read that hits the end of the file finds nothing after the last newline
+        bool is_end = line == NULL || (feof(file) && string_get_length(line) == 0);
+        string_destroy(line);
+
+        if (is_end)
+        {
+            break;
+        }
+
+        lines++;
+    }
+
+    unsigned long long end = bench_now();
+    fclose(file);
+    return (BenchResult){"string_read_line", poems, lines, end - start};
+}
+
+static BenchResult bench_string_construct(const Vector* const corpus, String** strings)
+{
+    size_t poems = vector_get_size(corpus);
+    unsigned long long start = bench_now();
+
+    for (size_t i = 0; i < poems; i++)
+    {
+        strings[i] = string_construct(vector_get_at(corpus, i));
+    }
+
+    unsigned long long end = bench_now();
+    return (BenchResult){"string_construct", poems, poems, end - start};
+}
+
+/* Takes ownership of 'strings'. */
+static BenchResult bench_vector_append(size_t poems, String** strings)
+{
+    Vector* vector = vector_construct();
+    unsigned long long start = bench_now();
+
+    for (size_t i = 0; i < poems; i++)
+    {
+        vector_append(vector, strings[i]);
+    }
+
+    unsigned long long end = bench_now();
+    vector_destroy(vector);
+    return (BenchResult){"vector_append", poems, poems, end - start};
+}
+
+/* Removes random elements from 'vector', which is therefore modified. */
+static BenchResult bench_vector_remove_at(Vector* vector)
+{
+    size_t poems = vector_get_size(vector);
+    size_t removals = poems / 2 < BENCH_REMOVALS ? poems / 2 : BENCH_REMOVALS;
+    unsigned long long start = bench_now();
+
+    for (size_t i = 0; i < removals; i++)
+    {
+        vector_remove_at(vector, corpus_random() % vector_get_size(vector));
+    }
+
+    unsigned long long end = bench_now();
+    return (BenchResult){"vector_remove_at", poems, removals, end - start};
+}
+
+static BenchResult bench_vector_print(const Vector* const vector)
+{
+    size_t poems = vector_get_size(vector);
+    unsigned long long start = bench_now();
+    vector_print(vector);
+    fflush(stdout);
+    unsigned long long end = bench_now();
+    return (BenchResult){"vector_print", poems, poems, end - start};
+}
+
+/* Visits every unused poem via the bitmap of the vector, after marking every other poem as used. */
+static BenchResult bench_vector_find_unused(Vector* vector)
+{
+    size_t poems = vector_get_size(vector);
+    size_t unused = 0;
+
+    for (size_t i = 0; i < poems; i += 2)
+    {
+        vector_set_used(vector, i);
+    }
+
+    unsigned long long start = bench_now();
+
+    for (size_t i = vector_find_unused(vector, 0, poems); i < poems; i = vector_find_unused(vector, i + 1, poems))
+    {
+        unused++;
+    }
+
+    unsigned long long end = bench_now();
+    // keeps the scan from being optimised away
+    fprintf(stderr, "%s", unused != poems / 2 ? " " : "");
+    return (BenchResult){"vector_find_unused", poems, poems, end - start};
+}
+
+static BenchResult bench_sort_strings(const Vector* const vector)
+{
+    size_t poems = vector_get_size(vector);
+    String** strings = ALLOCATE_ARRAY(String*, poems);
+    size_t* order = ALLOCATE_ARRAY(size_t, poems);
+    const SortKey key = SORT_ALPHABETICAL;
+
+    for (size_t i = 0; i < poems; i++)
+    {
+        strings[i] = vector_get_string_at(vector, i);
+    }
+
+    unsigned long long start = bench_now();
+    sort_strings(strings, poems, &key, 1, order);
+    unsigned long long end = bench_now();
+    DEALLOCATE(strings);
+    DEALLOCATE(order);
+    return (BenchResult){"sort_strings", poems, poems, end - start};
+}
+
+/* Loads the corpus with the given backend ('--io'), which the following saves use too. */
+static BenchResult bench_load(Application* application, char* program_name, size_t poems, char* backend, const char* name)
+{
+    char* arguments[] = {program_name, "--quiet", "--io", backend, NULL};
+    unsigned long long start = bench_now();
+    application_initialise(application, 4, arguments);
+    unsigned long long end = bench_now();
+    return (BenchResult){name, poems, vector_get_size(application->vector), end - start};
+}
+
+static BenchResult bench_load_compressed(Application* application, char* program_name, size_t poems)
+{
+    char* arguments[] = {program_name, "--quiet", "--compress", "--io", "uring", NULL};
+    unsigned long long start = bench_now();
+    application_initialise(application, 5, arguments);
+    unsigned long long end = bench_now();
+    return (BenchResult){"application_initialise --compress", poems, vector_get_size(application->vector), end - start};
+}
+
+/* Random accesses to compressed poems, with the hot poems trimmed between "commands" like in 'application_run'. */
+static BenchResult bench_get_compressed(const Vector* const vector)
+{
+    size_t poems = vector_get_size(vector);
+    size_t accesses = poems < BENCH_ACCESSES ? poems : BENCH_ACCESSES;
+    size_t checksum = 0;
+    unsigned long long start = bench_now();
+
+    for (size_t i = 0; i < accesses; i++)
+    {
+        checksum += (unsigned char)vector_get_at(vector, corpus_random() % poems)[0];
+
+        if (i % BENCH_ACCESSES_PER_COMMAND == BENCH_ACCESSES_PER_COMMAND - 1)
+        {
+            string_trim_hot();
+        }
+    }
+
+    unsigned long long end = bench_now();
+    // keeps the accesses from being optimised away
+    fprintf(stderr, "%s", checksum == 0 ? " " : "");
+    return (BenchResult){"vector_get_at (compressed)", poems, accesses, end - start};
+}
+
+static BenchResult bench_save(Application* application, const char* name)
+{
+    size_t poems = vector_get_size(application->vector);
+    application->is_edited = true;
+
+    // every shard counts as changed, so that it is written out
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        application->shards[i].saved_version--;
+    }
+
+    unsigned long long start = bench_now();
+    application_save(application);
+    unsigned long long end = bench_now();
+    return (BenchResult){name, poems, poems, end - start};
+}
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    size_t max_poems = BENCH_DEFAULT_MAX_POEMS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+        {
+            max_poems = strtoul(argv[++i], NULL, 10);
+            max_poems = max_poems > BENCH_MAX_POEMS ? BENCH_MAX_POEMS : max_poems;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            corpus_seed(strtoull(argv[++i], NULL, 10));
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--json] [--max poems] [--seed number]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // results go to the original 'stdout', everything printed by the benchmarked code to /dev/null
+    FILE* output = fdopen(dup(STDOUT_FILENO), "w");
+    int null_device = open("/dev/null", O_WRONLY);
+
+    if (output == NULL || null_device < 0)
+    {
+        perror("Error: redirecting output failed.");
+        return EXIT_FAILURE;
+    }
+
+    dup2(null_device, STDOUT_FILENO);
+    close(null_device);
+
+    // 'FILENAME' is relative, so the corpus is created under a temporary working directory
+    char directory[] = "/tmp/bunny_bench_XXXXXX";
+
+    if (mkdtemp(directory) == NULL || chdir(directory) != 0 || mkdir("./src", 0700) != 0 || mkdir("./src/file", 0700) != 0)
+    {
+        perror("Error: creating working directory failed.");
+        return EXIT_FAILURE;
+    }
+
+    fputs(json ? "[\n" : "benchmark,poems,operations,total_ns,ns_per_op\n", output);
+    bool is_first = true;
+
+    for (size_t poems = 1000; poems <= max_poems; poems *= 10)
+    {
+        corpus_generate(FILENAME, poems);
+
+        BenchResult results[13];
+        Application application;
+        results[0] = bench_string_read_line(poems);
+        results[1] = bench_load(&application, argv[0], poems, "uring", "application_initialise");
+
+        String** strings = ALLOCATE_ARRAY(String*, poems);
+        results[2] = bench_string_construct(application.vector, strings);
+        results[3] = bench_vector_append(poems, strings);
+        DEALLOCATE(strings);
+
+        results[4] = bench_vector_print(application.vector);
+        results[5] = bench_save(&application, "application_save");
+        results[6] = bench_sort_strings(application.vector);
+        results[7] = bench_vector_remove_at(application.vector);
+        application_destroy(&application);
+
+        results[8] = bench_load_compressed(&application, argv[0], poems);
+        results[9] = bench_get_compressed(application.vector);
+        application_destroy(&application);
+
+        results[10] = bench_load(&application, argv[0], poems, "blocking", "application_initialise --io blocking");
+        results[11] = bench_save(&application, "application_save --io blocking");
+        results[12] = bench_vector_find_unused(application.vector);
+        application_destroy(&application);
+
+        for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++)
+        {
+            bench_report(output, json, &results[i], is_first);
+            is_first = false;
+        }
+    }
+
+    fputs(json ? "\n]\n" : "", output);
+    fclose(output);
+
+    unlink(FILENAME);
+    unlink(FILENAME STORAGE_PREVIOUS_SUFFIX);
+    unlink(METADATA_FILENAME);
+    rmdir("./src/file");
+    rmdir("./src");
+    rmdir(directory);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Corpus.h"
+
+/* Words used by the generator, taken from (and in the spirit of) the traditional poems. */
+static const char* const corpus_words[] = {
+    "piros", "tojás", "zöld", "fehér", "nyuszi", "locsolásért", "jár", "két", "puszi", "kis",
+    "faluban", "templom", "erdőben", "jártam", "kék", "ibolyát", "láttam", "el", "akart", "hervadni",
+    "szabad-e", "locsolni", "egy", "tök", "három", "négy", "öntök", "rózsa", "virág", "kölni",
+    "húsvét", "kislány", "hétfő", "szép", "illatos", "kertben", "nyílik", "bárány", "kalács", "sonka",
+    "barka", "fűzfa", "csibe", "tavasz", "napsugár", "vödör", "víz", "harmat", "ablak", "ünnep"
+};
+
+#define CORPUS_WORD_COUNT (sizeof(corpus_words) / sizeof(corpus_words[0]))
+
+static unsigned long long corpus_random_state = 88172645463325252ULL;
+
+void corpus_seed(unsigned long long seed)
+{
+    // xorshift must not be seeded with 0
+    corpus_random_state = seed | 1;
+}
+
+unsigned long long corpus_random(void)
+{
+    corpus_random_state ^= corpus_random_state << 13;
+    corpus_random_state ^= corpus_random_state >> 7;
+    corpus_random_state ^= corpus_random_state << 17;
+    return corpus_random_state;
+}
+
+size_t corpus_write_poem(char* buffer)
+{
+    size_t length = 0;
+    size_t verses = 2 + corpus_random() % 3;
+
+    // at most 4 verses * 6 words * (longest word + separator) -- well below CORPUS_MAX_POEM_SIZE
+    for (size_t verse = 0; verse < verses; verse++)
+    {
+        size_t words = 3 + corpus_random() % 4;
+
+        for (size_t word = 0; word < words; word++)
+        {
+            const char* text = corpus_words[corpus_random() % CORPUS_WORD_COUNT];
+            size_t text_length = strlen(text);
+            memcpy(buffer + length, text, text_length);
+            length += text_length;
+
+            if (word + 1 < words)
+            {
+                buffer[length++] = ' ';
+            }
+        }
+
+        const char* ending = verse + 1 < verses ? ", / " : (corpus_random() % 2 ? "!" : "?");
+        memcpy(buffer + length, ending, strlen(ending));
+        length += strlen(ending);
+    }
+
+    buffer[length] = '\0';
+    return length;
+}
+
+void corpus_generate(const char* path, size_t poems)
+{
+    FILE* file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: creating corpus \"%s\" failed.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    char poem[CORPUS_MAX_POEM_SIZE];
+
+    for (size_t i = 0; i < poems; i++)
+    {
+        size_t length = corpus_write_poem(poem);
+        poem[length] = '\n';
+        fwrite(poem, 1, length + 1, file);
+    }
+
+    fclose(file);
+}
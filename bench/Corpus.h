@@ -0,0 +1,25 @@
+#ifndef Corpus_H
+#define Corpus_H
+
+#include <stddef.h>
+
+/* Longest poem produced by 'corpus_write_poem' (including the '\0' character). */
+#define CORPUS_MAX_POEM_SIZE 512
+
+/* Sets the seed of the generator. The same seed always produces the same corpus. */
+void corpus_seed(unsigned long long seed);
+
+/* Returns the next pseudo-random number (xorshift64 -- reproducible across platforms, unlike 'rand'). */
+unsigned long long corpus_random(void);
+
+/*
+  Writes a random poem to 'buffer' (at most CORPUS_MAX_POEM_SIZE bytes) and returns its length.
+  Each poem has 2-4 verses of 3-6 Hungarian words (roughly 40-200 bytes), separated by " / "
+  like the poems in the original database.
+*/
+size_t corpus_write_poem(char* buffer);
+
+/* Writes 'poems' random poems to 'path', one per line. Exits upon failure. */
+void corpus_generate(const char* path, size_t poems);
+
+#endif // Corpus_H
@@ -0,0 +1,641 @@
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../src/hdr/Storage.h"
+#include "Corpus.h"
+
+/*
+  End-to-end load generator: drives 'bunny' through a pseudo-terminal like an operator would.
+  Usage: bunny_load [--bunny path] [--poems n] [--commands n] [--rate per_second]
+                    [--mix i=..,e=..,r=..,l=..,w=..,s=..] [--timeout ms] [--seed n] [--replay file]
+                    [--engine process|thread] [--policy uniform|lru|weighted]
+
+  A command counts as completed when 'bunny' prints its next prompt (every line sent is answered
+  by exactly one prompt ending in "> "). Latency is measured from the moment the command was
+  scheduled to be sent, so falling behind the target rate shows up in the results
+  (no coordinated omission). If no prompt arrives within the timeout, 'bunny' is considered hung:
+  the tail of its output is printed and the generator exits with status 2.
+  '--engine' and '--policy' are passed on to 'bunny' (only if given, so that builds without them can be
+  driven as well), so sprinkle engines and selection policies can be compared under the same load.
+  Sprinkle rounds are asynchronous: 'w' prompts again as soon as the poems are handed over, and the round is
+  collected before a later command. So the 'sprinkle_start' latency is only that of the hand-off; the rounds
+  completed are counted from the "[PARENT] Poem has been received." lines, including those at exit.
+*/
+
+#define LOAD_DEFAULT_POEMS 10000
+#define LOAD_DEFAULT_COMMANDS 2000
+#define LOAD_DEFAULT_TIMEOUT_MS 5000
+/* Number of poems listed by a generated 'l' command. */
+#define LOAD_LIST_PAGE 20
+/* Bytes of 'bunny' output kept for hang reports. */
+#define LOAD_OUTPUT_TAIL 2048
+#define LOAD_MAX_LINE 4096
+/* Printed by 'bunny' when a sprinkle round is collected. */
+#define LOAD_ROUND_RECEIVED "[PARENT] Poem has been received."
+
+typedef enum LoadCommand {
+    LOAD_INSERT,
+    LOAD_EDIT,
+    LOAD_REMOVE,
+    LOAD_LIST,
+    LOAD_SPRINKLE,
+    LOAD_SAVE,
+    LOAD_OTHER,
+    LOAD_COMMAND_COUNT
+} LoadCommand;
+
+static const char load_command_letters[LOAD_COMMAND_COUNT] = {'i', 'e', 'r', 'l', 'w', 's', '?'};
+static const char* const load_command_names[LOAD_COMMAND_COUNT] = {
+    "insert", "edit", "remove", "list", "sprinkle_start", "save", "other"
+};
+
+typedef struct LatencySamples {
+    unsigned long long* values;
+    size_t size;
+    size_t capacity;
+} LatencySamples;
+
+typedef struct LoadSession {
+    int terminal;
+    pid_t bunny;
+    char tail[LOAD_OUTPUT_TAIL];
+    size_t tail_size;
+    bool last_was_prompt_marker;
+    size_t prompts;
+    // the number of characters of LOAD_ROUND_RECEIVED matched so far, and the number of whole matches
+    size_t round_match;
+    size_t rounds_received;
+    int timeout_ms;
+} LoadSession;
+
+static unsigned long long load_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+static void load_sleep_until(unsigned long long deadline)
+{
+    unsigned long long now = load_now();
+
+    if (deadline > now)
+    {
+        struct timespec duration = {(time_t)((deadline - now) / 1000000000ULL), (long)((deadline - now) % 1000000000ULL)};
+        nanosleep(&duration, NULL);
+    }
+}
+
+/* Adds a sample. Without memory to grow the samples, it is dropped. */
+static void load_samples_add(LatencySamples* samples, unsigned long long value)
+{
+    if (samples->size == samples->capacity)
+    {
+        size_t capacity = samples->capacity == 0 ? 64 : samples->capacity * 2;
+        unsigned long long* values = realloc(samples->values, capacity * sizeof(unsigned long long));
+
+        if (values == NULL)
+        {
+            return;
+        }
+
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+
+    samples->values[samples->size++] = value;
+}
+
+static int load_compare(const void* left, const void* right)
+{
+    unsigned long long a = *(const unsigned long long*)left;
+    unsigned long long b = *(const unsigned long long*)right;
+    return (a > b) - (a < b);
+}
+
+static unsigned long long load_percentile(const LatencySamples* samples, double percentile)
+{
+    size_t rank = (size_t)(percentile / 100.0 * samples->size + 0.5);
+    rank = rank == 0 ? 1 : (rank > samples->size ? samples->size : rank);
+    return samples->values[rank - 1];
+}
+
+/* Starts 'bunny' in 'directory' with a pseudo-terminal as its 'stdin', 'stdout' and 'stderr'. */
+static void load_start_bunny(LoadSession* session, const char* bunny, const char* engine, const char* policy,
+                             const char* directory)
+{
+    session->terminal = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (session->terminal < 0 || grantpt(session->terminal) != 0 || unlockpt(session->terminal) != 0)
+    {
+        perror("Error: opening pseudo-terminal failed.");
+        exit(EXIT_FAILURE);
+    }
+
+    const char* terminal_name = ptsname(session->terminal);
+    session->bunny = fork();
+
+    if (session->bunny < 0)
+    {
+        perror("Error: fork failed.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (session->bunny == 0)
+    {
+        setsid();
+        int terminal = open(terminal_name, O_RDWR);
+        struct termios attributes;
+
+        // no echo and no line editing -- the generator only wants to see what 'bunny' prints
+        tcgetattr(terminal, &attributes);
+        cfmakeraw(&attributes);
+        tcsetattr(terminal, TCSANOW, &attributes);
+
+        dup2(terminal, STDIN_FILENO);
+        dup2(terminal, STDOUT_FILENO);
+        dup2(terminal, STDERR_FILENO);
+        close(terminal);
+        close(session->terminal);
+
+        if (chdir(directory) != 0)
+        {
+            _exit(EXIT_FAILURE);
+        }
+
+        // '--engine' and '--policy' are only passed when given, so that older builds can be driven as well
+        char* arguments[7] = {(char*)bunny, "--quiet"};
+        size_t count = 2;
+
+        if (engine != NULL)
+        {
+            arguments[count++] = "--engine";
+            arguments[count++] = (char*)engine;
+        }
+
+        if (policy != NULL)
+        {
+            arguments[count++] = "--policy";
+            arguments[count++] = (char*)policy;
+        }
+
+        arguments[count] = NULL;
+        execv(bunny, arguments);
+        _exit(EXIT_FAILURE);
+    }
+}
+
+/* Keeps the last LOAD_OUTPUT_TAIL bytes of the output and counts the prompts and the collected rounds in it. */
+static void load_consume_output(LoadSession* session, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (session->last_was_prompt_marker && data[i] == ' ')
+        {
+            session->prompts++;
+        }
+
+        session->last_was_prompt_marker = data[i] == '>';
+
+        // matched incrementally, as a line may be split between two reads ('[' only starts the marker)
+        if (data[i] == LOAD_ROUND_RECEIVED[session->round_match])
+        {
+            session->round_match++;
+        }
+        else
+        {
+            session->round_match = data[i] == LOAD_ROUND_RECEIVED[0];
+        }
+
+        if (session->round_match == sizeof(LOAD_ROUND_RECEIVED) - 1)
+        {
+            session->rounds_received++;
+            session->round_match = 0;
+        }
+    }
+
+    if (size >= LOAD_OUTPUT_TAIL)
+    {
+        memcpy(session->tail, data + size - LOAD_OUTPUT_TAIL, LOAD_OUTPUT_TAIL);
+        session->tail_size = LOAD_OUTPUT_TAIL;
+    }
+    else
+    {
+        size_t keep = session->tail_size + size > LOAD_OUTPUT_TAIL ? LOAD_OUTPUT_TAIL - size : session->tail_size;
+        memmove(session->tail, session->tail + session->tail_size - keep, keep);
+        memcpy(session->tail + keep, data, size);
+        session->tail_size = keep + size;
+    }
+}
+
+/* Waits until 'bunny' has printed 'prompts' prompts in total. Returns false on timeout or exit. */
+static bool load_wait_for_prompts(LoadSession* session, size_t prompts)
+{
+    char buffer[65536];
+
+    while (session->prompts < prompts)
+    {
+        struct pollfd descriptor = {session->terminal, POLLIN, 0};
+        int ready = poll(&descriptor, 1, session->timeout_ms);
+
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (ready <= 0)
+        {
+            return false;
+        }
+
+        ssize_t received = read(session->terminal, buffer, sizeof(buffer));
+
+        if (received <= 0)
+        {
+            return false;
+        }
+
+        load_consume_output(session, buffer, (size_t)received);
+    }
+
+    return true;
+}
+
+/* Reads the output of 'bunny' until it closes the terminal, or prints nothing for the timeout. */
+static void load_drain_output(LoadSession* session)
+{
+    char buffer[65536];
+
+    for (;;)
+    {
+        struct pollfd descriptor = {session->terminal, POLLIN, 0};
+        int ready = poll(&descriptor, 1, session->timeout_ms);
+
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        ssize_t received = ready > 0 ? read(session->terminal, buffer, sizeof(buffer)) : 0;
+
+        if (received <= 0)
+        {
+            return;
+        }
+
+        load_consume_output(session, buffer, (size_t)received);
+    }
+}
+
+static void load_send(LoadSession* session, const char* text, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(session->terminal, text, length);
+
+        if (written < 0 && errno != EINTR)
+        {
+            perror("Error: writing to bunny failed.");
+            exit(EXIT_FAILURE);
+        }
+
+        text += written > 0 ? written : 0;
+        length -= written > 0 ? (size_t)written : 0;
+    }
+}
+
+static void load_report_hang(LoadSession* session, const char* command)
+{
+    fprintf(stderr, "HANG: no prompt within %d ms after \"%s\". Last output of bunny:\n", session->timeout_ms, command);
+    fwrite(session->tail, 1, session->tail_size, stderr);
+    fputc('\n', stderr);
+    kill(session->bunny, SIGKILL);
+    waitpid(session->bunny, NULL, 0);
+}
+
+/* Parses "i=10,e=10,..." into 'weights'. */
+static void load_parse_mix(const char* mix, unsigned weights[LOAD_COMMAND_COUNT])
+{
+    memset(weights, 0, LOAD_COMMAND_COUNT * sizeof(unsigned));
+
+    while (*mix != '\0')
+    {
+        for (size_t i = 0; i < LOAD_COMMAND_COUNT; i++)
+        {
+            if (mix[0] == load_command_letters[i] && mix[1] == '=')
+            {
+                weights[i] = (unsigned)strtoul(mix + 2, NULL, 10);
+            }
+        }
+
+        const char* next = strchr(mix, ',');
+        mix = next != NULL ? next + 1 : mix + strlen(mix);
+    }
+}
+
+/*
+  Writes the line(s) of a random command to 'text', based on the mix and the current number of poems.
+  Returns the number of lines (i.e. the number of prompts to wait for).
+*/
+static size_t load_generate_command(const unsigned weights[LOAD_COMMAND_COUNT], size_t* poems, char* text, LoadCommand* type)
+{
+    unsigned total = 0;
+
+    for (size_t i = 0; i < LOAD_COMMAND_COUNT; i++)
+    {
+        total += weights[i];
+    }
+
+    unsigned pick = (unsigned)(corpus_random() % total);
+    *type = LOAD_INSERT;
+
+    while (pick >= weights[*type])
+    {
+        pick -= weights[*type];
+        (*type)++;
+    }
+
+    // commands that need an existing poem fall back to inserting one
+    if (*poems == 0 && (*type == LOAD_EDIT || *type == LOAD_REMOVE))
+    {
+        *type = LOAD_INSERT;
+    }
+
+    char poem[CORPUS_MAX_POEM_SIZE];
+    size_t index = *poems > 0 ? 1 + corpus_random() % *poems : 1;
+
+    switch (*type)
+    {
+    case LOAD_INSERT:
+        corpus_write_poem(poem);
+        sprintf(text, "i\n%s\n", poem);
+        (*poems)++;
+        return 2;
+    case LOAD_EDIT:
+        corpus_write_poem(poem);
+        sprintf(text, "e %lu\n%s\n", index, poem);
+        return 2;
+    case LOAD_REMOVE:
+        sprintf(text, "r %lu\n", index);
+        (*poems)--;
+        return 1;
+    case LOAD_LIST:
+        sprintf(text, "l %lu %lu\n", index, index + LOAD_LIST_PAGE - 1 < *poems ? index + LOAD_LIST_PAGE - 1 : *poems);
+        return 1;
+    case LOAD_SPRINKLE:
+        sprintf(text, "w\n");
+        return 1;
+    default:
+        sprintf(text, "s\n");
+        *type = LOAD_SAVE;
+        return 1;
+    }
+}
+
+static LoadCommand load_classify(const char* line)
+{
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+
+    for (size_t i = 0; i < LOAD_OTHER; i++)
+    {
+        if ((line[0] == load_command_letters[i] || line[0] == load_command_letters[i] - 'a' + 'A') &&
+            (line[1] == '\0' || line[1] == ' ' || line[1] == '\n'))
+        {
+            return (LoadCommand)i;
+        }
+    }
+
+    return LOAD_OTHER;
+}
+
+int main(int argc, char** argv)
+{
+    const char* bunny = "./bunny";
+    const char* replay = NULL;
+    const char* engine = NULL;
+    const char* policy = NULL;
+    size_t poems = LOAD_DEFAULT_POEMS;
+    size_t commands = LOAD_DEFAULT_COMMANDS;
+    double rate = 0.0;
+    unsigned weights[LOAD_COMMAND_COUNT] = {10, 10, 5, 20, 2, 1, 0};
+    LoadSession session = {0};
+    session.timeout_ms = LOAD_DEFAULT_TIMEOUT_MS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bunny") == 0 && i + 1 < argc)
+        {
+            bunny = argv[++i];
+        }
+        else if (strcmp(argv[i], "--poems") == 0 && i + 1 < argc)
+        {
+            poems = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc)
+        {
+            commands = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            rate = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc)
+        {
+            load_parse_mix(argv[++i], weights);
+        }
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+        {
+            session.timeout_ms = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            corpus_seed(strtoull(argv[++i], NULL, 10));
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replay = argv[++i];
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            engine = argv[++i];
+        }
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc)
+        {
+            policy = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr,
+                    "Usage: %s [--bunny path] [--poems n] [--commands n] [--rate per_second]\n"
+                    "          [--mix i=..,e=..,r=..,l=..,w=..,s=..] [--timeout ms] [--seed n] [--replay file]\n"
+                    "          [--engine process|thread] [--policy uniform|lru|weighted]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    unsigned total_weight = 0;
+
+    for (size_t i = 0; i < LOAD_COMMAND_COUNT; i++)
+    {
+        total_weight += weights[i];
+    }
+
+    if (total_weight == 0)
+    {
+        fprintf(stderr, "Error: the command mix is empty.\n");
+        return EXIT_FAILURE;
+    }
+
+    char bunny_path[PATH_MAX];
+    char directory[] = "/tmp/bunny_load_XXXXXX";
+    FILE* replay_file = replay != NULL ? fopen(replay, "r") : NULL;
+
+    if (realpath(bunny, bunny_path) == NULL || (replay != NULL && replay_file == NULL))
+    {
+        fprintf(stderr, "Error: \"%s\" not found.\n", replay_file == NULL && replay != NULL ? replay : bunny);
+        return EXIT_FAILURE;
+    }
+
+    // 'bunny' reads ./src/file/poems.txt, relative to its working directory
+    char corpus_path[sizeof(directory) + 32];
+
+    if (mkdtemp(directory) == NULL)
+    {
+        perror("Error: creating working directory failed.");
+        return EXIT_FAILURE;
+    }
+
+    snprintf(corpus_path, sizeof(corpus_path), "%s/src", directory);
+    mkdir(corpus_path, 0700);
+    snprintf(corpus_path, sizeof(corpus_path), "%s/src/file", directory);
+    mkdir(corpus_path, 0700);
+    snprintf(corpus_path, sizeof(corpus_path), "%s/src/file/poems.txt", directory);
+    corpus_generate(corpus_path, poems);
+
+    // the SysV message queue key is derived from the program path
+    load_start_bunny(&session, bunny_path, engine, policy, directory);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!load_wait_for_prompts(&session, 1))
+    {
+        load_report_hang(&session, "(startup)");
+        return 2;
+    }
+
+    LatencySamples samples[LOAD_COMMAND_COUNT] = {{0}};
+    char text[LOAD_MAX_LINE + CORPUS_MAX_POEM_SIZE];
+    char line[LOAD_MAX_LINE];
+    size_t expected_prompts = 1;
+    size_t sent = 0;
+    unsigned long long start = load_now();
+    unsigned long long interval = rate > 0.0 ? (unsigned long long)(1e9 / rate) : 0;
+    bool is_hung = false;
+
+    while (replay_file != NULL ? fgets(line, sizeof(line), replay_file) != NULL : sent < commands)
+    {
+        LoadCommand type;
+        size_t lines = 1;
+
+        if (replay_file != NULL)
+        {
+            size_t length = strcspn(line, "\n");
+            line[length] = '\0';
+            type = load_classify(line);
+            sprintf(text, "%s\n", line);
+        }
+        else
+        {
+            lines = load_generate_command(weights, &poems, text, &type);
+        }
+
+        unsigned long long scheduled = start + sent * interval;
+        load_sleep_until(scheduled);
+        unsigned long long issued = interval > 0 ? scheduled : load_now();
+
+        load_send(&session, text, strlen(text));
+        expected_prompts += lines;
+
+        if (!load_wait_for_prompts(&session, expected_prompts))
+        {
+            text[strcspn(text, "\n")] = '\0';
+            load_report_hang(&session, text);
+            is_hung = true;
+            break;
+        }
+
+        load_samples_add(&samples[type], load_now() - issued);
+        sent++;
+    }
+
+    double elapsed = (load_now() - start) / 1e9;
+
+    if (!is_hung)
+    {
+        // discarding the modifications of the session
+        load_send(&session, "q\nN\n", 4);
+        // the rounds still in flight are collected on exit
+        load_drain_output(&session);
+        waitpid(session.bunny, NULL, 0);
+    }
+
+    printf("command,count,p50_us,p90_us,p99_us,max_us\n");
+
+    for (size_t i = 0; i < LOAD_COMMAND_COUNT; i++)
+    {
+        if (samples[i].size == 0)
+        {
+            continue;
+        }
+
+        qsort(samples[i].values, samples[i].size, sizeof(unsigned long long), load_compare);
+        printf("%s,%lu,%.1f,%.1f,%.1f,%.1f\n", load_command_names[i], samples[i].size,
+               load_percentile(&samples[i], 50.0) / 1e3, load_percentile(&samples[i], 90.0) / 1e3,
+               load_percentile(&samples[i], 99.0) / 1e3, samples[i].values[samples[i].size - 1] / 1e3);
+        free(samples[i].values);
+    }
+
+    printf("# commands: %lu, elapsed: %.3f s, throughput: %.1f commands/s, sprinkle rounds started: %.1f/s, completed: %lu%s\n",
+           sent, elapsed, sent / elapsed, samples[LOAD_SPRINKLE].size / elapsed, session.rounds_received,
+           is_hung ? ", HUNG" : "");
+
+    if (replay_file != NULL)
+    {
+        fclose(replay_file);
+    }
+
+    // everything 'bunny' may have written next to the corpus, so the directory can be removed
+    const char* files[] = {"poems.txt", "poems.txt" STORAGE_PREVIOUS_SUFFIX, "poems.txt" STORAGE_TEMPORARY_SUFFIX,
+                           "poems.meta", "poems.meta" STORAGE_TEMPORARY_SUFFIX};
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        snprintf(corpus_path, sizeof(corpus_path), "%s/src/file/%s", directory, files[i]);
+        unlink(corpus_path);
+    }
+
+    snprintf(corpus_path, sizeof(corpus_path), "%s/src/file", directory);
+    rmdir(corpus_path);
+    snprintf(corpus_path, sizeof(corpus_path), "%s/src", directory);
+    rmdir(corpus_path);
+    rmdir(directory);
+    return is_hung ? 2 : EXIT_SUCCESS;
+}
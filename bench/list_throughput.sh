@@ -0,0 +1,29 @@
+#!/bin/sh
+# Measures the throughput of the 'l' command by listing a synthetic database to /dev/null.
+# Usage: bench/list_throughput.sh [number of poems] (default: 1000000)
+# Must be run from the repository root after 'make'.
+
+set -e
+
+POEMS=${1:-1000000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+mkdir -p "$WORKDIR/src/file"
+cp ./bunny "$WORKDIR/bunny"
+
+awk -v n="$POEMS" 'BEGIN {
+    for (i = 1; i <= n; i++)
+        printf "Piros tojás zöld-fehér nyuszi, locsolásér jár két puszi! (%d)\n", i
+}' > "$WORKDIR/src/file/poems.txt"
+
+BYTES=$(wc -c < "$WORKDIR/src/file/poems.txt")
+
+cd "$WORKDIR"
+# the per-command timing summary of batch mode is printed to stderr
+echo "l" | ./bunny --batch 2>&1 > /dev/null | awk -v n="$POEMS" -v bytes="$BYTES" '
+$1 == "list" {
+    elapsed = $3 / 1000
+    printf "poems,bytes,seconds,poems_per_second,mib_per_second\n"
+    printf "%d,%d,%.3f,%.0f,%.1f\n", n, bytes, elapsed, n / elapsed, bytes / elapsed / 1048576
+}'
@@ -1,11 +1,15 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h> // strncasecmp
 #include <ctype.h>
 #include <time.h> // srand -- random generator
 #include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <dirent.h> // shard directory
 #include <sys/types.h>
 #include <sys/wait.h> // waidpid
 #include <signal.h>
@@ -16,555 +20,2313 @@
 #include "hdr/Application.h"
 #include "hdr/PosixUtils.h"
 #include "hdr/MemoryAllocation.h"
+#include "hdr/Statistics.h"
+#include "hdr/Trace.h"
+#include "hdr/SprinkleEngine.h"
+#include "hdr/Selection.h"
+#include "hdr/Sort.h"
+#include "hdr/Storage.h"
+#include "hdr/Array.h"
+
+/* Tokens of a command, kept inline unless the line has more than 'MAX_TOKENS'. */
+DEFINE_SMALL_ARRAY(TokenArray, token_array, Token, MAX_TOKENS, ARRAY_DEFAULT_GROWTH)
+
+/* The poems of a shard read by a loader thread, before they are appended to the vector. */
+typedef struct ShardLoad {
+    const Shard* shard;
+    size_t number;
+    String** poems;
+    size_t count;
+    StorageStatus status;
+    // whether the poems come from the previous generation of the file
+    bool is_recovered;
+} ShardLoad;
+
+/* Fills in the shards of the database with the '*.txt' files of 'directory', sorted by their names. */
+static void application_find_shards(Application* application, const char* const directory);
+
+/* Orders the shards by their paths (see 'qsort'). */
+static int application_compare_shards(const void* left, const void* right);
+
+/* Function of a loader thread: reads the poems of a shard from its file, or from its previous generation if the file is corrupt. */
+static void* application_load_shard(void* argument);
+
+/* Destroys the poems read by 'storage_load' and their array. Accepts NULL. */
+static void application_destroy_poems(String** poems, size_t count);
+
+/*
+  Trains a symbol table on a sample of the shard files and enables the compression of the poems with it (see '--compress').
+  The poems are then compressed as they are loaded, and only those accessed recently are kept decompressed (see 'string_trim_hot').
+*/
+static void application_compress(Application* application);
+
+/* Loads every shard (in parallel if there are several) into the vector, then the metadata of each shard. */
+static void application_load_shards(Application* application);
+
+/*
+  Merges the changes made to the shard files by other programs since the last command (if any).
+  A shard without unsaved edits stays saved; otherwise the changes are merged with the edits (see 'Reload.h').
+*/
+static void application_reload(Application* application);
+
+/* Inserts a new poem to the end of a shard (the last one by default). Usage: i [shard] */
+static void application_command_insert(Application* application, const ApplicationCommand* const command);
+
+/*
+  Prints out the elements of the database in a formatted way.
+  Usage: l [from] [to] -- or l from-to. If omitted, 'from' is the first and 'to' is the last poem.
+  If there are several shards, each poem is numbered as 'shard:index'.
+*/
+static void application_command_list(Application *application, const ApplicationCommand* const command);
+
+/* Funky asynchronous task spedified in Part 2. Usage: w [shard] -- the poems are drawn from every shard by default. */
+static void application_command_sprinkle(Application *application, const ApplicationCommand* const command);
+
+/* Forks the child of the round of 'slot' and sends the round's poems to it through a pipe. */
+static void application_command_sprinkle_process_start(Application* application, size_t slot);
 
-/* Inserts a new poem to the end of the database. */
-static void application_command_insert(Application* application);
+/* Function of the child process related to the 'sprinkle' command. */
+static pid_t application_command_sprinkle_child_async(int, int, size_t);
+
+/*
+  Collects a finished sprinkle round: the chosen poem is marked as used by its identifier and the round's
+  references to the poems are released. Returns false if no round has finished, unless 'wait' is true,
+  in which case it waits for a round in flight (if any).
+*/
+static bool application_collect_round(Application* application, bool wait);
+
+/* Collects every finished round. If 'wait' is true, it waits for every round in flight. */
+static void application_collect_rounds(Application* application, bool wait);
+
+/* Sets the score of the poems at the specified indices or ranges of indices. Usage: score weight index... */
+static void application_command_score(Application *application, const ApplicationCommand* const command);
+
+/*
+  Sorts the database by the given keys (alphabetically by default). Usage: sort [alpha|length|used...]
+  Later keys break the ties of the earlier ones; poems that are equal by every key keep their order.
+*/
+static void application_command_sort(Application *application, const ApplicationCommand* const command);
+
+/* Removes every poem that is equal to an earlier one. The order of the remaining poems does not change. */
+static void application_command_uniq(Application *application, const ApplicationCommand* const command);
+
+/* Prints out each available command and their usage. */
+static void application_command_help(Application *application, const ApplicationCommand* const command);
+
+/*
+  Saves the contents of the database if it was changes at runtime. If not, it does nothing.
+  In batch mode, saving is deferred to the end of the run.
+*/
+static void application_command_save(Application *application, const ApplicationCommand* const command);
+
+/*
+  Starts writing the shards whose poems (or their metadata) have changed since the last save on a background thread.
+  The poems and the metadata are taken first, so the database can be edited while the files are written.
+  A save in flight is waited for first. Returns false (after saying so) if there is nothing to save.
+*/
+static bool application_start_save(Application* application);
+
+/*
+  Function of the save thread: writes the poems of each job if they have changed and their metadata, replacing
+  both files atomically (see 'Storage.h'), and computes the new bases of the reloader.
+*/
+static void* application_save_thread(void* argument);
+
+/*
+  Finishes the save in flight once its thread is done (or waits for it if 'wait' is true): the saved shards count as
+  saved at the state the save started from, the reloader takes their new bases, and the outcome is reported.
+*/
+static void application_collect_save(Application* application, bool wait);
+
+/* Quits the applicaion. Before quitting, it asks whether to save all modifications or not.  */
+static void application_command_quit(Application *application, const ApplicationCommand* const command);
+
+/* Removes the poems at the specified indices or ranges of indices (the union of the ranges, if they overlap). */
+static void application_command_remove(Application *application, const ApplicationCommand* const command);
+
+/* Edits the poems at the specified indices or ranges of indices. */
+static void application_command_edit(Application *application, const ApplicationCommand* const command);
+
+/* Reverts the last modification(s). Usage: u [steps] */
+static void application_command_undo(Application *application, const ApplicationCommand* const command);
+
+/* Re-applies the last reverted modification(s). Usage: y [steps] */
+static void application_command_redo(Application *application, const ApplicationCommand* const command);
+
+/* Prints out the latency percentiles of each command and the global counters. */
+static void application_command_stats(Application *application, const ApplicationCommand* const command);
+
+/* Prints out the file, the number of poems and the state of each shard. */
+static void application_command_shards(Application *application, const ApplicationCommand* const command);
+
+/*
+  Writes the shard given as the only argument of 'command' (numbered from 1) to 'shard', numbered from 0.
+  If there is no argument, 'shard' is left unchanged. Prints an error message and returns false if there is no such shard.
+*/
+static bool application_get_shard_argument(const Application* const application, const ApplicationCommand* const command, size_t* shard);
+
+/* Converts the ranges of the command given as 'shard:index' into indices of the database. Prints an error message if invalid. */
+static bool application_resolve_shards(const Application* const application, ApplicationCommand* command);
+
+/*
+  Tokenises the input in place: no memory is allocated, each token is a slice of 'line'.
+  Only the first 'length' characters of 'line' are considered.
+  The tokens are appended to 'tokens', which only allocates if there are more than 'MAX_TOKENS' of them.
+  Returns false upon failure.
+*/
+static bool application_tokenise_input(const char* const line, size_t length, TokenArray* tokens);
+
+/* Executes each command of a line. Commands are separated by 'COMMAND_SEPARATOR'. */
+static void application_execute_line(Application* application, const String* const line);
+
+/* Prints out a prompt if the application is interactive. Otherwise, it does nothing. */
+static void application_prompt(const Application* const application, const char* const format, ...);
+
+/* Prints out how many times each command was executed and how long it took. */
+static void application_print_timings(const Application* const application);
+
+/* Processes the tokens and returns the 'decoded' command. */
+static ApplicationCommand application_process_tokens(const Token* const tokens, size_t token_count);
+
+/*
+  Converts a token of the form 'number' or 'number-number', optionally prefixed by 'shard:', into a range.
+  Returns false if it is malformed.
+*/
+static bool application_parse_argument(const Token* const token, ArgumentRange* range);
+
+/*
+  Looks up 'token' among the keywords of 'descriptor' (case-insensitively, like the command names).
+  If found, its index is written to 'keyword'. Returns false if the command has no such keyword.
+*/
+static bool application_match_keyword(const CommandDescriptor* const descriptor, const Token* const token, size_t* keyword);
+
+/* Checks whether each range of the command falls into [1..size]. Prints an error message if not. */
+static bool application_validate_ranges(const Application* const application, const ApplicationCommand* const command);
+
+/*
+  Checks whether 'poem' can be stored: it is not empty, and it cannot be mistaken for the footer of a shard file
+  (see 'storage_is_footer'). Prints an error message about the latter, or a prompt to try again if 'is_interactive'.
+*/
+static bool application_validate_poem(const String* const poem, bool is_interactive);
+
+/* Executes the command that is passed in to the function. */
+static void application_execute_command(Application *application);
+
+/* Keywords of 'sort', in the order of 'SortKey'. */
+static const char* const sort_keywords[] = {"alpha", "length", "used", NULL};
+
+/*
+  Table of the available commands, indexed by 'Command'.
+  Command names are matched case-insensitively.
+*/
+static const CommandDescriptor command_table[] = {
+    [INSERT]   = {"i", INSERT,   0, 1,             application_command_insert,   NULL},
+    [LIST]     = {"l", LIST,     0, 2,             application_command_list,     NULL},
+    [SPRINKLE] = {"w", SPRINKLE, 0, 1,             application_command_sprinkle, NULL},
+    [HELP]     = {"h", HELP,     0, 0,             application_command_help,     NULL},
+    [SAVE]     = {"s", SAVE,     0, 0,             application_command_save,     NULL},
+    [QUIT]     = {"q", QUIT,     0, 0,             application_command_quit,     NULL},
+    [EDIT]     = {"e", EDIT,     1, MAX_ARGUMENTS, application_command_edit,     NULL},
+    [REMOVE]   = {"r", REMOVE,   1, MAX_ARGUMENTS, application_command_remove,   NULL},
+    [UNDO]     = {"u", UNDO,     0, 1,             application_command_undo,     NULL},
+    [REDO]     = {"y", REDO,     0, 1,             application_command_redo,     NULL},
+    [STATS]    = {"stats", STATS, 0, 0,            application_command_stats,    NULL},
+    [SCORE]    = {"score", SCORE, 2, MAX_ARGUMENTS, application_command_score,   NULL},
+    [SORT]     = {"sort", SORT,   0, 3,            application_command_sort,     sort_keywords},
+    [UNIQ]     = {"uniq", UNIQ,   0, 0,            application_command_uniq,     NULL},
+    [SHARDS]   = {"shards", SHARDS, 0, 0,          application_command_shards,   NULL},
+};
+
+#define COMMAND_TABLE_SIZE (sizeof(command_table) / sizeof(command_table[0]))
+
+/* Descriptive names of the commands, used in reports. */
+static const char* const command_names[NUMBER_OF_COMMANDS] = {
+    "none", "insert", "list", "sprinkle", "help", "save", "quit", "edit", "remove", "undo", "redo", "stats", "score", "sort", "uniq", "shards", "error"
+};
+
+void application_initialise(Application *const application, int argc, char** argv)
+{
+    // puts("Initialisation in progress.");
+    application->input = stdin;
+    application->is_interactive = isatty(STDIN_FILENO);
+    application->save_requested = false;
+    application->is_quiet = false;
+    application->statistics_path = NULL;
+    application->trace_path = NULL;
+    application->sprinkle_engine = NULL;
+    application->active_rounds = 0;
+    memset(application->rounds, 0, sizeof(application->rounds));
+    SprinkleEngineType engine_type = SPRINKLE_ENGINE_PROCESS;
+    SelectionPolicy policy = SELECTION_UNIFORM;
+    size_t history_budget = DEFAULT_HISTORY_BUDGET;
+    const char* shard_directory = NULL;
+    bool is_compressed = false;
+    bool is_budgeted = false;
+    size_t memory_budget = 0;
+    application->symbol_table = NULL;
+    application->spill_file = NULL;
+    application->memory_budget = 0;
+    application->save.is_running = false;
+    application->save.job_count = 0;
+    application->output_buffer = NULL;
+    memset(application->timings, 0, sizeof(application->timings));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--batch") == 0)
+        {
+            application->is_interactive = false;
+
+            // the script is optional: another option (or '-', the standard input) does not name one
+            if (i + 1 < argc && strcmp(argv[i + 1], "-") == 0)
+            {
+                i++;
+            }
+            else if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+            {
+                application->input = fopen(argv[++i], "r");
+
+                if (application->input == NULL)
+                {
+                    fprintf(stderr, "Error: opening script \"%s\" failed.\n", argv[i]);
+                    exit(-1);
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--quiet") == 0)
+        {
+            application->is_quiet = true;
+        }
+        else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc)
+        {
+            history_budget = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+        {
+            application->statistics_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            application->trace_path = argv[++i];
+
+            if (!trace_enable())
+            {
+                perror("Error: enabling tracing failed.");
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc &&
+                 (strcmp(argv[i + 1], "process") == 0 || strcmp(argv[i + 1], "thread") == 0))
+        {
+            engine_type = strcmp(argv[++i], "thread") == 0 ? SPRINKLE_ENGINE_THREAD : SPRINKLE_ENGINE_PROCESS;
+        }
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc &&
+                 (strcmp(argv[i + 1], "uniform") == 0 || strcmp(argv[i + 1], "lru") == 0 || strcmp(argv[i + 1], "weighted") == 0))
+        {
+            i++;
+            policy = strcmp(argv[i], "lru") == 0 ? SELECTION_LRU :
+                     strcmp(argv[i], "weighted") == 0 ? SELECTION_WEIGHTED : SELECTION_UNIFORM;
+        }
+        else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc)
+        {
+            shard_directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--compress") == 0)
+        {
+            is_compressed = true;
+        }
+        else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc)
+        {
+            is_budgeted = true;
+            memory_budget = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc &&
+                 (strcmp(argv[i + 1], "uring") == 0 || strcmp(argv[i + 1], "blocking") == 0))
+        {
+            storage_set_backend(strcmp(argv[++i], "blocking") == 0 ? STORAGE_BACKEND_BLOCKING : STORAGE_BACKEND_URING);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--quiet] [--history bytes] [--stats-json path] [--trace path] "
+                            "[--engine process|thread] [--policy uniform|lru|weighted] [--shards directory] [--compress] "
+                            "[--memory-budget bytes] [--io uring|blocking] [--batch [script]]\n", argv[0]);
+            exit(-1);
+        }
+    }
+
+    if (!application->is_interactive)
+    {
+        application->output_buffer = ALLOCATE_ARRAY(char, BATCH_OUTPUT_BUFFER_SIZE);
+
+        if (application->output_buffer != NULL)
+        {
+            setvbuf(stdout, application->output_buffer, _IOFBF, BATCH_OUTPUT_BUFFER_SIZE);
+            // the listings are flushed with the rest of the output
+            vector_set_buffered_output(true);
+        }
+    }
+
+    if (shard_directory != NULL)
+    {
+        application_find_shards(application, shard_directory);
+    }
+    else
+    {
+        application->shard_count = 1;
+        snprintf(application->shards[0].path, SHARD_PATH_MAX_LENGTH, "%s", FILENAME);
+        snprintf(application->shards[0].metadata_path, SHARD_PATH_MAX_LENGTH, "%s", METADATA_FILENAME);
+    }
+
+    application->quit_state = false;
+    application->is_edited = false;
+    application->command_to_execute = (ApplicationCommand){NO_COMMAND, 0, {{NO_ARGUMENTS, NO_ARGUMENTS, 0}}, 0, {0}};
+    strncpy(application->program_name, argv[0], PROGRAM_NAME_MAX_LENGTH);
+    application->vector = vector_construct();
+
+    application->history = history_construct(history_budget);
+    application->selector = selector_construct(policy);
+    // seeded once: re-seeding with the time before every round repeats the same draws within a second
+    srand(time(NULL));
+
+    if (application->vector == NULL || application->history == NULL || application->selector == NULL)
+    {
+        perror("Error: instantiation of vector failed.");
+        exit(-1);
+    }
+
+    if (engine_type == SPRINKLE_ENGINE_THREAD)
+    {
+        application->sprinkle_engine = sprinkle_engine_construct(MAX_NUMBER_OF_CHILDREN);
+
+        if (application->sprinkle_engine == NULL)
+        {
+            perror("Error: starting the bunny threads failed.");
+            exit(-1);
+        }
+    }
+
+    if (is_compressed)
+    {
+        application_compress(application);
+    }
+
+    if (is_budgeted)
+    {
+        // enabled before loading, so that the poems beyond the budget go straight to the spill file
+        const char* directory = getenv("TMPDIR");
+        application->spill_file = spill_file_construct(directory != NULL ? directory : SPILL_DIRECTORY);
+
+        if (application->spill_file == NULL)
+        {
+            fprintf(stderr, "Error: creating the spill file failed - the memory budget is ignored.\n");
+        }
+        else
+        {
+            string_set_spill_file(application->spill_file, memory_budget);
+            application->memory_budget = memory_budget;
+        }
+    }
+
+    application_load_shards(application);
+    application->reloader = reloader_construct();
+
+    // without inotify, the shard files are only read at startup
+    for (size_t i = 0; application->reloader != NULL && i < application->shard_count; i++)
+    {
+        reloader_watch(application->reloader, i, application->shards[i].path);
+        reloader_set_base(application->reloader, application->vector, i);
+    }
+}
+
+static void application_compress(Application* application)
+{
+    // the table is trained before loading, so that each poem can be compressed as soon as it is read
+    char* sample = ALLOCATE_ARRAY(char, SYMBOL_TABLE_SAMPLE_SIZE);
+    size_t size = 0;
+
+    for (size_t i = 0; sample != NULL && i < application->shard_count; i++)
+    {
+        size += storage_read_sample(application->shards[i].path, sample + size, SYMBOL_TABLE_SAMPLE_SIZE / application->shard_count);
+    }
+
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        capacity += sample[i] == '\n' ? 1 : 0;
+    }
+
+    const char** lines = ALLOCATE_ARRAY(const char*, capacity + 1);
+    size_t* lengths = ALLOCATE_ARRAY(size_t, capacity + 1);
+    size_t count = 0;
+
+    for (size_t start = 0, i = 0; lines != NULL && lengths != NULL && i < size; i++)
+    {
+        if (sample[i] != '\n')
+        {
+            continue;
+        }
+
+        if (i > start && !storage_is_footer(sample + start, i - start))
+        {
+            lines[count] = sample + start;
+            lengths[count++] = i - start;
+        }
+
+        start = i + 1;
+    }
+
+    application->symbol_table = sample != NULL && lines != NULL && lengths != NULL ? symbol_table_train(lines, lengths, count) : NULL;
+    DEALLOCATE(lengths);
+    DEALLOCATE(lines);
+    DEALLOCATE(sample);
+
+    if (application->symbol_table == NULL)
+    {
+        fprintf(stderr, "Error: training the symbol table failed - the poems are not compressed.\n");
+        return;
+    }
+
+    string_set_symbol_table(application->symbol_table, COMPRESSION_HOT_POEMS);
+}
+
+static void application_reload(Application* application)
+{
+    // our own save may be renaming files: the events wait until it is collected
+    if (application->reloader == NULL || application->save.is_running || !reloader_poll(application->reloader))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        Shard* shard = &application->shards[i];
+        bool is_saved = vector_get_shard_version(application->vector, i) == shard->saved_version;
+        ReloadResult result;
+
+        if (!reloader_apply(application->reloader, application->vector, application->history, i, &result))
+        {
+            continue;
+        }
+
+        // the database is still what the files hold, unless it was edited before
+        if (is_saved)
+        {
+            shard->saved_version = vector_get_shard_version(application->vector, i);
+        }
+
+        if (!application->is_edited)
+        {
+            history_mark_saved(application->history);
+        }
+
+        printf("Reloaded \"%s\": %lu poem(s) added, %lu removed%s.\n", shard->path, result.inserted, result.removed,
+               result.conflicts > 0 ? " (with conflicts)" : "");
+    }
+}
+
+static void application_find_shards(Application* application, const char* const directory)
+{
+    DIR* stream = opendir(directory);
+
+    if (stream == NULL)
+    {
+        fprintf(stderr, "Error: opening directory \"%s\" failed.\n", directory);
+        exit(-1);
+    }
+
+    size_t extension_length = strlen(SHARD_EXTENSION);
+    struct dirent* entry;
+    application->shard_count = 0;
+
+    while ((entry = readdir(stream)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+
+        if (length <= extension_length || strcmp(entry->d_name + length - extension_length, SHARD_EXTENSION) != 0)
+        {
+            continue;
+        }
+
+        if (application->shard_count == MAX_SHARDS)
+        {
+            fprintf(stderr, "Error: too many shards in \"%s\" (at most %d).\n", directory, MAX_SHARDS);
+            exit(-1);
+        }
+
+        Shard* shard = &application->shards[application->shard_count++];
+        snprintf(shard->path, SHARD_PATH_MAX_LENGTH, "%s/%s", directory, entry->d_name);
+        snprintf(shard->metadata_path, SHARD_PATH_MAX_LENGTH, "%s/%.*s%s",
+                 directory, (int)(length - extension_length), entry->d_name, METADATA_EXTENSION);
+    }
+
+    closedir(stream);
+
+    if (application->shard_count == 0)
+    {
+        fprintf(stderr, "Error: no shards (\"*%s\" files) found in \"%s\".\n", SHARD_EXTENSION, directory);
+        exit(-1);
+    }
+
+    // 'readdir' returns the files in no particular order
+    qsort(application->shards, application->shard_count, sizeof(Shard), application_compare_shards);
+}
+
+static int application_compare_shards(const void* left, const void* right)
+{
+    return strcmp(((const Shard*)left)->path, ((const Shard*)right)->path);
+}
+
+static void* application_load_shard(void* argument)
+{
+    ShardLoad* load = argument;
+    load->status = storage_load(load->shard->path, load->number, &load->poems, &load->count);
+
+    if (load->status != STORAGE_CORRUPT)
+    {
+        return NULL;
+    }
+
+    // the file was damaged (e.g. by a crash of another writer): fall back to the previous generation
+    char previous[SHARD_PATH_MAX_LENGTH + sizeof(STORAGE_PREVIOUS_SUFFIX)];
+    snprintf(previous, sizeof(previous), "%s%s", load->shard->path, STORAGE_PREVIOUS_SUFFIX);
+    String** poems = NULL;
+    size_t count = 0;
+
+    // a previous generation without a footer (e.g. the file before its first save) is taken unchecked
+    StorageStatus status = access(previous, F_OK) == 0 ? storage_load(previous, load->number, &poems, &count)
+                                                      : STORAGE_FAILED;
+
+    if (status == STORAGE_VALID || status == STORAGE_UNCHECKED)
+    {
+        application_destroy_poems(load->poems, load->count);
+        load->poems = poems;
+        load->count = count;
+        load->is_recovered = true;
+    }
+    else
+    {
+        application_destroy_poems(poems, count);
+    }
+
+    return NULL;
+}
+
+static void application_destroy_poems(String** poems, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        string_destroy(poems[i]);
+    }
+
+    DEALLOCATE(poems);
+}
+
+static void application_load_shards(Application* application)
+{
+    ShardLoad loads[MAX_SHARDS];
+    pthread_t threads[MAX_SHARDS];
+    bool is_started[MAX_SHARDS] = {false};
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        loads[i] = (ShardLoad){&application->shards[i], i, NULL, 0, STORAGE_FAILED, false};
+    }
+
+    // the shards are read in parallel, but appended in order, so that each shard is in one piece
+    if (application->shard_count == 1)
+    {
+        application_load_shard(&loads[0]);
+    }
+    else
+    {
+        for (size_t i = 0; i < application->shard_count; i++)
+        {
+            is_started[i] = pthread_create(&threads[i], NULL, application_load_shard, &loads[i]) == 0;
+
+            if (!is_started[i])
+            {
+                application_load_shard(&loads[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        if (is_started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // the table is sized once for every shard
+    size_t total = vector_get_size(application->vector);
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        total += loads[i].count;
+    }
+
+    vector_reserve(application->vector, total);
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        Shard* shard = &application->shards[i];
+
+        if (loads[i].status == STORAGE_FAILED)
+        {
+            fprintf(stderr, "Error: opening file \"%s\" failed.\n", shard->path);
+            exit(-1);
+        }
+        else if (loads[i].is_recovered)
+        {
+            fprintf(stderr, "Warning: \"%s\" is corrupt - loaded its previous generation.\n", shard->path);
+        }
+        else if (loads[i].status == STORAGE_CORRUPT)
+        {
+            fprintf(stderr, "Warning: \"%s\" is corrupt and has no valid previous generation - loaded as is.\n", shard->path);
+        }
+
+        for (size_t j = 0; j < loads[i].count; j++)
+        {
+            vector_append(application->vector, loads[i].poems[j]);
+        }
+
+        // the metadata is matched to the poems by their hashes
+        PoemId* ids = ALLOCATE_ARRAY(PoemId, loads[i].count + 1);
+        unsigned long long* hashes = ALLOCATE_ARRAY(unsigned long long, loads[i].count + 1);
+        bool is_hashed = ids != NULL && hashes != NULL && reloader_hash_poems(loads[i].poems, loads[i].count, ids, hashes);
+        DEALLOCATE(loads[i].poems);
+        shard->saved_version = vector_get_shard_version(application->vector, i);
+        shard->is_corrupt = loads[i].status == STORAGE_CORRUPT;
+
+        if (loads[i].is_recovered)
+        {
+            // the next save replaces the damaged file
+            shard->saved_version--;
+            application->is_edited = true;
+        }
+
+        // the metadata file is optional
+        FILE* metadata = fopen(shard->metadata_path, "r");
+
+        if (metadata != NULL)
+        {
+            if (!selector_read_metadata(application->selector, application->vector, i, is_hashed ? hashes : NULL, metadata))
+            {
+                fprintf(stderr, "Warning: \"%s\" does not match its shard - ignored.\n", shard->metadata_path);
+            }
+
+            fclose(metadata);
+        }
+
+        DEALLOCATE(ids);
+        DEALLOCATE(hashes);
+    }
+}
+
+int application_run(Application* application)
+{
+    if (application->is_interactive && !application->is_quiet)
+    {
+        puts("=== Easter Bunny's Poems ===");
+        ApplicationCommand list = {LIST, 0, {{NO_ARGUMENTS, NO_ARGUMENTS, 0}}, 0, {0}};
+        application_command_list(application, &list);
+    }
+
+    while (!application->quit_state && !feof(application->input))
+    {
+        application_prompt(application, "> ");
+        String* input = string_read_line(application->input);
+        application_execute_line(application, input);
+        string_destroy(input);
+        // between two lines, no pointer to the contents of a poem is held
+        string_trim_hot();
+    }
+
+    // the rounds still in flight mark their poems before anything is saved or written out
+    application_collect_rounds(application, true);
+    application_collect_save(application, true);
+
+    if (!application->is_interactive)
+    {
+        // the deferred save of batch mode
+        if (application->save_requested)
+        {
+            application_save(application);
+        }
+
+        fflush(stdout);
+        application_print_timings(application);
+    }
+
+    if (application->statistics_path != NULL)
+    {
+        FILE* statistics_file = fopen(application->statistics_path, "w");
+
+        if (statistics_file == NULL)
+        {
+            fprintf(stderr, "Error: opening file \"%s\" failed.\n", application->statistics_path);
+        }
+        else
+        {
+            statistics_write_json(statistics_file, command_names, NUMBER_OF_COMMANDS);
+            fclose(statistics_file);
+        }
+    }
+
+    if (application->trace_path != NULL)
+    {
+        FILE* trace_file = fopen(application->trace_path, "w");
+
+        if (trace_file == NULL)
+        {
+            fprintf(stderr, "Error: opening file \"%s\" failed.\n", application->trace_path);
+        }
+        else
+        {
+            trace_write_chrome_json(trace_file);
+            fclose(trace_file);
+        }
+    }
+
+    return application_destroy(application);
+}
+
+int application_destroy(Application* const application)
+{
+    if (application->input != stdin)
+    {
+        fclose(application->input);
+    }
+
+    application->input = NULL;
+
+    if (application->output_buffer != NULL)
+    {
+        fflush(stdout);
+        setvbuf(stdout, NULL, _IONBF, 0);
+        vector_set_buffered_output(false);
+        DEALLOCATE(application->output_buffer);
+        application->output_buffer = NULL;
+    }
+
+    application_collect_rounds(application, true);
+    application_collect_save(application, true);
+    sprinkle_engine_destroy(application->sprinkle_engine);
+    history_destroy(application->history);
+    selector_destroy(application->selector);
+    reloader_destroy(application->reloader);
+    vector_destroy(application->vector);
+    trace_destroy();
+    application->sprinkle_engine = NULL;
+    application->history = NULL;
+    application->selector = NULL;
+    application->reloader = NULL;
+    application->vector = NULL;
+    // every compressed or spilled poem is gone
+    string_set_symbol_table(NULL, 0);
+    string_set_spill_file(NULL, 0);
+    symbol_table_destroy(application->symbol_table);
+    spill_file_destroy(application->spill_file);
+    application->symbol_table = NULL;
+    application->spill_file = NULL;
+    return EXIT_SUCCESS;
+}
+
+static void application_execute_line(Application* application, const String* const line)
+{
+    const char* segment = string_get_data(line);
+    const char* end = segment + string_get_length(line);
+    TokenArray tokens;
+    token_array_initialise(&tokens);
+
+    while (segment <= end && !application->quit_state)
+    {
+        const char* separator = memchr(segment, COMMAND_SEPARATOR, (size_t)(end - segment));
+        const char* segment_end = separator != NULL ? separator : end;
+
+        token_array_clear(&tokens);
+
+        if (!application_tokenise_input(segment, (size_t)(segment_end - segment), &tokens))
+        {
+            fprintf(stderr, "Error: not enough memory to tokenise the line.\n");
+            break;
+        }
+
+        application->command_to_execute = application_process_tokens(tokens.data, tokens.size);
+        application_execute_command(application);
+
+        segment = segment_end + 1;
+    }
+
+    token_array_release(&tokens);
+}
+
+static void application_prompt(const Application* const application, const char* const format, ...)
+{
+    if (application->is_interactive)
+    {
+        va_list arguments;
+        va_start(arguments, format);
+        vprintf(format, arguments);
+        va_end(arguments);
+    }
+}
+
+static void application_print_timings(const Application* const application)
+{
+    fprintf(stderr, "%-10s %10s %14s %14s\n", "command", "count", "total [ms]", "average [us]");
+
+    for (size_t i = 0; i < NUMBER_OF_COMMANDS; i++)
+    {
+        const CommandTiming* timing = &application->timings[i];
+
+        if (timing->count > 0)
+        {
+            fprintf(stderr, "%-10s %10lu %14.3f %14.3f\n",
+                    command_names[i], timing->count,
+                    timing->total_nanoseconds / 1e6,
+                    timing->total_nanoseconds / 1e3 / timing->count);
+        }
+    }
+}
+
+static void application_command_insert(Application* application, const ApplicationCommand* const command)
+{
+    size_t shard = application->shard_count - 1;
+
+    if (!application_get_shard_argument(application, command, &shard))
+    {
+        return;
+    }
+
+    application_prompt(application, "Insert new poem > ");
+    String* poem = string_read_line(application->input);
+    bool is_valid = application_validate_poem(poem, application->is_interactive);
+
+    while (!is_valid && !feof(application->input))
+    {
+        string_destroy(poem);
+        poem = string_read_line(application->input);
+        is_valid = application_validate_poem(poem, application->is_interactive);
+    }
+
+    if (is_valid)
+    {
+        // the end of the shard, which is the end of the database for the last shard
+        size_t index = vector_get_shard_start(application->vector, shard) + vector_get_shard_size(application->vector, shard);
+        string_set_shard(poem, shard);
+        history_begin_step(application->history);
+        vector_insert_range(application->vector, index, &poem, 1);
+
+        if (!history_record_insert(application->history, index))
+        {
+            // the insertion could not be undone, so it is taken back
+            vector_detach_range(application->vector, index, 1, &poem);
+            string_destroy(poem);
+            fprintf(stderr, "Error: not enough memory to insert the poem.\n");
+            return;
+        }
+    }
+    else
+    {
+        // no empty strings (or footers) are added
+        string_destroy(poem);
+    }
+
+    if (!application->is_edited)
+    {
+        application->is_edited = true;
+    }
+}
+
+static void application_command_list(Application* application, const ApplicationCommand* const command)
+{
+    size_t size = vector_get_size(application->vector);
+    Argument from = 1;
+    Argument to = size;
+
+    if (command->argument_count == 1)
+    {
+        // 'l 5' lists from the 5th poem onwards, 'l 5-10' lists the given range
+        from = command->arguments[0].first;
+        to = command->arguments[0].first == command->arguments[0].last ? size : command->arguments[0].last;
+    }
+    else if (command->argument_count == 2)
+    {
+        from = command->arguments[0].first;
+        to = command->arguments[1].last;
+    }
+
+    if (size > 0 && (from == NO_ARGUMENTS || from > size || from > to))
+    {
+        fprintf(stderr,
+                "Error: invalid range [%lu..%lu] - indices must fall in the range of [1..%lu].\n",
+                from, to, size);
+        return;
+    }
+
+    if (application->shard_count == 1 || size == 0)
+    {
+        vector_print_range(application->vector, from - 1, to);
+        return;
+    }
+
+    for (size_t shard = 0; shard < application->shard_count; shard++)
+    {
+        size_t start = vector_get_shard_start(application->vector, shard);
+        size_t end = start + vector_get_shard_size(application->vector, shard);
+        // the part of the range that falls into the shard
+        size_t first = from - 1 > start ? from - 1 : start;
+        size_t last = to < end ? to : end;
+
+        if (first < last)
+        {
+            vector_print_shard_range(application->vector, shard, shard + 1, first - start, last - start);
+        }
+    }
+}
+
+static void application_command_sprinkle(Application* application, const ApplicationCommand* const command)
+{
+    size_t shard = SELECTION_ALL_SHARDS;
+
+    if (!application_get_shard_argument(application, command, &shard))
+    {
+        return;
+    }
+
+    // minimal error handling
+    if ((shard == SELECTION_ALL_SHARDS ? vector_get_size(application->vector) : vector_get_shard_size(application->vector, shard)) < 2)
+    {
+        fprintf(stderr, "Error: not enough poems to select from.\n");
+        return;
+    }
+
+    if (application->active_rounds == MAX_NUMBER_OF_CHILDREN)
+    {
+        application_collect_round(application, true);
+    }
+
+    PoemId drawn[2];
+
+    // the poems of the rounds in flight cannot be drawn, so those rounds may have to finish first
+    while (!selector_draw(application->selector, application->vector, shard, drawn))
+    {
+        if (!application_collect_round(application, true))
+        {
+            fprintf(stderr, selector_get_policy(application->selector) == SELECTION_UNIFORM ?
+                            "Error: you need at least 2 unused poems in the database.\n" :
+                            "Error: you need at least 2 poems that can be selected (see 'score').\n");
+            return;
+        }
+    }
+
+    int random = random_generator(MAX_NUMBER_OF_CHILDREN, true);
+    size_t slot = random - 1;
+
+    // every bunny has its own slot; a busy bunny hands the round over to the next idle one
+    while (application->rounds[slot].is_active)
+    {
+        slot = (slot + 1) % MAX_NUMBER_OF_CHILDREN;
+    }
+
+    SprinkleRound* round = &application->rounds[slot];
+    round->poems[0] = string_retain(vector_get_string_by_id(application->vector, drawn[0]));
+    round->poems[1] = string_retain(vector_get_string_by_id(application->vector, drawn[1]));
+    round->is_active = true;
+    application->active_rounds++;
+    trace_begin_round(slot);
+    round->start = trace_now();
+
+    if (application->sprinkle_engine != NULL)
+    {
+        // copied by the engine before it returns, so the text may be frozen or spilled while the bunny reads it
+        const char* poems[2] = {string_get_data(round->poems[0]), string_get_data(round->poems[1])};
+        sprinkle_engine_start(application->sprinkle_engine, slot, poems);
+    }
+    else
+    {
+        application_command_sprinkle_process_start(application, slot);
+    }
+
+    puts("[PARENT] Poems have been sent");
+}
+
+static void application_command_sprinkle_process_start(Application* application, size_t slot)
+{
+    SprinkleRound* round = &application->rounds[slot];
+    key_t key = ftok(application->program_name, 1);
+
+    char poems[2][MSQUEUE_BUFFER];
+    memset(poems[0], 0, MSQUEUE_BUFFER);
+    memset(poems[1], 0, MSQUEUE_BUFFER);
+
+    for (int i = 0; i < 2; i++)
+    {
+        size_t poem_size = string_get_size(round->poems[i]);
+        poem_size = poem_size < MSQUEUE_BUFFER ? poem_size : MSQUEUE_BUFFER;
+        strncpy(poems[i], string_get_data(round->poems[i]), poem_size);
+        poems[i][poem_size - 1] = '\0';
+    }
+
+    int pipe_io[IO_PORTS];
+    unsigned long long phase_start = trace_now();
+
+    if (pipe(pipe_io) < 0)
+    {
+        perror("Creating pipe failed. :(");
+        exit(EXIT_FAILURE);
+    }
+
+    trace_record(TRACE_PIPE, phase_start);
+    phase_start = trace_now();
+    round->msqueue_id = msgget(key, 0600 | IPC_CREAT);
+    trace_record(TRACE_MSGGET, phase_start);
+
+    // SIGUSR1 stays blocked until 'sigsuspend', otherwise the child's signal may arrive before the parent waits for it
+    sigset_t signal_mask, previous_mask;
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &signal_mask, &previous_mask);
+    phase_start = trace_now();
+    round->child = application_command_sprinkle_child_async(pipe_io[RECEIVE], round->msqueue_id, slot);
+    trace_record(TRACE_FORK, phase_start);
+    phase_start = trace_now();
+    sigsuspend(&previous_mask);
+    sigprocmask(SIG_SETMASK, &previous_mask, NULL);
+    trace_record(TRACE_SIGNAL_WAIT, phase_start);
+    phase_start = trace_now();
+    write(pipe_io[SEND], poems, 2 * MSQUEUE_BUFFER);
+    trace_record(TRACE_PIPE_WRITE, phase_start);
+
+    // the poems fit into the pipe's buffer, so the parent's ends can be closed right away
+    close(pipe_io[RECEIVE]);
+    close(pipe_io[SEND]);
+}
+
+static pid_t application_command_sprinkle_child_async(int pipe_io, int msqueue_id, size_t slot)
+{
+    // pending output would otherwise be duplicated into the child's buffer
+    fflush(stdout);
+    pid_t thread = fork();
+
+    if (thread < 0)
+    {
+        perror("Fork failed. :(");
+        exit(EXIT_FAILURE);
+    }
+    if (thread > 0)
+    {
+        return thread;
+    }
+
+    trace_enter_child(slot);
+    unsigned long long child_start = trace_now();
+    unsigned long long phase_start = child_start;
+    kill(getppid(), SIGUSR1);
+    trace_record(TRACE_SIGNAL_SEND, phase_start);
+    srand(getpid());
+
+    char poems[2][MSQUEUE_BUFFER];
+    memset(poems[0], 0, MSQUEUE_BUFFER);
+    memset(poems[1], 0, MSQUEUE_BUFFER);
+
+    phase_start = trace_now();
+    int error_read = read(pipe_io, poems, 2 * MSQUEUE_BUFFER);
+    trace_record(TRACE_PIPE_READ, phase_start);
+    poems[0][strlen(poems[0])] = '\0';
+    poems[1][strlen(poems[1])] = '\0';
+
+    if (error_read < 0)
+    {
+        perror("reading string 1 failed");
+    }
+
+    puts("[CHILD] Received poems:");
+
+    for (int i = 0; i < 2; i++)
+    {
+        printf("[%d] %s\n", i + 1, poems[i]);
+    }
+
+    int random = random_generator(2, false);
+    puts("[CHILD] Poem has been chosen");
+    int status;
+    MessageQueue msqueue;
+
+    puts(poems[random]);
+    puts("Szabad-e locsolni?");
+    // each slot has its own message type, so concurrent rounds do not take each other's replies
+    msqueue.mtype = MSQUEUE_TYPE + slot;
+    msqueue.choice = random;
+    strncpy(msqueue.mtext, poems[random], MSQUEUE_BUFFER);
+    phase_start = trace_now();
+    status = msgsnd(msqueue_id, &msqueue, sizeof(msqueue.choice) + strlen(poems[random]) + 1, 0);
+    trace_record(TRACE_MSGSND, phase_start);
+
+    if (status < 0)
+    {
+        perror("Message queue: sending message failed :(");
+    }
+
+    puts("[CHILD] Poem has been sent");
+    trace_record(TRACE_CHILD, child_start);
+    // the 'atexit' handlers belong to the parent (e.g. the leak report would list its allocations)
+    fflush(stdout);
+    _exit(EXIT_SUCCESS);
+}
+
+/* Reaps the child of the round of 'slot' (waiting for it if 'wait' is true) and receives its reply. */
+static bool application_collect_process_round(Application* application, size_t slot, bool wait, int* choice)
+{
+    SprinkleRound* round = &application->rounds[slot];
+    int child_status;
+    unsigned long long phase_start = trace_now();
+
+    if (waitpid(round->child, &child_status, wait ? 0 : WNOHANG) != round->child)
+    {
+        return false;
+    }
+
+    trace_record(TRACE_WAITPID, phase_start);
+
+    // the child has sent its reply before exiting
+    MessageQueue msqueue;
+    phase_start = trace_now();
+    ssize_t msqueue_status =
+        msgrcv(round->msqueue_id, &msqueue, sizeof(msqueue.choice) + MSQUEUE_BUFFER, MSQUEUE_TYPE + slot, IPC_NOWAIT);
+    trace_record(TRACE_MSGRCV, phase_start);
+
+    if (msqueue_status < 0)
+    {
+        perror("Message queue: receiving message failed :(");
+        *choice = -1;
+    }
+    else
+    {
+        *choice = (int)msqueue.choice;
+    }
+
+    return true;
+}
+
+static bool application_collect_round(Application* application, bool wait)
+{
+    if (application->active_rounds == 0)
+    {
+        return false;
+    }
+
+    size_t slot = 0;
+    int choice = -1;
+
+    if (application->sprinkle_engine != NULL)
+    {
+        if (!sprinkle_engine_collect(application->sprinkle_engine, wait, &slot, &choice))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        bool is_collected = false;
+
+        for (size_t i = 0; i < MAX_NUMBER_OF_CHILDREN && !is_collected; i++)
+        {
+            if (application->rounds[i].is_active && application_collect_process_round(application, i, false, &choice))
+            {
+                slot = i;
+                is_collected = true;
+            }
+        }
+
+        if (!is_collected && wait)
+        {
+            // waiting for the oldest round
+            size_t oldest = MAX_NUMBER_OF_CHILDREN;
+
+            for (size_t i = 0; i < MAX_NUMBER_OF_CHILDREN; i++)
+            {
+                if (application->rounds[i].is_active &&
+                    (oldest == MAX_NUMBER_OF_CHILDREN || application->rounds[i].start < application->rounds[oldest].start))
+                {
+                    oldest = i;
+                }
+            }
+
+            slot = oldest;
+            is_collected = application_collect_process_round(application, slot, true, &choice);
+        }
+
+        if (!is_collected)
+        {
+            return false;
+        }
+    }
 
-/* Prints out each element of the database in a formatted way. */
-static void application_command_list(Application *application);
+    SprinkleRound* round = &application->rounds[slot];
+    puts("[PARENT] Poem has been received.");
+
+    // the poem may have been edited or moved since the round started, or even removed
+    if (choice == 0 || choice == 1)
+    {
+        vector_set_used_by_id(application->vector, string_get_id(round->poems[choice]));
+    }
+
+    selector_release(application->selector, application->vector, string_get_id(round->poems[0]), choice == 0);
+    selector_release(application->selector, application->vector, string_get_id(round->poems[1]), choice == 1);
+
+    string_destroy(round->poems[0]);
+    string_destroy(round->poems[1]);
+    round->poems[0] = round->poems[1] = NULL;
+    round->is_active = false;
+    application->active_rounds--;
+
+    trace_record(TRACE_ROUND, round->start);
+    trace_end_round(slot);
+    STATISTICS_COUNT_SPRINKLE();
+    return true;
+}
+
+static void application_collect_rounds(Application* application, bool wait)
+{
+    while (application_collect_round(application, wait))
+    {
+    }
+}
+
+static void application_command_save(Application* const application, const ApplicationCommand* const command)
+{
+    (void)command;
+
+    if (!application->is_interactive)
+    {
+        // batch mode: the database is saved only once, at the end of the run
+        application->save_requested = true;
+        return;
+    }
+
+    if (!application_start_save(application))
+    {
+        return;
+    }
+
+    // a small save is reported right away; a large one is collected before a later command
+    for (int i = 0; i < SAVE_FOREGROUND_MILLISECONDS && !atomic_load(&application->save.is_done); i++)
+    {
+        nanosleep(&(struct timespec){0, 1000000}, NULL);
+    }
+
+    if (atomic_load(&application->save.is_done))
+    {
+        application_collect_save(application, true);
+    }
+    else
+    {
+        puts("Saving in the background...");
+    }
+}
+
+void application_save(Application* const application)
+{
+    if (application_start_save(application))
+    {
+        application_collect_save(application, true);
+    }
+}
+
+static bool application_start_save(Application* application)
+{
+    BackgroundSave* save = &application->save;
+    application_collect_save(application, true);
+    save->job_count = 0;
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        Shard* shard = &application->shards[i];
+        bool is_changed = application->is_edited && vector_get_shard_version(application->vector, i) != shard->saved_version;
+
+        if (!is_changed && !selector_is_dirty(application->selector, i))
+        {
+            continue;
+        }
+
+        // the metadata is written whenever the poems are
+        size_t start = vector_get_shard_start(application->vector, i);
+        size_t count = vector_get_shard_size(application->vector, i);
+        SaveJob* job = &save->jobs[save->job_count++];
+        *job = (SaveJob){0};
+        job->number = i;
+        job->path = shard->path;
+        job->metadata_path = shard->metadata_path;
+        job->is_changed = is_changed;
+        job->version = vector_get_shard_version(application->vector, i);
+        job->is_previous_kept = shard->is_corrupt;
+        job->count = count;
+        job->last_used = ALLOCATE_ARRAY(unsigned long long, count + 1);
+        job->scores = ALLOCATE_ARRAY(unsigned, count + 1);
+        // the metadata is keyed by the hashes of the poems, so the poems of unchanged shards are hashed too
+        job->poems = ALLOCATE_ARRAY(String*, count + 1);
+        job->ids = ALLOCATE_ARRAY(PoemId, count + 1);
+        job->hashes = ALLOCATE_ARRAY(unsigned long long, count + 1);
+
+        if (job->last_used == NULL || job->scores == NULL || job->poems == NULL)
+        {
+            job->error = ENOMEM;
+            continue;
+        }
+
+        // each poem is held by the job until the save is collected, whatever happens to it in the database
+        for (size_t j = 0; j < count; j++)
+        {
+            job->poems[j] = string_retain(vector_get_string_at(application->vector, start + j));
+        }
+
+        selector_copy_metadata(application->selector, application->vector, i, job->last_used, job->scores);
+    }
+
+    if (save->job_count == 0 && !application->is_edited)
+    {
+        puts("No edits have been performed. Saving skipped.");
+        return false;
+    }
+
+    save->history_state = history_get_state(application->history);
+    save->is_running = true;
+    atomic_store(&save->is_done, false);
+
+    if (pthread_create(&save->thread, NULL, application_save_thread, save) != 0)
+    {
+        // no thread to spare: the files are written right away
+        save->thread = pthread_self();
+        application_save_thread(save);
+    }
+
+    return true;
+}
+
+static void* application_save_thread(void* argument)
+{
+    BackgroundSave* save = argument;
+
+    for (size_t i = 0; i < save->job_count; i++)
+    {
+        SaveJob* job = &save->jobs[i];
+
+        if (job->error != 0)
+        {
+            continue;
+        }
+
+        job->is_hashed = job->ids != NULL && job->hashes != NULL &&
+                         reloader_hash_poems(job->poems, job->count, job->ids, job->hashes);
+
+        if (job->is_changed)
+        {
+            if (!storage_save(job->poems, job->count, job->path, job->is_previous_kept))
+            {
+                job->error = errno;
+                continue;
+            }
+
+            job->is_saved = true;
+        }
+
+        // one line per poem, in the same order as the shard, keyed by its hash if there was memory to compute them
+        FILE* metadata = storage_open_temporary(job->metadata_path);
+
+        if (metadata == NULL)
+        {
+            job->error = errno;
+            continue;
+        }
+
+        selector_write_metadata(job->is_hashed ? job->hashes : NULL, job->last_used, job->scores, job->count, metadata);
+
+        if (!storage_commit(metadata, job->metadata_path))
+        {
+            job->error = errno;
+            continue;
+        }
+
+        job->is_metadata_saved = true;
+    }
+
+    atomic_store(&save->is_done, true);
+    return NULL;
+}
+
+static void application_collect_save(Application* application, bool wait)
+{
+    BackgroundSave* save = &application->save;
+
+    if (!save->is_running || (!wait && !atomic_load(&save->is_done)))
+    {
+        return;
+    }
+
+    if (!pthread_equal(save->thread, pthread_self()))
+    {
+        pthread_join(save->thread, NULL);
+    }
+
+    save->is_running = false;
+    bool is_saved = true;
+
+    for (size_t i = 0; i < save->job_count; i++)
+    {
+        SaveJob* job = &save->jobs[i];
+
+        if (job->is_saved)
+        {
+            application->shards[job->number].saved_version = job->version;
+            // the corrupt file has been replaced; later saves rotate the generations again
+            application->shards[job->number].is_corrupt = false;
+
+            if (application->reloader != NULL && job->is_hashed)
+            {
+                reloader_set_base_hashes(application->reloader, job->number, job->ids, job->hashes, job->count);
+            }
+            else if (application->reloader != NULL)
+            {
+                reloader_set_base(application->reloader, application->vector, job->number);
+            }
+        }
+
+        if (!job->is_metadata_saved)
+        {
+            // the shards that were saved stay saved; the others are retried by the next save
+            const char* path = job->is_changed && !job->is_saved ? job->path : job->metadata_path;
+            fprintf(stderr, "Error: saving \"%s\" failed (%s).\n", path, strerror(job->error));
+            selector_mark_dirty(application->selector, job->number);
+            is_saved = false;
+        }
+
+        for (size_t j = 0; job->poems != NULL && j < job->count; j++)
+        {
+            string_destroy(job->poems[j]);
+        }
+
+        DEALLOCATE(job->poems);
+        DEALLOCATE(job->last_used);
+        DEALLOCATE(job->scores);
+        DEALLOCATE(job->ids);
+        DEALLOCATE(job->hashes);
+    }
+
+    save->job_count = 0;
+
+    if (!is_saved)
+    {
+        puts("Saving failed.");
+        return;
+    }
+
+    history_mark_saved_state(application->history, save->history_state);
+    // edits made while the files were written are still to be saved
+    application->is_edited = false;
+
+    for (size_t i = 0; i < application->shard_count; i++)
+    {
+        bool is_changed = vector_get_shard_version(application->vector, i) != application->shards[i].saved_version;
+        application->is_edited = application->is_edited || is_changed;
+    }
+
+    puts("File has been saved successfully.");
+}
+
+static void application_command_quit(Application* application, const ApplicationCommand* const command)
+{
+    (void)command;
+    // the rounds in flight are part of what is saved, and a save in flight may leave nothing to ask about
+    application_collect_rounds(application, true);
+    application_collect_save(application, true);
+
+    if (application->is_edited && application->is_interactive)
+    {
+        printf("The database has been edited.\nDo you want to save changes? [Y/N] > ");
+        String* line = string_read_line(stdin);
+        string_transform_to_upper(line);
+
+        while (!string_are_equal_c(line, "Y") && !string_are_equal_c(line, "N") && !feof(stdin))
+        {
+            string_destroy(line);
+            printf("Invalid input. Try again. [Y/N] > ");
+            line = string_read_line(stdin);
+            string_transform_to_upper(line);
+        }
+
+        if (string_are_equal_c(line, "Y"))
+        {
+            application_save(application);
+        }
+
+        string_destroy(line);
+    }
+
+    application->quit_state = true;
+}
+
+static void application_command_help(Application* application, const ApplicationCommand* const command)
+{
+    (void)command;
+
+    puts("=== Easter Bunny's Poems ===");
+    puts("Commands:");
+    puts("\ti [shard] - insert; inserts a new poem at the end of the shard (the last one by default).");
+    puts("\tl [from] [to] - list; enumerates the poems in the database (all of them by default).");
+    puts("\tw [shard] - sprinkle; throw water onto a girl according to the ancient Hungarian Easter-related folk tradition.");
+    puts("\t            The poems are drawn from the given shard, or from every shard by default.");
+    puts("\th - help; prints out all available commands.");
+    puts("\ts - save; saves database.");
+    puts("\tq - quit; quits the program if no edits were performed.");
+    puts("\t          Otherwise, asks the user about saving the changes.");
+    puts("\te [number...] - edit; edits the poems at the specified indices.");
+    puts("\tr [number...] - remove; removes the poems at the specified indices.");
+    puts("\tu [steps] - undo; reverts the last modification(s) (insert, edit or remove).");
+    puts("\ty [steps] - redo; re-applies the last reverted modification(s).");
+    puts("\tstats - statistics; prints out the latency of each command, the I/O counters and the memory usage.");
+    puts("\tscore weight [number...] - score; sets the weight of the poems at the specified indices (policy 'weighted').");
+    puts("\tsort [alpha|length|used...] - sort; sorts the poems by the given keys (alphabetically by default).");
+    puts("\tuniq - unique; removes every poem that is equal to an earlier one of the same shard.");
+    puts("\tshards - shards; lists the shards of the database, their size and whether they were edited.");
+    puts("Remarks:");
+    puts("\t- All commands can be capitalised.");
+    puts("\t- Arguments must be separated by a whitespace character.");
+    puts("\t- Instead of a single index, a range of indices can be given as 'from-to' (e.g. r 10-500).");
+    puts("\t- An index (or range) can be given within a shard as 'shard:index' (e.g. e 2:5 or r 3:1-10).");
+    printf("\t- Indices must fall in the range of [1..'n'] (where 'n' == %lu).\n", vector_get_size(application->vector));
+}
+
+static void application_command_remove(Application* application, const ApplicationCommand* const command)
+{
+    if (!application_validate_ranges(application, command))
+    {
+        return;
+    }
+
+    ArgumentRange ranges[MAX_ARGUMENTS];
+    size_t range_count = command->argument_count;
+    memcpy(ranges, command->arguments, range_count * sizeof(ArgumentRange));
+
+    // sorting the ranges in ascending order of their first indices
+    for (size_t i = 1; i < range_count; i++)
+    {
+        ArgumentRange current = ranges[i];
+        size_t j = i;
+
+        while (j > 0 && ranges[j - 1].first > current.first)
+        {
+            ranges[j] = ranges[j - 1];
+            j--;
+        }
+
+        ranges[j] = current;
+    }
+
+    // overlapping and adjacent ranges are merged into their union
+    size_t merged_count = 0;
+
+    for (size_t i = 0; i < range_count; i++)
+    {
+        if (merged_count > 0 && ranges[i].first <= ranges[merged_count - 1].last + 1)
+        {
+            if (ranges[i].last > ranges[merged_count - 1].last)
+            {
+                ranges[merged_count - 1].last = ranges[i].last;
+            }
+        }
+        else
+        {
+            ranges[merged_count++] = ranges[i];
+        }
+    }
+
+    // the removed poems are handed over to the history instead of being destroyed;
+    // their arrays are allocated up front, so that the command removes either every range or none
+    String** removed[MAX_ARGUMENTS] = {NULL};
+    bool is_allocated = true;
+
+    for (size_t i = 0; i < merged_count; i++)
+    {
+        removed[i] = ALLOCATE_ARRAY(String*, ranges[i].last - ranges[i].first + 1);
+        is_allocated = is_allocated && removed[i] != NULL;
+    }
+
+    if (!is_allocated)
+    {
+        for (size_t i = 0; i < merged_count; i++)
+        {
+            DEALLOCATE(removed[i]);
+        }
+
+        fprintf(stderr, "Error: not enough memory to remove the poems.\n");
+        return;
+    }
+
+    history_begin_step(application->history);
+
+    // removed from the last range to the first, so that removals do not shift pending indices
+    for (size_t i = merged_count; i-- > 0;)
+    {
+        size_t count = ranges[i].last - ranges[i].first + 1;
+        vector_detach_range(application->vector, ranges[i].first - 1, count, removed[i]);
+        history_record_remove(application->history, ranges[i].first - 1, removed[i], count);
+    }
+
+    if (!application->is_edited)
+    {
+        application->is_edited = true;
+    }
+}
+
+static void application_command_edit(Application* application, const ApplicationCommand* const command)
+{
+    if (!application_validate_ranges(application, command))
+    {
+        return;
+    }
+
+    FILE* input = application->input;
+    bool is_step_started = false;
+
+    for (size_t i = 0; i < command->argument_count && !feof(input); i++)
+    {
+        for (Argument index = command->arguments[i].first; index <= command->arguments[i].last && !feof(input); index++)
+        {
+            application_prompt(application, "Edit poem %lu > ", index);
+            String *edited_poem = string_read_line(input);
+            bool is_valid = application_validate_poem(edited_poem, application->is_interactive);
+
+            while (!is_valid && !feof(input))
+            {
+                string_destroy(edited_poem);
+                edited_poem = string_read_line(input);
+                is_valid = application_validate_poem(edited_poem, application->is_interactive);
+            }
+
+            if (!is_valid)
+            {
+                // input ended before a valid poem was entered
+                string_destroy(edited_poem);
+                break;
+            }
+
+            if (!is_step_started)
+            {
+                history_begin_step(application->history);
+                is_step_started = true;
+            }
+
+            String* old_poem = vector_replace_at(application->vector, index - 1, edited_poem);
+
+            if (!history_record_edit(application->history, index - 1, old_poem))
+            {
+                // the edit could not be undone, so the old poem is put back
+                string_destroy(vector_replace_at(application->vector, index - 1, old_poem));
+                fprintf(stderr, "Error: not enough memory to edit poem %lu.\n", index);
+                return;
+            }
+
+            if (!application->is_edited)
+            {
+                application->is_edited = true;
+            }
+        }
+    }
+}
+
+static void application_command_undo(Application* application, const ApplicationCommand* const command)
+{
+    size_t steps = command->argument_count > 0 ? command->arguments[0].first : 1;
+    size_t undone = history_undo(application->history, application->vector, steps);
+
+    if (undone == 0)
+    {
+        puts("Nothing to undo.");
+        return;
+    }
+
+    application->is_edited = !history_is_at_saved(application->history);
+    printf("Undone %lu step(s). %lu step(s) left to undo.\n",
+           undone, history_get_undo_count(application->history));
+}
+
+static void application_command_redo(Application* application, const ApplicationCommand* const command)
+{
+    size_t steps = command->argument_count > 0 ? command->arguments[0].first : 1;
+    size_t redone = history_redo(application->history, application->vector, steps);
+
+    if (redone == 0)
+    {
+        puts("Nothing to redo.");
+        return;
+    }
 
-/* Funky asynchronous task spedified in Part 2. */
-static void application_command_sprinkle(Application *application);
+    application->is_edited = !history_is_at_saved(application->history);
+    printf("Redone %lu step(s). %lu step(s) left to redo.\n",
+           redone, history_get_redo_count(application->history));
+}
 
-/* Function of the child process related to the 'sprinkle' command. */
-static pid_t application_command_sprinkle_child_async(int, int);
+static void application_command_stats(Application* application, const ApplicationCommand* const command)
+{
+    (void)command;
 
-/* Prints out each available command and their usage. */
-static void application_command_help(Application *application);
+    statistics_print(stdout, command_names, NUMBER_OF_COMMANDS);
 
-/* Saves the contents of the database if it was changes at runtime. If not, it does nothing. */
-static void application_command_save(Application *application);
+    StringCacheStatistics cache;
+    string_get_cache_statistics(&cache);
+    size_t accesses = cache.hits + cache.misses;
 
-/* Quits the applicaion. Before quitting, it asks whether to save all modifications or not.  */
-static void application_command_quit(Application *application);
+    // with a spill file, the compressed poems are on disk (see 'string_set_spill_file')
+    if (application->symbol_table != NULL && application->spill_file == NULL)
+    {
+        printf("compression: %lu symbols, %lu poems compressed (%lu -> %lu bytes, %.2fx), %lu hot\n",
+               symbol_table_get_symbol_count(application->symbol_table), cache.packed_count,
+               cache.packed_length, cache.packed_bytes,
+               cache.packed_bytes > 0 ? (double)cache.packed_length / cache.packed_bytes : 1.0,
+               cache.hot_count);
+    }
 
-/* Removes a poem at the specified index. */
-static void application_command_remove(Application *application, Argument argument);
+    if (application->spill_file != NULL)
+    {
+        printf("memory budget: %lu of %lu bytes of poems in memory (%lu poems), %lu poems spilled (%llu bytes on disk), "
+               "%lu read back\n", cache.hot_bytes, application->memory_budget, cache.hot_count, cache.spilled_count,
+               spill_file_get_size(application->spill_file), cache.spill_reads);
+    }
 
-/* Edits a poem at the specified index. */
-static void application_command_edit(Application *application, Argument argument);
+    if (application->symbol_table != NULL || application->spill_file != NULL)
+    {
+        printf("hot cache: %lu hits, %lu misses (hit rate %.1f%%)\n", cache.hits, cache.misses,
+               accesses > 0 ? 100.0 * cache.hits / accesses : 0.0);
+    }
 
-/* Tokenises the input. Returns a vector of strings (i.e. tokens). */
-static Vector *application_tokenise_input(const String *const string);
+    if (MEMORY_ACCOUNTING)
+    {
+        size_t poems = vector_get_size(application->vector);
+        size_t text_bytes = vector_get_text_length(application->vector);
+        // the output buffer of batch mode does not grow with the database
+        size_t live_bytes = memory_get_live_bytes() - (application->output_buffer != NULL ? BATCH_OUTPUT_BUFFER_SIZE : 0);
 
-/* Processes the tokens and returns the 'decoded' command. */
-static ApplicationCommand application_process_tokens(const Vector *const tokens);
+        memory_print_report(stdout);
 
-/* Executes the command that is passed in to the function. */
-static void application_execute_command(Application *application);
+        if (poems > 0)
+        {
+            // everything beyond the characters of the poems is overhead (headers, terminators, the vector, etc.)
+            printf("bytes per poem: %.1f (text: %.1f, overhead: %.1f)\n",
+                   (double)live_bytes / poems,
+                   (double)text_bytes / poems,
+                   ((double)live_bytes - text_bytes) / poems);
+        }
+    }
+}
 
-void application_initialise(Application *const application, const char* const name)
+static void application_command_score(Application* application, const ApplicationCommand* const command)
 {
-    // puts("Initialisation in progress.");
-    application->file = fopen(FILENAME, "a+");
+    const ArgumentRange* score = &command->arguments[0];
 
-    if (application->file == NULL)
+    if (score->first != score->last)
     {
-        fprintf(stderr, "Error: opening file \"%s\" failed.\n", FILENAME);
-        exit(-1);
+        fprintf(stderr, "Error: the score must be a single number.\n");
+        return;
     }
 
-    application->quit_state = false;
-    application->is_edited = false;
-    application->command_to_execute = (ApplicationCommand){NO_COMMAND, NO_ARGUMENTS};
-    strncpy(application->program_name, name, PROGRAM_NAME_MAX_LENGTH);
-    application->vector = vector_construct();
+    // the remaining arguments are the indices
+    ApplicationCommand indices = {command->command, command->argument_count - 1, {{NO_ARGUMENTS, NO_ARGUMENTS, 0}}, 0, {0}};
+    memcpy(indices.arguments, command->arguments + 1, indices.argument_count * sizeof(ArgumentRange));
 
-    if (application->vector == NULL)
+    if (!application_validate_ranges(application, &indices))
     {
-        perror("Error: instantiation of vector failed.");
-        exit(-1);
+        return;
     }
 
-    while (!feof(application->file))
+    for (size_t i = 0; i < indices.argument_count; i++)
     {
-        String *line = string_read_line(application->file);
-
-        if (!string_are_equal_c(line, ""))
-        {
-            vector_append(application->vector, line);
-        }
-        else
+        for (Argument index = indices.arguments[i].first; index <= indices.arguments[i].last; index++)
         {
-            // no empty strings are added
-            string_destroy(line);
+            PoemId id = string_get_id(vector_get_string_at(application->vector, index - 1));
+            selector_set_score(application->selector, application->vector, id, (unsigned)score->first);
         }
     }
-
-    fclose(application->file);
-    application->file = NULL;
 }
 
-int application_run(Application* application)
+static void application_command_sort(Application* application, const ApplicationCommand* const command)
 {
-    puts("=== Easter Bunny's Poems ===");
-    vector_print(application->vector);
-
-    while (!application->quit_state && !feof(stdin))
+    if (command->argument_count > 0)
     {
-        printf("> ");
-        String* input = string_read_line(stdin);
-        Vector* tokens = application_tokenise_input(input);
-        application->command_to_execute = application_process_tokens(tokens);
-        application_execute_command(application);
-        vector_destroy(tokens);
-        string_destroy(input);
+        fprintf(stderr, "Error: unknown sort key - the keys are 'alpha', 'length' and 'used'.\n");
+        return;
     }
 
-    vector_destroy(application->vector);
-    return application->file != NULL ? fclose(application->file) : EXIT_SUCCESS;
-}
-
-static void application_command_insert(Application* application)
-{
-    printf("Insert new poem > ");
-    String* poem = string_read_line(stdin);
+    SortKey keys[MAX_ARGUMENTS + 1];
+    size_t key_count = 0;
 
-    while (string_are_equal_c(poem, "") && !feof(stdin))
+    // with several shards, the poems are sorted within their shard, which keeps each shard in one piece
+    if (application->shard_count > 1)
     {
-        fprintf(stderr, "Invalid input. Try again. > ");
-        string_destroy(poem);
-        poem = string_read_line(stdin);
+        keys[key_count++] = SORT_SHARD;
     }
 
-    if (!string_are_equal_c(poem, ""))
+    for (size_t i = 0; i < command->keyword_count; i++)
     {
-        vector_append(application->vector, poem);
+        keys[key_count++] = (SortKey)command->keywords[i];
     }
-    else
+
+    if (command->keyword_count == 0)
     {
-        // no empty strings are added
-        string_destroy(poem);
+        keys[key_count++] = SORT_ALPHABETICAL;
     }
 
-    if (!application->is_edited)
+    size_t size = vector_get_size(application->vector);
+
+    if (size < 2)
     {
-        application->is_edited = true;
+        return;
     }
-}
 
-static void application_command_list(Application* application)
-{
-    vector_print(application->vector);
-}
+    String** strings = ALLOCATE_ARRAY(String*, size);
+    size_t* order = ALLOCATE_ARRAY(size_t, size);
 
-static void application_command_sprinkle(Application* application)
-{
-    // minimal error handling
-    if (vector_get_size(application->vector) < 2)
+    for (size_t i = 0; i < size; i++)
     {
-        fprintf(stderr, "Error: not enough poems to select from.\n");
-        return;
+        strings[i] = vector_get_string_at(application->vector, i);
     }
 
-    if (vector_get_used_count(application->vector) > (vector_get_size(application->vector) - 2))
+    if (!sort_strings(strings, size, keys, key_count, order))
     {
-        fprintf(stderr, "Error: you need at least 2 unused poems in the database.\n");
+        fprintf(stderr, "Error: not enough memory to sort the database.\n");
+        DEALLOCATE(strings);
+        DEALLOCATE(order);
         return;
     }
 
-    srand(time(NULL));
-    int random = random_generator(MAX_NUMBER_OF_CHILDREN, true);
+    // 'sorted' receives the previous order from 'vector_permute', which the history keeps for undoing
+    String** sorted = ALLOCATE_ARRAY(String*, size);
+    bool is_changed = false;
 
-    int child_status;
-    pid_t child_process;
+    for (size_t i = 0; i < size; i++)
+    {
+        sorted[i] = strings[order[i]];
+        is_changed = is_changed || order[i] != i;
+    }
 
-    int poem_index_01 = random_generator(vector_get_size(application->vector), false);
+    DEALLOCATE(strings);
+    DEALLOCATE(order);
 
-    while (string_get_is_used(vector_get_string_at(application->vector, poem_index_01)))
+    if (!is_changed)
     {
-        poem_index_01 = random_generator(vector_get_size(application->vector), false);
+        DEALLOCATE(sorted);
+        return;
     }
 
-    int poem_index_02 = random_generator(vector_get_size(application->vector), false);
+    history_begin_step(application->history);
+    vector_permute(application->vector, sorted);
+    history_record_reorder(application->history, sorted, size);
 
-    // so that the two indices are different
-    while (string_get_is_used(vector_get_string_at(application->vector, poem_index_02)) ||
-           poem_index_02 == poem_index_01)
+    if (!application->is_edited)
     {
-        poem_index_02 = random_generator(vector_get_size(application->vector), false);
+        application->is_edited = true;
     }
+}
 
-    size_t poem_01_size = string_get_size(vector_get_string_at(application->vector, poem_index_01));
-    size_t poem_02_size = string_get_size(vector_get_string_at(application->vector, poem_index_02));
-
-    MessageQueue msqueue;
-    int msqueue_id;
-    int msqueue_status;
-    key_t key = ftok(application->program_name, 1);
+static void application_command_uniq(Application* application, const ApplicationCommand* const command)
+{
+    (void)command;
 
-    char poems[2][MSQUEUE_BUFFER];
-    memset(poems[0], 0, MSQUEUE_BUFFER);
-    memset(poems[1], 0, MSQUEUE_BUFFER);
+    size_t size = vector_get_size(application->vector);
+    size_t duplicates = 0;
 
-    strncpy(poems[0], vector_get_at(application->vector, poem_index_01), poem_01_size);
-    strncpy(poems[1], vector_get_at(application->vector, poem_index_02), poem_02_size);
-    poems[0][poem_01_size - 1] = '\0';
-    poems[1][poem_02_size - 1] = '\0';
+    if (size < 2)
+    {
+        puts("Removed 0 duplicate(s).");
+        return;
+    }
 
-    int pipe_io[IO_PORTS];
+    String** strings = ALLOCATE_ARRAY(String*, size);
+    size_t* order = ALLOCATE_ARRAY(size_t, size);
+    // duplicates are only looked for within each shard
+    const SortKey keys[] = {SORT_SHARD, SORT_ALPHABETICAL};
+    size_t first_key = application->shard_count > 1 ? 0 : 1;
 
-    if (pipe(pipe_io) < 0)
+    for (size_t i = 0; i < size; i++)
     {
-        perror("Creating pipe failed. :(");
-        exit(EXIT_FAILURE);
+        strings[i] = vector_get_string_at(application->vector, i);
     }
 
-    msqueue_id = msgget(key, 0600 | IPC_CREAT);
-
-    switch (random)
+    if (!sort_strings(strings, size, keys + first_key, 2 - first_key, order))
     {
-    case 1:
-        child_process = application_command_sprinkle_child_async(pipe_io[RECEIVE], msqueue_id);
-        break;
-    case 2:
-        child_process = application_command_sprinkle_child_async(pipe_io[RECEIVE], msqueue_id);
-        break;
-    case 3:
-        child_process = application_command_sprinkle_child_async(pipe_io[RECEIVE], msqueue_id);
-        break;
-    case 4:
-        child_process = application_command_sprinkle_child_async(pipe_io[RECEIVE], msqueue_id);
-        break;
-    default:
-        break;
+        fprintf(stderr, "Error: not enough memory to sort the database.\n");
+        DEALLOCATE(strings);
+        DEALLOCATE(order);
+        return;
     }
-    pause();
-    write(pipe_io[SEND], poems, 2 * MSQUEUE_BUFFER);
-    puts("[PARENT] Poems have been sent");
 
-    msqueue_status = msgrcv(msqueue_id, &msqueue, MSQUEUE_BUFFER, MSQUEUE_TYPE, 0);
+    // equal poems are adjacent in 'order', and the sort is stable, so the first of them is the earliest one
+    bool* is_duplicate = ALLOCATE_ARRAY(bool, size);
 
-    if (msqueue_status < 0)
+    for (size_t i = 1; i < size; i++)
     {
-        perror("Message queue: receiving message failed :(");
+        if (string_get_shard(strings[order[i]]) == string_get_shard(strings[order[i - 1]]) &&
+            string_are_equal(strings[order[i]], strings[order[i - 1]]))
+        {
+            is_duplicate[order[i]] = true;
+            duplicates++;
+        }
     }
 
-    puts("[PARENT] Poem has been received.");
+    if (duplicates > 0)
+    {
+        // the duplicates are moved to the end (both parts keeping their order), then removed in one go
+        String** arranged = ALLOCATE_ARRAY(String*, size);
+        size_t kept = 0;
+        size_t moved = size - duplicates;
 
-    waitpid(child_process, &child_status, 0);
-    close(pipe_io[RECEIVE]);
-    close(pipe_io[SEND]);
+        for (size_t i = 0; i < size; i++)
+        {
+            arranged[is_duplicate[i] ? moved++ : kept++] = strings[i];
+        }
 
-    size_t used_index =
-        string_are_equal_c(vector_get_string_at(application->vector, poem_index_01), msqueue.mtext) ? 
-        poem_index_01 : poem_index_02;
+        history_begin_step(application->history);
+        vector_permute(application->vector, arranged);
+        history_record_reorder(application->history, arranged, size);
 
-    vector_set_used(application->vector, used_index);
+        String** removed = ALLOCATE_ARRAY(String*, duplicates);
+        vector_detach_range(application->vector, size - duplicates, duplicates, removed);
+        history_record_remove(application->history, size - duplicates, removed, duplicates);
+
+        if (!application->is_edited)
+        {
+            application->is_edited = true;
+        }
+    }
+
+    DEALLOCATE(strings);
+    DEALLOCATE(order);
+    DEALLOCATE(is_duplicate);
+    printf("Removed %lu duplicate(s).\n", duplicates);
 }
 
-static pid_t application_command_sprinkle_child_async(int pipe_io, int msqueue_id)
+static void application_command_shards(Application* application, const ApplicationCommand* const command)
 {
-    pid_t thread = fork();
+    (void)command;
 
-    if (thread < 0)
+    for (size_t i = 0; i < application->shard_count; i++)
     {
-        perror("Fork failed. :(");
-        exit(EXIT_FAILURE);
+        const Shard* shard = &application->shards[i];
+        bool is_edited = vector_get_shard_version(application->vector, i) != shard->saved_version ||
+                         selector_is_dirty(application->selector, i);
+        size_t start = vector_get_shard_start(application->vector, i);
+        size_t size = vector_get_shard_size(application->vector, i);
+        printf("[%lu] %s - %lu poem(s), %lu used%s\n", i + 1, shard->path, size,
+               vector_count_used(application->vector, start, start + size), is_edited ? ", edited" : "");
     }
-    if (thread > 0)
+}
+
+static bool application_get_shard_argument(const Application* const application, const ApplicationCommand* const command, size_t* shard)
+{
+    if (command->argument_count == 0)
     {
-        return thread;
+        return true;
     }
 
-    kill(getppid(), SIGUSR1);
-    srand(getpid());
-
-    char poems[2][MSQUEUE_BUFFER];
-    memset(poems[0], 0, MSQUEUE_BUFFER);
-    memset(poems[1], 0, MSQUEUE_BUFFER);
-
-    int error_read = read(pipe_io, poems, 2 * MSQUEUE_BUFFER);
-    poems[0][strlen(poems[0])] = '\0';
-    poems[1][strlen(poems[1])] = '\0';
+    const ArgumentRange* argument = &command->arguments[0];
 
-    if (error_read < 0)
+    if (argument->first != argument->last || argument->first > application->shard_count)
     {
-        perror("reading string 1 failed");
+        fprintf(stderr, "Error: invalid shard - shards must fall in the range of [1..%lu].\n", application->shard_count);
+        return false;
     }
 
-    puts("[CHILD] Received poems:");
+    *shard = argument->first - 1;
+    return true;
+}
 
-    for (int i = 0; i < 2; i++)
+static bool application_resolve_shards(const Application* const application, ApplicationCommand* command)
+{
+    for (size_t i = 0; i < command->argument_count; i++)
     {
-        printf("[%d] %s\n", i + 1, poems[i]);
-    }
+        ArgumentRange* range = &command->arguments[i];
 
-    int random = random_generator(2, false);
-    puts("[CHILD] Poem has been chosen");
-    int status;
-    MessageQueue msqueue;
+        if (range->shard == 0)
+        {
+            continue;
+        }
 
-    puts(poems[random]);
-    puts("Szabad-e locsolni?");
-    msqueue.mtype = MSQUEUE_TYPE;
-    strncpy(msqueue.mtext, poems[random], MSQUEUE_BUFFER);
-    status = msgsnd(msqueue_id, &msqueue, strlen(poems[random]) + 1, 0);
+        if (range->shard > application->shard_count)
+        {
+            fprintf(stderr, "Error: invalid shard (%lu) - shards must fall in the range of [1..%lu].\n",
+                    range->shard, application->shard_count);
+            return false;
+        }
 
-    if (status < 0)
-    {
-        perror("Message queue: sending message failed :(");
+        size_t size = vector_get_shard_size(application->vector, range->shard - 1);
+
+        if (range->first == NO_ARGUMENTS || range->last > size)
+        {
+            fprintf(stderr, "Error: invalid index (%lu:%lu) - indices of shard %lu must fall in the range of [1..%lu].\n",
+                    range->shard, range->first == NO_ARGUMENTS ? range->first : range->last, range->shard, size);
+            return false;
+        }
+
+        size_t start = vector_get_shard_start(application->vector, range->shard - 1);
+        range->first += start;
+        range->last += start;
+        range->shard = 0;
     }
 
-    puts("[CHILD] Poem has been sent");
-    exit(EXIT_SUCCESS);
+    return true;
 }
 
-static void application_command_save(Application* const application)
+static bool application_validate_poem(const String* const poem, bool is_interactive)
 {
-    if (application->is_edited)
+    if (storage_is_footer(string_get_data(poem), string_get_length(poem)))
     {
-        application->file = fopen(FILENAME, "w");
+        fprintf(stderr, "Error: a poem cannot start with \"%s\".%s", STORAGE_FOOTER_MAGIC,
+                is_interactive ? " Try again. > " : "\n");
+        return false;
+    }
 
-        for (size_t i = 0; i < vector_get_size(application->vector); i++)
+    if (string_are_equal_c(poem, ""))
+    {
+        if (is_interactive)
         {
-            fprintf(application->file, "%s\n", vector_get_at(application->vector, i));
+            fprintf(stderr, "Invalid input: poem cannot be empty. Try again. > ");
         }
 
-        fclose(application->file);
-        application->file = NULL;
-        application->is_edited = false;
-        puts("File has been saved successfully.");
-    }
-    else
-    {
-        puts("No edits have been performed. Saving skipped.");
+        return false;
     }
+
+    return true;
 }
 
-static void application_command_quit(Application* application)
+static bool application_validate_ranges(const Application* const application, const ApplicationCommand* const command)
 {
-    if (application->is_edited)
-    {
-        printf("The database has been edited.\nDo you want to save changes? [Y/N] > ");
-        String* line = string_read_line(stdin);
-        string_transform_to_upper(line);
+    size_t size = vector_get_size(application->vector);
 
-        while (!string_are_equal_c(line, "Y") && !string_are_equal_c(line, "N") && !feof(stdin))
-        {
-            string_destroy(line);
-            printf("Invalid input. Try again. [Y/N] > ");
-            line = string_read_line(stdin);
-            string_transform_to_upper(line);
-        }
+    for (size_t i = 0; i < command->argument_count; i++)
+    {
+        const ArgumentRange* range = &command->arguments[i];
 
-        if (string_are_equal_c(line, "Y"))
+        if (range->first == NO_ARGUMENTS || range->last > size)
         {
-            application_command_save(application);
+            fprintf(stderr,
+                    "Error: invalid index (%lu) - indices must fall in the range of [1..%lu].\n",
+                    range->first == NO_ARGUMENTS ? range->first : range->last, size);
+            return false;
         }
-
-        string_destroy(line);
     }
 
-    application->quit_state = true;
+    return true;
 }
 
-static void application_command_help(Application* application)
+static bool application_tokenise_input(const char* const line, size_t length, TokenArray* tokens)
 {
-    puts("=== Easter Bunny's Poems ===");
-    puts("Commands:");
-    puts("\ti - insert; inserts a new poem.");
-    puts("\tl - list; enumerates each poem in the database.");
-    puts("\tw - sprinkle; throw water onto a girl according to the ancient Hungarian Easter-related folk tradition.");
-    puts("\th - help; prints out all available commands.");
-    puts("\ts - save; saves database.");
-    puts("\tq - quit; quits the program if no edits were performed.");
-    puts("\t          Otherwise, asks the user about saving the changes.");
-    puts("\te [number] - edit; edits the poem at the specified index.");
-    puts("\tr [number] - remove; removes the poem at the specified index.");
-    puts("Remarks:");
-    puts("\t- All commands can be capitalised.");
-    puts("\t- Arguments must be separated by a whitespace character.");
-    printf("\t- Indices must fall in the range of [1..'n'] (where 'n' == %lu).\n", vector_get_size(application->vector));
-}
+    const char* cursor = line;
+    const char* end = line + length;
 
-static void application_command_remove(Application* application, Argument argument)
-{
-    if (argument == NO_ARGUMENTS || argument > vector_get_size(application->vector))
-    {
-        fprintf(stderr,
-                "Error: invalid index (%lu) - indices must fall in the range of [1..%lu].\n",
-                argument, vector_get_size(application->vector));
-    }
-    else
+    while (true)
     {
-        vector_remove_at(application->vector, argument - 1);
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+        {
+            cursor++;
+        }
 
-        if (!application->is_edited)
+        if (cursor == end)
         {
-            application->is_edited = true;
+            break;
+        }
+
+        Token token = {cursor, 0};
+
+        while (cursor < end && *cursor != ' ' && *cursor != '\t')
+        {
+            cursor++;
+        }
+
+        token.length = (size_t)(cursor - token.data);
+
+        if (!ARRAY_PUSH(token_array, tokens, token))
+        {
+            return false;
         }
     }
+
+    return true;
 }
 
-static void application_command_edit(Application* application, Argument argument)
+static bool application_parse_argument(const Token* const token, ArgumentRange* range)
 {
-    if (argument == NO_ARGUMENTS || argument > vector_get_size(application->vector))
-    {
-        fprintf(stderr,
-                "Error: invalid index (%lu) - indices must fall in the range of [1..%lu].\n",
-                argument, vector_get_size(application->vector));
-    }
-    else
+    Argument values[2] = {0, 0};
+    size_t value_index = 0;
+    bool has_digit = false;
+    bool is_sharded = false;
+    Argument shard = 0;
+
+    for (size_t i = 0; i < token->length; i++)
     {
-        printf("Edit poem %lu > ", argument);
-        String *edited_poem = string_read_line(stdin);
+        char character = token->data[i];
 
-        while (string_are_equal_c(edited_poem, "") && !feof(stdin))
+        if (isdigit((unsigned char)character))
         {
-            fprintf(stderr, "Invalid input: poem cannot be empty. Try again. > ");
-            string_destroy(edited_poem);
-            edited_poem = string_read_line(stdin);
-        }
+            Argument digit = (Argument)(character - '0');
 
-        vector_set_at(application->vector, argument - 1, edited_poem);
+            // a number too large for 'Argument' is malformed rather than wrapped around
+            if (values[value_index] > ((Argument)-1 - digit) / 10)
+            {
+                return false;
+            }
 
-        if (!application->is_edited)
+            values[value_index] = values[value_index] * 10 + digit;
+            has_digit = true;
+        }
+        else if (character == '-' && value_index == 0 && has_digit)
         {
-            application->is_edited = true;
+            value_index++;
+            has_digit = false;
+        }
+        else if (character == ':' && value_index == 0 && has_digit && !is_sharded)
+        {
+            // the number read so far is the shard
+            shard = values[0];
+            values[0] = 0;
+            is_sharded = true;
+            has_digit = false;
         }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (!has_digit || (is_sharded && shard == 0))
+    {
+        return false;
     }
+
+    range->first = values[0];
+    range->last = value_index == 0 ? values[0] : values[1];
+    range->shard = shard;
+    return range->first <= range->last;
 }
 
-static Vector* application_tokenise_input(const String* const string)
+static bool application_match_keyword(const CommandDescriptor* const descriptor, const Token* const token, size_t* keyword)
 {
-    Vector* tokens = vector_construct();
-    char* copy = ALLOCATE_ARRAY(char, string_get_size(string));
-    strncpy(copy, string_get_data(string), string_get_size(string));
-    char delimiters[] = " \t";
-    char* token = strtok(copy, delimiters);
-
-    while (token != NULL)
+    for (size_t i = 0; descriptor->keywords != NULL && descriptor->keywords[i] != NULL; i++)
     {
-        vector_append(tokens, string_construct(token));
-        token = strtok(NULL, delimiters);
+        if (strlen(descriptor->keywords[i]) == token->length &&
+            strncasecmp(descriptor->keywords[i], token->data, token->length) == 0)
+        {
+            *keyword = i;
+            return true;
+        }
     }
 
-    free(copy);
-    return tokens;
+    return false;
 }
 
-static ApplicationCommand application_process_tokens(const Vector* const tokens)
+static ApplicationCommand application_process_tokens(const Token* const tokens, size_t token_count)
 {
-    if (tokens == NULL)
+    ApplicationCommand cmd = {NO_COMMAND, 0, {{NO_ARGUMENTS, NO_ARGUMENTS, 0}}, 0, {0}};
+
+    if (token_count == 0)
     {
-        // in case that vector 'tokens' is empty
-        return (ApplicationCommand){NO_COMMAND, NO_ARGUMENTS};
+        // in case that the line is empty
+        return cmd;
     }
 
-    size_t index = 0;
-    bool continue_args = false;
-    ApplicationCommand cmd = {NO_COMMAND, NO_ARGUMENTS};
+    const CommandDescriptor* descriptor = NULL;
 
-    if (index == 0 && index < vector_get_size(tokens))
+    for (size_t i = 0; i < COMMAND_TABLE_SIZE && descriptor == NULL; i++)
     {
-        if (string_get_length(vector_get_string_at(tokens, index)) != 1)
+        if (command_table[i].name != NULL &&
+            strlen(command_table[i].name) == tokens[0].length &&
+            strncasecmp(command_table[i].name, tokens[0].data, tokens[0].length) == 0)
         {
-            // unrecognised command (must be exactly 1 character long)
-            return (ApplicationCommand){ERROR, NO_ARGUMENTS};
+            descriptor = &command_table[i];
         }
-        else
-        {
-            // checks string command -- comparison of the first character
-            switch (vector_get_at(tokens, index)[0])
-            {
-            // commands requiring no arguments
-            case 'i':
-            case 'I':
-                return (ApplicationCommand){INSERT, NO_ARGUMENTS};
-            case 'l':
-            case 'L':
-                return (ApplicationCommand){LIST, NO_ARGUMENTS};
-            case 'w':
-            case 'W':
-                return (ApplicationCommand){SPRINKLE, NO_ARGUMENTS};
-            case 'h':
-            case 'H':
-                return (ApplicationCommand){HELP, NO_ARGUMENTS};
-            case 's':
-            case 'S':
-                return (ApplicationCommand){SAVE, NO_ARGUMENTS};
-            case 'q':
-            case 'Q':
-                return (ApplicationCommand){QUIT, NO_ARGUMENTS};
-
-            // commands requiring 1 argument
-            case 'e':
-            case 'E':
-                cmd.command = EDIT;
-                continue_args = true;
-                break;
-            case 'r':
-            case 'R':
-                cmd.command = REMOVE;
-                continue_args = true;
-                break;
+    }
 
-            // unrecognised command
-            default:
-                return (ApplicationCommand){ERROR, NO_ARGUMENTS};
-            }
-        }
+    if (descriptor == NULL)
+    {
+        // unrecognised command
+        cmd.command = ERROR;
+        return cmd;
+    }
+
+    size_t argument_count = token_count - 1;
+
+    if (argument_count < descriptor->min_arity)
+    {
+        fprintf(stderr, "Error: missing argument.\n");
+        return cmd;
     }
 
-    // if the command has an additional argument
-    if (continue_args)
+    if (argument_count > descriptor->max_arity)
     {
-        index++;
+        fprintf(stderr, "Error: too many arguments (at most %lu expected).\n", descriptor->max_arity);
+        return cmd;
+    }
+
+    size_t range_count = 0;
+
+    for (size_t i = 0; i < argument_count; i++)
+    {
+        size_t keyword = 0;
 
-        if (index < vector_get_size(tokens))
+        if (application_match_keyword(descriptor, &tokens[i + 1], &keyword))
         {
-            char* end;
-            // converts the second token to a 'long'
-            // 0 is equivalend to NO_ARGUMENTS
-            cmd.argument = strtoul(vector_get_at(tokens, index), &end, 10);
+            cmd.keywords[cmd.keyword_count++] = keyword;
+        }
+        else if (application_parse_argument(&tokens[i + 1], &cmd.arguments[range_count]))
+        {
+            range_count++;
         }
         else
         {
-            fprintf(stderr, "Error: missing argument.\n");
-            // cmd.command = ERROR;
+            fprintf(stderr, "Error: invalid argument \"%.*s\".\n", (int)tokens[i + 1].length, tokens[i + 1].data);
+            return cmd;
         }
     }
 
+    cmd.command = descriptor->command;
+    cmd.argument_count = range_count;
     return cmd;
 }
 
 static void application_execute_command(Application* const application)
 {
-    switch (application->command_to_execute.command)
-    {
-    // 0-argument functions
-    case INSERT:
-        application_command_insert(application);
-        break;
-    case LIST:
-        application_command_list(application);
-        break;
-    case SPRINKLE:
-        application_command_sprinkle(application);
-        break;
-    case HELP:
-        application_command_help(application);
-        break;
-    case SAVE:
-        application_command_save(application);
-        break;
-    case QUIT:
-        application_command_quit(application);
-        break;
-    // 1-argument functions
-    case EDIT:
-        application_command_edit(application, application->command_to_execute.argument);
-        break;
-    case REMOVE:
-        application_command_remove(application, application->command_to_execute.argument);
-        break;
-    // error message
-    case ERROR:
+    Command command = application->command_to_execute.command;
+    application_collect_rounds(application, false);
+    application_collect_save(application, false);
+    application_reload(application);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (command == ERROR)
+    {
         fprintf(stderr, "Error: unrecognised command.\n");
-        break;
-    // case NO_COMMAND: return;
-    default:
+    }
+    else if (!application_resolve_shards(application, &application->command_to_execute))
+    {
+        // the error message has been printed already
+    }
+    else if (command < COMMAND_TABLE_SIZE && command_table[command].handler != NULL)
+    {
+        command_table[command].handler(application, &application->command_to_execute);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (command == NO_COMMAND)
+    {
         return;
     }
+
+    unsigned long long elapsed =
+        (unsigned long long)(end.tv_sec - start.tv_sec) * 1000000000ULL + (end.tv_nsec - start.tv_nsec);
+    application->timings[command].count++;
+    application->timings[command].total_nanoseconds += elapsed;
+    STATISTICS_RECORD_LATENCY(command, elapsed);
 }
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "hdr/AsyncIo.h"
+#include "hdr/MemoryAllocation.h"
+
+/* Largest transfer of a single submission; longer requests are continued like short transfers. */
+#define ASYNC_IO_MAX_TRANSFER (1U << 30)
+
+typedef struct AsyncIoRequest {
+    int file;
+    char* buffer;
+    size_t size;
+    // bytes transferred so far
+    size_t done;
+    unsigned long long offset;
+    size_t tag;
+    long long result;
+    bool is_write;
+    bool is_busy;
+    bool is_complete;
+} AsyncIoRequest;
+
+struct AsyncIo
+{
+    // -1 with the blocking fallback
+    int ring;
+    // false once the kernel has turned down a request (e.g. it does not know the operation)
+    bool is_ring_usable;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    // entries written to the submission queue, but not submitted yet
+    unsigned queued;
+    AsyncIoRequest* requests;
+    size_t depth;
+    size_t pending;
+    // the requests that have completed but have not been returned by 'async_io_wait', in order
+    size_t* completed;
+    size_t completed_head;
+    size_t completed_count;
+};
+
+/* STATIC FUNCTIONS */
+
+static void async_io_unmap(AsyncIo* io)
+{
+    if (io->sqes != NULL && io->sqes != MAP_FAILED)
+    {
+        munmap(io->sqes, io->sqes_size);
+    }
+
+    if (io->cq_ring != NULL && io->cq_ring != MAP_FAILED && io->cq_ring != io->sq_ring)
+    {
+        munmap(io->cq_ring, io->cq_ring_size);
+    }
+
+    if (io->sq_ring != NULL && io->sq_ring != MAP_FAILED)
+    {
+        munmap(io->sq_ring, io->sq_ring_size);
+    }
+
+    io->sqes = NULL;
+    io->cq_ring = NULL;
+    io->sq_ring = NULL;
+}
+
+/* Sets up the ring and maps its queues. Returns false if io_uring is not available. */
+static bool async_io_setup_ring(AsyncIo* io)
+{
+    struct io_uring_params parameters;
+    memset(&parameters, 0, sizeof(parameters));
+    int ring = (int)syscall(__NR_io_uring_setup, (unsigned)io->depth, &parameters);
+
+    if (ring < 0)
+    {
+        return false;
+    }
+
+    io->sq_ring_size = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+    io->cq_ring_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+    io->sqes_size = parameters.sq_entries * sizeof(struct io_uring_sqe);
+    // with a single mapping, both queues live in the larger of the two sizes
+    bool is_single_mapping = (parameters.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (is_single_mapping)
+    {
+        io->sq_ring_size = io->sq_ring_size > io->cq_ring_size ? io->sq_ring_size : io->cq_ring_size;
+        io->cq_ring_size = io->sq_ring_size;
+    }
+
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring, IORING_OFF_SQ_RING);
+    io->cq_ring = is_single_mapping ? io->sq_ring
+                                    : mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring, IORING_OFF_CQ_RING);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring, IORING_OFF_SQES);
+
+    if (io->sq_ring == MAP_FAILED || io->cq_ring == MAP_FAILED || io->sqes == MAP_FAILED)
+    {
+        async_io_unmap(io);
+        close(ring);
+        return false;
+    }
+
+    char* submissions = io->sq_ring;
+    io->sq_head = (unsigned*)(submissions + parameters.sq_off.head);
+    io->sq_tail = (unsigned*)(submissions + parameters.sq_off.tail);
+    io->sq_mask = *(unsigned*)(submissions + parameters.sq_off.ring_mask);
+    io->sq_array = (unsigned*)(submissions + parameters.sq_off.array);
+
+    char* completions = io->cq_ring;
+    io->cq_head = (unsigned*)(completions + parameters.cq_off.head);
+    io->cq_tail = (unsigned*)(completions + parameters.cq_off.tail);
+    io->cq_mask = *(unsigned*)(completions + parameters.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe*)(completions + parameters.cq_off.cqes);
+
+    io->ring = ring;
+    io->is_ring_usable = true;
+    return true;
+}
+
+static void async_io_complete(AsyncIo* io, size_t slot, long long result)
+{
+    AsyncIoRequest* request = &io->requests[slot];
+    request->result = result;
+    request->is_complete = true;
+    io->completed[(io->completed_head + io->completed_count) % io->depth] = slot;
+    io->completed_count++;
+}
+
+/* Carries out the rest of a request with blocking calls. */
+static void async_io_perform(AsyncIo* io, size_t slot)
+{
+    AsyncIoRequest* request = &io->requests[slot];
+    long long error = 0;
+
+    while (request->done < request->size)
+    {
+        char* buffer = request->buffer + request->done;
+        size_t size = request->size - request->done;
+        off_t offset = (off_t)(request->offset + request->done);
+        ssize_t transferred = request->is_write ? pwrite(request->file, buffer, size, offset)
+                                                : pread(request->file, buffer, size, offset);
+
+        if (transferred < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (transferred <= 0)
+        {
+            // 0: the end of the file
+            error = transferred < 0 ? -errno : 0;
+            break;
+        }
+
+        request->done += (size_t)transferred;
+    }
+
+    async_io_complete(io, slot, error < 0 && request->done == 0 ? error : (long long)request->done);
+}
+
+/* Writes the rest of a request to the submission queue. */
+static void async_io_queue(AsyncIo* io, size_t slot)
+{
+    AsyncIoRequest* request = &io->requests[slot];
+    size_t remaining = request->size - request->done;
+    // only this thread moves the tail; at most 'depth' entries are ever in the queue, so there is always room
+    unsigned tail = *io->sq_tail;
+    unsigned index = tail & io->sq_mask;
+    struct io_uring_sqe* entry = &io->sqes[index];
+
+    memset(entry, 0, sizeof(*entry));
+    entry->opcode = request->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    entry->fd = request->file;
+    entry->addr = (unsigned long long)(uintptr_t)(request->buffer + request->done);
+    entry->len = remaining > ASYNC_IO_MAX_TRANSFER ? ASYNC_IO_MAX_TRANSFER : (unsigned)remaining;
+    entry->off = request->offset + request->done;
+    entry->user_data = slot;
+    io->sq_array[index] = index;
+    __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    io->queued++;
+}
+
+/* Submits the queued entries and waits for at least 'minimum' completions. Returns 0 or '-errno'. */
+static int async_io_enter(AsyncIo* io, unsigned minimum)
+{
+    long submitted = syscall(__NR_io_uring_enter, io->ring, io->queued, minimum,
+                             minimum > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+    if (submitted < 0)
+    {
+        return errno == EINTR || errno == EAGAIN || errno == EBUSY ? 0 : -errno;
+    }
+
+    io->queued -= (unsigned)submitted;
+    return 0;
+}
+
+static bool async_io_start(AsyncIo* io, int file, void* buffer, size_t size, unsigned long long offset, size_t tag,
+                           bool is_write)
+{
+    size_t slot = 0;
+
+    while (slot < io->depth && io->requests[slot].is_busy)
+    {
+        slot++;
+    }
+
+    if (slot == io->depth)
+    {
+        return false;
+    }
+
+    io->requests[slot] = (AsyncIoRequest){file, buffer, size, 0, offset, tag, 0, is_write, true, false};
+    io->pending++;
+
+    if (io->ring >= 0 && io->is_ring_usable)
+    {
+        async_io_queue(io, slot);
+    }
+    else
+    {
+        async_io_perform(io, slot);
+    }
+
+    return true;
+}
+
+/* Waits for the completions of the ring and handles them: finished requests are moved to 'completed'. */
+static void async_io_reap(AsyncIo* io)
+{
+    unsigned head = *io->cq_head;
+
+    if (head == __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        int error = async_io_enter(io, 1);
+
+        if (error < 0)
+        {
+            // the ring cannot be waited on any more: whatever has not completed has failed
+            for (size_t i = 0; i < io->depth; i++)
+            {
+                if (io->requests[i].is_busy && !io->requests[i].is_complete)
+                {
+                    async_io_complete(io, i, error);
+                }
+            }
+
+            io->is_ring_usable = false;
+            return;
+        }
+    }
+
+    for (; head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE); head++)
+    {
+        const struct io_uring_cqe* completion = &io->cqes[head & io->cq_mask];
+        size_t slot = (size_t)completion->user_data;
+        int result = completion->res;
+        AsyncIoRequest* request = &io->requests[slot];
+        __atomic_store_n(io->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            async_io_queue(io, slot);
+        }
+        else if (result == -EINVAL || result == -EOPNOTSUPP)
+        {
+            // a kernel without these operations: the rest goes through the blocking calls
+            io->is_ring_usable = false;
+            async_io_perform(io, slot);
+        }
+        else if (result > 0 && request->done + (size_t)result < request->size)
+        {
+            request->done += (size_t)result;
+            async_io_queue(io, slot);
+        }
+        else
+        {
+            request->done += result > 0 ? (size_t)result : 0;
+            async_io_complete(io, slot, result < 0 && request->done == 0 ? result : (long long)request->done);
+        }
+    }
+}
+
+/* NON-STATIC FUNCTIONS */
+
+AsyncIo* async_io_construct(size_t depth, bool is_ring_allowed)
+{
+    AsyncIo* io = ALLOCATE(AsyncIo);
+
+    if (io == NULL)
+    {
+        return NULL;
+    }
+
+    io->ring = -1;
+    io->is_ring_usable = false;
+    io->sq_ring = NULL;
+    io->cq_ring = NULL;
+    io->sqes = NULL;
+    io->queued = 0;
+    io->depth = depth > 0 ? depth : 1;
+    io->pending = 0;
+    io->requests = ALLOCATE_ARRAY(AsyncIoRequest, io->depth);
+    io->completed = ALLOCATE_ARRAY(size_t, io->depth);
+    io->completed_head = 0;
+    io->completed_count = 0;
+
+    if (io->requests == NULL || io->completed == NULL)
+    {
+        DEALLOCATE(io->requests);
+        DEALLOCATE(io->completed);
+        DEALLOCATE(io);
+        return NULL;
+    }
+
+    if (is_ring_allowed)
+    {
+        async_io_setup_ring(io);
+    }
+
+    return io;
+}
+
+void async_io_destroy(AsyncIo* io)
+{
+    if (io == NULL)
+    {
+        return;
+    }
+
+    if (io->ring >= 0)
+    {
+        async_io_unmap(io);
+        close(io->ring);
+    }
+
+    DEALLOCATE(io->requests);
+    DEALLOCATE(io->completed);
+    DEALLOCATE(io);
+}
+
+bool async_io_is_ring(const AsyncIo* const io)
+{
+    return io->ring >= 0 && io->is_ring_usable;
+}
+
+bool async_io_read(AsyncIo* io, int file, void* buffer, size_t size, unsigned long long offset, size_t tag)
+{
+    return async_io_start(io, file, buffer, size, offset, tag, false);
+}
+
+bool async_io_write(AsyncIo* io, int file, const void* buffer, size_t size, unsigned long long offset, size_t tag)
+{
+    // the buffer is only read from
+    return async_io_start(io, file, (void*)buffer, size, offset, tag, true);
+}
+
+void async_io_submit(AsyncIo* io)
+{
+    while (io->ring >= 0 && io->queued > 0 && async_io_enter(io, 0) == 0)
+    {
+    }
+}
+
+bool async_io_wait(AsyncIo* io, size_t* tag, long long* result)
+{
+    while (io->pending > 0 && io->completed_count == 0)
+    {
+        async_io_reap(io);
+    }
+
+    if (io->pending == 0)
+    {
+        return false;
+    }
+
+    size_t slot = io->completed[io->completed_head];
+    io->completed_head = (io->completed_head + 1) % io->depth;
+    io->completed_count--;
+    io->pending--;
+    io->requests[slot].is_busy = false;
+    *tag = io->requests[slot].tag;
+    *result = io->requests[slot].result;
+    return true;
+}
+
+size_t async_io_get_pending(const AsyncIo* const io)
+{
+    return io->pending;
+}
@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdr/History.h"
+#include "hdr/MemoryAllocation.h"
+
+typedef enum HistoryOperation {
+    HISTORY_INSERT,
+    HISTORY_EDIT,
+    HISTORY_REMOVE,
+    HISTORY_REORDER
+} HistoryOperation;
+
+/*
+  A single change of the vector.
+  'strings' holds the string(s) that are NOT in the vector in the current state,
+  or, if 'owns_strings' is false, the ones that were put back into it.
+  A reorder holds the other order of the whole vector; it never owns the strings.
+*/
+typedef struct HistoryDelta {
+    HistoryOperation operation;
+    size_t index;
+    size_t count;
+    String** strings;
+    bool owns_strings;
+} HistoryDelta;
+
+/* A group of deltas that is undone and redone together. */
+typedef struct HistoryStep {
+    unsigned long id;
+    HistoryDelta* deltas;
+    size_t size;
+    size_t capacity;
+    size_t memory_usage;
+} HistoryStep;
+
+typedef struct HistoryStack {
+    HistoryStep** steps;
+    size_t size;
+    size_t capacity;
+} HistoryStack;
+
+struct History
+{
+    HistoryStack undo;
+    HistoryStack redo;
+    size_t memory_budget;
+    size_t memory_usage;
+    // identifiers of steps: 'base_id' belongs to the state before the oldest undoable step
+    unsigned long next_id;
+    unsigned long base_id;
+    unsigned long saved_id;
+    bool is_step_pending;
+};
+
+/* STATIC FUNCTIONS */
+
+static size_t history_delta_memory_usage(const HistoryDelta* const delta)
+{
+    size_t usage = sizeof(HistoryDelta) + delta->count * sizeof(String*);
+
+    if (delta->owns_strings)
+    {
+        for (size_t i = 0; i < delta->count; i++)
+        {
+            usage += string_get_footprint(delta->strings[i]);
+        }
+    }
+
+    return usage;
+}
+
+static void history_step_destroy(HistoryStep* step)
+{
+    for (size_t i = 0; i < step->size; i++)
+    {
+        if (step->deltas[i].owns_strings)
+        {
+            for (size_t j = 0; j < step->deltas[i].count; j++)
+            {
+                string_destroy(step->deltas[i].strings[j]);
+            }
+        }
+
+        DEALLOCATE(step->deltas[i].strings);
+    }
+
+    DEALLOCATE(step->deltas);
+    DEALLOCATE(step);
+}
+
+/* Recomputes the memory usage of a step after its deltas changed ownership. */
+static void history_step_update_memory(History* history, HistoryStep* step)
+{
+    history->memory_usage -= step->memory_usage;
+    step->memory_usage = 0;
+
+    for (size_t i = 0; i < step->size; i++)
+    {
+        step->memory_usage += history_delta_memory_usage(&step->deltas[i]);
+    }
+
+    history->memory_usage += step->memory_usage;
+}
+
+static bool history_stack_push(HistoryStack* stack, HistoryStep* step)
+{
+    if (stack->size == stack->capacity)
+    {
+        HistoryStep** steps = DOUBLE_ARRAY(stack->steps, stack->capacity, HistoryStep*);
+
+        if (steps == NULL)
+        {
+            return false;
+        }
+
+        stack->steps = steps;
+        stack->capacity *= 2;
+    }
+
+    stack->steps[stack->size++] = step;
+    return true;
+}
+
+static void history_stack_clear(History* history, HistoryStack* stack)
+{
+    for (size_t i = 0; i < stack->size; i++)
+    {
+        history->memory_usage -= stack->steps[i]->memory_usage;
+        history_step_destroy(stack->steps[i]);
+    }
+
+    stack->size = 0;
+}
+
+/* Discards the oldest undoable steps until the budget is met, keeping at least 'keep' steps. */
+static void history_enforce_budget(History* history, size_t keep)
+{
+    size_t dropped = 0;
+
+    while (history->memory_usage > history->memory_budget && history->undo.size - dropped > keep)
+    {
+        HistoryStep* oldest = history->undo.steps[dropped];
+        history->base_id = oldest->id;
+        history->memory_usage -= oldest->memory_usage;
+        history_step_destroy(oldest);
+        dropped++;
+    }
+
+    if (dropped > 0)
+    {
+        history->undo.size -= dropped;
+        memmove(history->undo.steps, history->undo.steps + dropped, history->undo.size * sizeof(HistoryStep*));
+    }
+}
+
+/* Returns false if there was not enough memory, in which case the history does not take 'strings'. */
+static bool history_record(History* history, HistoryOperation operation, size_t index, String** strings, size_t count, bool owns_strings)
+{
+    if (history->is_step_pending || history->undo.size == 0)
+    {
+        HistoryStep* step = ALLOCATE(HistoryStep);
+        HistoryDelta* deltas = ALLOCATE_ARRAY(HistoryDelta, 1);
+
+        if (step == NULL || deltas == NULL || !history_stack_push(&history->undo, step))
+        {
+            DEALLOCATE(step);
+            DEALLOCATE(deltas);
+            return false;
+        }
+
+        step->id = history->next_id++;
+        step->deltas = deltas;
+        step->capacity = 1;
+        history->is_step_pending = false;
+    }
+
+    HistoryStep* step = history->undo.steps[history->undo.size - 1];
+
+    if (step->size == step->capacity)
+    {
+        HistoryDelta* deltas = DOUBLE_ARRAY(step->deltas, step->capacity, HistoryDelta);
+
+        if (deltas == NULL)
+        {
+            return false;
+        }
+
+        step->deltas = deltas;
+        step->capacity *= 2;
+    }
+
+    HistoryDelta* delta = &step->deltas[step->size++];
+    *delta = (HistoryDelta){operation, index, count, strings, owns_strings};
+
+    size_t usage = history_delta_memory_usage(delta);
+    step->memory_usage += usage;
+    history->memory_usage += usage;
+    history_enforce_budget(history, 1);
+    return true;
+}
+
+/* Forgets every step, after a change of the vector that could not be recorded. */
+static void history_forget(History* history)
+{
+    history_stack_clear(history, &history->undo);
+    history_stack_clear(history, &history->redo);
+    // a state of its own, which is not the saved one
+    history->base_id = history->next_id++;
+}
+
+static unsigned long history_get_current_id(const History* const history)
+{
+    return history->undo.size > 0 ? history->undo.steps[history->undo.size - 1]->id : history->base_id;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+History* history_construct(size_t memory_budget)
+{
+    History* history = ALLOCATE(History);
+
+    if (history == NULL)
+    {
+        return NULL;
+    }
+
+    history->undo.steps = ALLOCATE_ARRAY(HistoryStep*, 1);
+    history->undo.capacity = 1;
+    history->redo.steps = ALLOCATE_ARRAY(HistoryStep*, 1);
+    history->redo.capacity = 1;
+
+    if (history->undo.steps == NULL || history->redo.steps == NULL)
+    {
+        DEALLOCATE(history->undo.steps);
+        DEALLOCATE(history->redo.steps);
+        DEALLOCATE(history);
+        return NULL;
+    }
+
+    history->memory_budget = memory_budget;
+    history->memory_usage = 0;
+    history->next_id = 1;
+    history->base_id = 0;
+    history->saved_id = 0;
+    history->is_step_pending = true;
+    return history;
+}
+
+void history_destroy(History* history)
+{
+    if (history != NULL)
+    {
+        history_stack_clear(history, &history->undo);
+        history_stack_clear(history, &history->redo);
+        DEALLOCATE(history->undo.steps);
+        DEALLOCATE(history->redo.steps);
+        DEALLOCATE(history);
+    }
+
+    history = NULL;
+}
+
+void history_begin_step(History* history)
+{
+    history_stack_clear(history, &history->redo);
+    history_enforce_budget(history, 0);
+    history->is_step_pending = true;
+}
+
+bool history_record_insert(History* history, size_t index)
+{
+    if (history->memory_budget == 0)
+    {
+        return true;
+    }
+
+    String** strings = ALLOCATE_ARRAY(String*, 1);
+
+    if (strings == NULL || !history_record(history, HISTORY_INSERT, index, strings, 1, false))
+    {
+        DEALLOCATE(strings);
+        return false;
+    }
+
+    return true;
+}
+
+bool history_record_edit(History* history, size_t index, String* old_string)
+{
+    if (history->memory_budget == 0)
+    {
+        string_destroy(old_string);
+        return true;
+    }
+
+    String** strings = ALLOCATE_ARRAY(String*, 1);
+
+    if (strings == NULL)
+    {
+        return false;
+    }
+
+    strings[0] = old_string;
+
+    if (!history_record(history, HISTORY_EDIT, index, strings, 1, true))
+    {
+        DEALLOCATE(strings);
+        return false;
+    }
+
+    return true;
+}
+
+void history_record_remove(History* history, size_t index, String** strings, size_t count)
+{
+    if (history->memory_budget == 0 || !history_record(history, HISTORY_REMOVE, index, strings, count, true))
+    {
+        if (history->memory_budget > 0)
+        {
+            history_forget(history);
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            string_destroy(strings[i]);
+        }
+
+        DEALLOCATE(strings);
+    }
+}
+
+void history_record_reorder(History* history, String** order, size_t count)
+{
+    if (history->memory_budget == 0 || !history_record(history, HISTORY_REORDER, 0, order, count, false))
+    {
+        if (history->memory_budget > 0)
+        {
+            history_forget(history);
+        }
+
+        DEALLOCATE(order);
+    }
+}
+
+size_t history_undo(History* history, Vector* vector, size_t steps)
+{
+    size_t undone = 0;
+
+    while (undone < steps && history->undo.size > 0)
+    {
+        HistoryStep* step = history->undo.steps[--history->undo.size];
+
+        // reverting in the opposite order the deltas were applied
+        for (size_t i = step->size; i > 0; i--)
+        {
+            HistoryDelta* delta = &step->deltas[i - 1];
+
+            switch (delta->operation)
+            {
+            case HISTORY_INSERT:
+                vector_detach_range(vector, delta->index, 1, delta->strings);
+                delta->owns_strings = true;
+                break;
+            case HISTORY_EDIT:
+                delta->strings[0] = vector_replace_at(vector, delta->index, delta->strings[0]);
+                break;
+            case HISTORY_REMOVE:
+                vector_insert_range(vector, delta->index, delta->strings, delta->count);
+                delta->owns_strings = false;
+                break;
+            case HISTORY_REORDER:
+                vector_permute(vector, delta->strings);
+                break;
+            }
+        }
+
+        history_step_update_memory(history, step);
+        history_stack_push(&history->redo, step);
+        undone++;
+    }
+
+    history->is_step_pending = true;
+    return undone;
+}
+
+size_t history_redo(History* history, Vector* vector, size_t steps)
+{
+    size_t redone = 0;
+
+    while (redone < steps && history->redo.size > 0)
+    {
+        HistoryStep* step = history->redo.steps[--history->redo.size];
+
+        for (size_t i = 0; i < step->size; i++)
+        {
+            HistoryDelta* delta = &step->deltas[i];
+
+            switch (delta->operation)
+            {
+            case HISTORY_INSERT:
+                vector_insert_range(vector, delta->index, delta->strings, 1);
+                delta->owns_strings = false;
+                break;
+            case HISTORY_EDIT:
+                delta->strings[0] = vector_replace_at(vector, delta->index, delta->strings[0]);
+                break;
+            case HISTORY_REMOVE:
+                vector_detach_range(vector, delta->index, delta->count, delta->strings);
+                delta->owns_strings = true;
+                break;
+            case HISTORY_REORDER:
+                vector_permute(vector, delta->strings);
+                break;
+            }
+        }
+
+        history_step_update_memory(history, step);
+        history_stack_push(&history->undo, step);
+        redone++;
+    }
+
+    history->is_step_pending = true;
+    return redone;
+}
+
+void history_mark_saved(History* history)
+{
+    history->saved_id = history_get_current_id(history);
+}
+
+unsigned long history_get_state(const History* const history)
+{
+    return history_get_current_id(history);
+}
+
+void history_mark_saved_state(History* history, unsigned long state)
+{
+    history->saved_id = state;
+}
+
+bool history_is_at_saved(const History* const history)
+{
+    return history_get_current_id(history) == history->saved_id;
+}
+
+size_t history_get_undo_count(const History* const history)
+{
+    return history->undo.size;
+}
+
+size_t history_get_redo_count(const History* const history)
+{
+    return history->redo.size;
+}
+
+size_t history_get_memory_usage(const History* const history)
+{
+    return history->memory_usage;
+}
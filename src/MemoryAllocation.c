@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "hdr/MemoryAllocation.h"
+
+/* Maximum number of distinct call sites that are tracked. Further sites share the last slot. */
+#define MEMORY_MAX_SITES 256
+
+/* Prepended to each allocation. The union keeps the user's memory maximally aligned. */
+typedef union AllocationHeader {
+    struct {
+        size_t size;
+        size_t site;
+    } info;
+    max_align_t alignment;
+} AllocationHeader;
+
+typedef struct AllocationSite {
+    const char* file;
+    int line;
+    size_t allocations;
+    size_t live_count;
+    size_t live_bytes;
+    size_t total_bytes;
+} AllocationSite;
+
+typedef struct MemoryAccounting {
+    AllocationSite sites[MEMORY_MAX_SITES];
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t allocations;
+    size_t deallocations;
+    bool is_report_registered;
+    // the process that registered the report (a forked child inherits the registration, not the allocations)
+    pid_t report_pid;
+} MemoryAccounting;
+
+static MemoryAccounting accounting;
+// serialises every change of 'accounting' (e.g. the shards are loaded by several threads)
+static pthread_mutex_t accounting_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* STATIC FUNCTIONS */
+
+/* Open addressing over (file, line). 'file' is always a '__FILE__' literal, so comparing pointers is enough. */
+static size_t memory_find_site(const char* file, int line)
+{
+    size_t index = ((uintptr_t)file * 31 + (size_t)line) % (MEMORY_MAX_SITES - 1);
+
+    for (size_t probe = 0; probe < MEMORY_MAX_SITES - 1; probe++)
+    {
+        AllocationSite* site = &accounting.sites[index];
+
+        if (site->file == NULL)
+        {
+            site->file = file;
+            site->line = line;
+            return index;
+        }
+
+        if (site->file == file && site->line == line)
+        {
+            return index;
+        }
+
+        index = (index + 1) % (MEMORY_MAX_SITES - 1);
+    }
+
+    // overflow slot
+    accounting.sites[MEMORY_MAX_SITES - 1].file = "(other)";
+    return MEMORY_MAX_SITES - 1;
+}
+
+static void memory_report_leaks(void)
+{
+    pthread_mutex_lock(&accounting_lock);
+
+    if (accounting.live_bytes == 0 || getpid() != accounting.report_pid)
+    {
+        pthread_mutex_unlock(&accounting_lock);
+        return;
+    }
+
+    fprintf(stderr, "Memory: %lu bytes in %lu allocations were not released:\n",
+            accounting.live_bytes, accounting.allocations - accounting.deallocations);
+
+    for (size_t i = 0; i < MEMORY_MAX_SITES; i++)
+    {
+        const AllocationSite* site = &accounting.sites[i];
+
+        if (site->live_count > 0)
+        {
+            fprintf(stderr, "\t%s:%d - %lu bytes in %lu allocations\n",
+                    site->file, site->line, site->live_bytes, site->live_count);
+        }
+    }
+
+    pthread_mutex_unlock(&accounting_lock);
+}
+
+static void memory_account(AllocationHeader* header, size_t size, size_t site_index)
+{
+    AllocationSite* site = &accounting.sites[site_index];
+    header->info.size = size;
+    header->info.site = site_index;
+    site->allocations++;
+    site->live_count++;
+    site->live_bytes += size;
+    site->total_bytes += size;
+    accounting.allocations++;
+    accounting.live_bytes += size;
+    accounting.peak_bytes = accounting.live_bytes > accounting.peak_bytes ? accounting.live_bytes : accounting.peak_bytes;
+
+    if (!accounting.is_report_registered)
+    {
+        atexit(memory_report_leaks);
+        accounting.is_report_registered = true;
+        accounting.report_pid = getpid();
+    }
+}
+
+static void memory_unaccount(const AllocationHeader* const header)
+{
+    AllocationSite* site = &accounting.sites[header->info.site];
+    site->live_count--;
+    site->live_bytes -= header->info.size;
+    accounting.deallocations++;
+    accounting.live_bytes -= header->info.size;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+void* memory_allocate(size_t count, size_t size, const char* file, int line)
+{
+    if (size != 0 && count > (SIZE_MAX - sizeof(AllocationHeader)) / size)
+    {
+        return NULL;
+    }
+
+    AllocationHeader* header = calloc(1, sizeof(AllocationHeader) + count * size);
+
+    if (header == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&accounting_lock);
+    memory_account(header, count * size, memory_find_site(file, line));
+    pthread_mutex_unlock(&accounting_lock);
+    return header + 1;
+}
+
+void* memory_reallocate(void* pointer, size_t size, const char* file, int line)
+{
+    if (pointer == NULL)
+    {
+        return memory_allocate(1, size, file, line);
+    }
+
+    AllocationHeader* header = (AllocationHeader*)pointer - 1;
+    AllocationHeader previous = *header;
+    AllocationHeader* resized = realloc(header, sizeof(AllocationHeader) + size);
+
+    if (resized == NULL)
+    {
+        return NULL;
+    }
+
+    // the memory is accounted to the site that resized it last
+    pthread_mutex_lock(&accounting_lock);
+    memory_unaccount(&previous);
+    accounting.deallocations--;
+    accounting.allocations--;
+    memory_account(resized, size, memory_find_site(file, line));
+    pthread_mutex_unlock(&accounting_lock);
+    return resized + 1;
+}
+
+void memory_deallocate(void* pointer)
+{
+    if (pointer == NULL)
+    {
+        return;
+    }
+
+    AllocationHeader* header = (AllocationHeader*)pointer - 1;
+    pthread_mutex_lock(&accounting_lock);
+    memory_unaccount(header);
+    pthread_mutex_unlock(&accounting_lock);
+    free(header);
+}
+
+size_t memory_get_live_bytes(void)
+{
+    pthread_mutex_lock(&accounting_lock);
+    size_t live_bytes = accounting.live_bytes;
+    pthread_mutex_unlock(&accounting_lock);
+    return live_bytes;
+}
+
+size_t memory_get_peak_bytes(void)
+{
+    pthread_mutex_lock(&accounting_lock);
+    size_t peak_bytes = accounting.peak_bytes;
+    pthread_mutex_unlock(&accounting_lock);
+    return peak_bytes;
+}
+
+void memory_print_report(FILE* output)
+{
+    if (!MEMORY_ACCOUNTING)
+    {
+        fputs("Memory accounting is disabled in this build.\n", output);
+        return;
+    }
+
+    // the totals and the sites are taken together, even while other threads allocate
+    pthread_mutex_lock(&accounting_lock);
+    fprintf(output, "live bytes: %lu\n", accounting.live_bytes);
+    fprintf(output, "peak bytes: %lu\n", accounting.peak_bytes);
+    fprintf(output, "live allocations: %lu\n", accounting.allocations - accounting.deallocations);
+    fprintf(output, "%-32s %12s %12s %14s %14s\n", "call site", "allocations", "live", "live bytes", "total bytes");
+
+    for (size_t i = 0; i < MEMORY_MAX_SITES; i++)
+    {
+        const AllocationSite* site = &accounting.sites[i];
+
+        if (site->allocations > 0)
+        {
+            char location[256];
+            snprintf(location, sizeof(location), "%s:%d", site->file, site->line);
+            fprintf(output, "%-32s %12lu %12lu %14lu %14lu\n",
+                    location, site->allocations, site->live_count, site->live_bytes, site->total_bytes);
+        }
+    }
+
+    pthread_mutex_unlock(&accounting_lock);
+}
@@ -0,0 +1,897 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "hdr/Reload.h"
+#include "hdr/Storage.h"
+#include "hdr/MemoryAllocation.h"
+#include "hdr/Statistics.h"
+#include "hdr/Array.h"
+
+/* Number of bytes before the end of the base that must be unchanged for a grown file to count as appended. */
+#define RELOAD_SIGNATURE_SIZE 64
+#define RELOAD_EVENT_BUFFER_SIZE 4096
+/* Position of a poem that is not in the shard. */
+#define RELOAD_NO_POSITION SIZE_MAX
+
+DEFINE_ARRAY(IdArray, id_array, PoemId, ARRAY_DEFAULT_GROWTH)
+DEFINE_ARRAY(HashArray, hash_array, unsigned long long, ARRAY_DEFAULT_GROWTH)
+
+typedef enum ReloadOperation {
+    RELOAD_KEEP,
+    RELOAD_DELETE,
+    RELOAD_INSERT
+} ReloadOperation;
+
+/* A step of the edit script: 'base' is the index of a line of the base, 'line' of the file (if any). */
+typedef struct ReloadEdit {
+    ReloadOperation operation;
+    size_t base;
+    size_t line;
+} ReloadEdit;
+
+/* A non-empty line of the file, '\0'-terminated in place. */
+typedef struct ReloadLine {
+    char* data;
+    unsigned long long hash;
+} ReloadLine;
+
+/*
+  A change of the vector planned by a rewrite, at a position of the shard before any change.
+  'slot' is the entry of the new base that receives the identifier of an inserted poem.
+*/
+typedef struct ReloadChange {
+    size_t position;
+    bool is_insert;
+    size_t sequence;
+    const ReloadLine* line;
+    size_t slot;
+} ReloadChange;
+
+typedef struct ReloadShard {
+    char* path;
+    // the file name within 'path', as reported by the events of the directory
+    const char* name;
+    int watch;
+    bool is_pending;
+    // a writer has closed the file (or moved it into place) since the last merge
+    bool is_closed;
+    // the base: the identifier and the hash of each poem the file held last (as many of each)
+    IdArray ids;
+    HashArray hashes;
+    // the file the base was taken from, and how much of it the base covers
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    char signature[RELOAD_SIGNATURE_SIZE];
+    size_t signature_size;
+} ReloadShard;
+
+struct Reloader
+{
+    int descriptor;
+    ReloadShard shards[MAX_SHARDS];
+};
+
+/* STATIC FUNCTIONS */
+
+/* FNV-1a, 64 bits. */
+static unsigned long long reloader_hash(const char* data, size_t length)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void reloader_base_clear(ReloadShard* shard)
+{
+    id_array_clear(&shard->ids);
+    hash_array_clear(&shard->hashes);
+}
+
+/* Makes room for 'count' more poems in the base. Returns false upon failure. */
+static bool reloader_base_reserve(ReloadShard* shard, size_t count)
+{
+    return ARRAY_GROW(id_array, &shard->ids, shard->ids.size + count) &&
+           ARRAY_GROW(hash_array, &shard->hashes, shard->hashes.size + count);
+}
+
+/* Appends a poem to the base. Without memory to grow it, the poem is left out (as if the file did not hold it). */
+static void reloader_base_push(ReloadShard* shard, PoemId id, unsigned long long hash)
+{
+    if (ARRAY_GROW(id_array, &shard->ids, shard->ids.size + 1) &&
+        ARRAY_GROW(hash_array, &shard->hashes, shard->hashes.size + 1))
+    {
+        ARRAY_PUSH(id_array, &shard->ids, id);
+        ARRAY_PUSH(hash_array, &shard->hashes, hash);
+    }
+}
+
+/* Records the identity of the file and the bytes before 'size' that must stay unchanged for an append. */
+static void reloader_set_extent(ReloadShard* shard, int file, const struct stat* status, off_t size)
+{
+    shard->device = status->st_dev;
+    shard->inode = status->st_ino;
+    shard->modified = status->st_mtim;
+    shard->size = size;
+    shard->signature_size = size < RELOAD_SIGNATURE_SIZE ? (size_t)size : RELOAD_SIGNATURE_SIZE;
+    ssize_t read_size = pread(file, shard->signature, shard->signature_size, size - (off_t)shard->signature_size);
+    shard->signature_size = read_size > 0 ? (size_t)read_size : 0;
+}
+
+/* Records the file the base was just taken from (see 'reloader_set_extent'). */
+static void reloader_take_extent(ReloadShard* reloader_shard)
+{
+    int file = reloader_shard->path != NULL ? open(reloader_shard->path, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat status;
+
+    if (file >= 0 && fstat(file, &status) == 0)
+    {
+        reloader_set_extent(reloader_shard, file, &status, status.st_size);
+    }
+
+    if (file >= 0)
+    {
+        close(file);
+    }
+
+    // the events of the write that led here are stale
+    reloader_shard->is_pending = false;
+    reloader_shard->is_closed = false;
+}
+
+static bool reloader_is_appended(const ReloadShard* const shard, int file, const struct stat* status)
+{
+    if (status->st_dev != shard->device || status->st_ino != shard->inode || status->st_size <= shard->size)
+    {
+        return false;
+    }
+
+    char signature[RELOAD_SIGNATURE_SIZE];
+    off_t offset = shard->size - (off_t)shard->signature_size;
+    return pread(file, signature, shard->signature_size, offset) == (ssize_t)shard->signature_size &&
+           memcmp(signature, shard->signature, shard->signature_size) == 0;
+}
+
+/* Reads the file from 'offset' up to the size in 'status'. The buffer has room for a terminating '\0'. */
+static char* reloader_read(int file, const struct stat* status, off_t offset, size_t* size)
+{
+    size_t length = status->st_size > offset ? (size_t)(status->st_size - offset) : 0;
+    char* buffer = ALLOCATE_ARRAY(char, length + 1);
+    *size = 0;
+
+    while (buffer != NULL && *size < length)
+    {
+        ssize_t read_size = pread(file, buffer + *size, length - *size, offset + (off_t)*size);
+
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (read_size <= 0)
+        {
+            break;
+        }
+
+        *size += (size_t)read_size;
+    }
+
+    STATISTICS_ADD_BYTES_READ(*size);
+    return buffer;
+}
+
+/*
+  Splits the buffer into its non-empty lines, terminating each in place. Unless 'is_partial_kept' is true,
+  a last line without a newline is left out. Returns the lines; 'consumed' is the number of bytes they cover.
+*/
+static ReloadLine* reloader_split(char* buffer, size_t size, bool is_partial_kept, size_t* count, size_t* consumed)
+{
+    size_t newlines = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        newlines += buffer[i] == '\n' ? 1 : 0;
+    }
+
+    ReloadLine* lines = ALLOCATE_ARRAY(ReloadLine, newlines + 1);
+    size_t start = 0;
+    *count = 0;
+    *consumed = 0;
+
+    for (size_t i = 0; i <= size && lines != NULL; i++)
+    {
+        bool is_end = i < size ? buffer[i] == '\n' : is_partial_kept;
+
+        if (!is_end)
+        {
+            continue;
+        }
+
+        buffer[i] = '\0';
+
+        // the checksum footer of a save is not a poem (see 'Storage.h')
+        if (i > start && !storage_is_footer(buffer + start, i - start))
+        {
+            lines[(*count)++] = (ReloadLine){buffer + start, reloader_hash(buffer + start, i - start)};
+        }
+
+        start = i + 1;
+        *consumed = i < size ? i + 1 : size;
+    }
+
+    return lines;
+}
+
+/*
+  The furthest point reachable on diagonal 'k' in step 'd', from row 'd - 1' of the trace ('previous',
+  indexed by k + d - 1): down from diagonal k + 1 (an insertion) or right from k - 1 (a deletion).
+  Writes the diagonal it comes from to 'from'. Returns -1 if the diagonal cannot be reached.
+*/
+static long reloader_diff_step(const long* previous, long d, long k, long n, long m, long* from)
+{
+    long down = k + 1 <= d - 1 ? previous[k + 1 + d - 1] : -1;
+    long right = k - 1 >= -(d - 1) ? previous[k - 1 + d - 1] : -1;
+    down = down >= 0 && down - k <= m ? down : -1;
+    right = right >= 0 && right + 1 <= n ? right + 1 : -1;
+
+    if (down < 0 && right < 0)
+    {
+        return -1;
+    }
+
+    *from = down >= right ? k + 1 : k - 1;
+    return down >= right ? down : right;
+}
+
+/*
+  Appends the shortest edit script from 'base' to 'lines' to 'edits' (Myers' O(ND) algorithm).
+  'offset' is added to the indices of both. Returns false (and appends nothing) if it takes more than 'RELOAD_MAX_DIFF' edits.
+*/
+static bool reloader_diff_middle(const unsigned long long* base, long n, const ReloadLine* lines, long m,
+                                 size_t offset, ReloadEdit* edits, size_t* edit_count)
+{
+    long max = n + m < RELOAD_MAX_DIFF ? n + m : RELOAD_MAX_DIFF;
+    // row 'd' of the trace holds the furthest point of the diagonals [-d..d] after step 'd', at offset d * d
+    long* trace = ALLOCATE_ARRAY(long, (size_t)(max + 1) * (size_t)(max + 1));
+    long found = -1;
+
+    for (long d = 0; d <= max && found < 0 && trace != NULL; d++)
+    {
+        long* row = trace + d * d;
+        const long* previous = d > 0 ? trace + (d - 1) * (d - 1) : NULL;
+
+        for (long k = -d; k <= d && found < 0; k += 2)
+        {
+            long from = 0;
+            long x = d == 0 ? 0 : reloader_diff_step(previous, d, k, n, m, &from);
+            long y = x - k;
+
+            while (x >= 0 && x < n && y < m && base[x] == lines[y].hash)
+            {
+                x++;
+                y++;
+            }
+
+            row[k + d] = x;
+            found = x == n && y == m ? d : -1;
+        }
+    }
+
+    if (found < 0)
+    {
+        DEALLOCATE(trace);
+        return false;
+    }
+
+    // backtracking from the end: the script is written backwards, then reversed
+    ReloadEdit* script = edits + *edit_count;
+    size_t count = 0;
+    long x = n;
+    long y = m;
+
+    for (long d = found; d > 0; d--)
+    {
+        long k = x - y;
+        long from = 0;
+        long start = reloader_diff_step(trace + (d - 1) * (d - 1), d, k, n, m, &from);
+
+        while (x > start)
+        {
+            x--;
+            y--;
+            script[count++] = (ReloadEdit){RELOAD_KEEP, offset + (size_t)x, offset + (size_t)y};
+        }
+
+        if (from == k + 1)
+        {
+            y--;
+            script[count++] = (ReloadEdit){RELOAD_INSERT, offset + (size_t)x, offset + (size_t)y};
+        }
+        else
+        {
+            x--;
+            script[count++] = (ReloadEdit){RELOAD_DELETE, offset + (size_t)x, offset + (size_t)y};
+        }
+    }
+
+    while (x > 0)
+    {
+        x--;
+        y--;
+        script[count++] = (ReloadEdit){RELOAD_KEEP, offset + (size_t)x, offset + (size_t)y};
+    }
+
+    for (size_t i = 0; i < count / 2; i++)
+    {
+        ReloadEdit edit = script[i];
+        script[i] = script[count - 1 - i];
+        script[count - 1 - i] = edit;
+    }
+
+    *edit_count += count;
+    DEALLOCATE(trace);
+    return true;
+}
+
+/* Writes the edit script from 'base' to 'lines' to 'edits' (room for n + m edits). Returns the number of edits. */
+static size_t reloader_diff(const unsigned long long* base, size_t n, const ReloadLine* lines, size_t m, ReloadEdit* edits)
+{
+    size_t prefix = 0;
+    size_t suffix = 0;
+    size_t count = 0;
+
+    while (prefix < n && prefix < m && base[prefix] == lines[prefix].hash)
+    {
+        prefix++;
+    }
+
+    while (suffix < n - prefix && suffix < m - prefix && base[n - 1 - suffix] == lines[m - 1 - suffix].hash)
+    {
+        suffix++;
+    }
+
+    for (size_t i = 0; i < prefix; i++)
+    {
+        edits[count++] = (ReloadEdit){RELOAD_KEEP, i, i};
+    }
+
+    size_t base_middle = n - prefix - suffix;
+    size_t line_middle = m - prefix - suffix;
+
+    // 'offset' is the same for both, since the prefix is common
+    if (!reloader_diff_middle(base + prefix, (long)base_middle, lines + prefix, (long)line_middle, prefix, edits, &count))
+    {
+        // too different: the middle of the file counts as replaced
+        for (size_t i = 0; i < base_middle; i++)
+        {
+            edits[count++] = (ReloadEdit){RELOAD_DELETE, prefix + i, prefix};
+        }
+
+        for (size_t i = 0; i < line_middle; i++)
+        {
+            edits[count++] = (ReloadEdit){RELOAD_INSERT, n - suffix, prefix + i};
+        }
+    }
+
+    for (size_t i = 0; i < suffix; i++)
+    {
+        edits[count++] = (ReloadEdit){RELOAD_KEEP, n - suffix + i, m - suffix + i};
+    }
+
+    return count;
+}
+
+/* Descending position; at the same position, removals first, then insertions in reverse order. */
+static int reloader_compare_changes(const void* left, const void* right)
+{
+    const ReloadChange* first = left;
+    const ReloadChange* second = right;
+
+    if (first->position != second->position)
+    {
+        return first->position > second->position ? -1 : 1;
+    }
+
+    if (first->is_insert != second->is_insert)
+    {
+        return first->is_insert ? 1 : -1;
+    }
+
+    return first->sequence > second->sequence ? -1 : (first->sequence < second->sequence ? 1 : 0);
+}
+
+/* Inserts a poem of the file at 'position' of the vector as part of the current history step. Returns its identifier. */
+static PoemId reloader_insert(Vector* vector, History* history, size_t shard, size_t position, const char* const data)
+{
+    String* poem = string_construct(data);
+    string_set_shard(poem, shard);
+    vector_insert_range(vector, position, &poem, 1);
+    history_record_insert(history, position);
+    return string_get_id(poem);
+}
+
+/* Inserts the new complete lines at the end of the file at the end of the shard. */
+static bool reloader_apply_tail(ReloadShard* reloader_shard, Vector* vector, History* history, size_t shard,
+                                int file, const struct stat* status, ReloadResult* result)
+{
+    size_t size = 0;
+    size_t count = 0;
+    size_t consumed = 0;
+    char* buffer = reloader_read(file, status, reloader_shard->size, &size);
+    ReloadLine* lines = buffer != NULL ? reloader_split(buffer, size, false, &count, &consumed) : NULL;
+
+    if (count > 0)
+    {
+        size_t position = vector_get_shard_start(vector, shard) + vector_get_shard_size(vector, shard);
+        history_begin_step(history);
+        reloader_base_reserve(reloader_shard, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            reloader_base_push(reloader_shard, reloader_insert(vector, history, shard, position + i, lines[i].data),
+                               lines[i].hash);
+        }
+    }
+
+    // a line that is still being written is read once it is complete
+    if (consumed > 0)
+    {
+        reloader_set_extent(reloader_shard, file, status, reloader_shard->size + (off_t)consumed);
+    }
+
+    result->is_appended = true;
+    result->inserted = count;
+    DEALLOCATE(lines);
+    DEALLOCATE(buffer);
+    return count > 0;
+}
+
+/* Diffs the whole file against the base and merges the differences into the shard. */
+static bool reloader_apply_rewrite(ReloadShard* reloader_shard, Vector* vector, History* history, size_t shard,
+                                   int file, const struct stat* status, ReloadResult* result)
+{
+    size_t size = 0;
+    size_t count = 0;
+    size_t consumed = 0;
+    char* buffer = reloader_read(file, status, 0, &size);
+    ReloadLine* lines = buffer != NULL ? reloader_split(buffer, size, true, &count, &consumed) : NULL;
+    ReloadEdit* edits = ALLOCATE_ARRAY(ReloadEdit, reloader_shard->ids.size + count + 1);
+    ReloadChange* changes = ALLOCATE_ARRAY(ReloadChange, reloader_shard->ids.size + count + 1);
+
+    // the current position of each poem of the shard, by identifier
+    size_t start = vector_get_shard_start(vector, shard);
+    size_t end = start + vector_get_shard_size(vector, shard);
+    PoemId highest = 0;
+
+    for (size_t i = start; i < end; i++)
+    {
+        PoemId id = string_get_id(vector_get_string_at(vector, i));
+        highest = id > highest ? id : highest;
+    }
+
+    size_t* positions = ALLOCATE_ARRAY(size_t, highest + 1);
+    // the new base is the file
+    IdArray new_ids;
+    HashArray new_hashes;
+    id_array_initialise(&new_ids);
+    hash_array_initialise(&new_hashes);
+    bool is_reserved = ARRAY_RESERVE(id_array, &new_ids, count) && ARRAY_RESERVE(hash_array, &new_hashes, count);
+
+    if (lines == NULL || edits == NULL || changes == NULL || positions == NULL || !is_reserved)
+    {
+        hash_array_release(&new_hashes);
+        id_array_release(&new_ids);
+        DEALLOCATE(positions);
+        DEALLOCATE(changes);
+        DEALLOCATE(edits);
+        DEALLOCATE(lines);
+        DEALLOCATE(buffer);
+        return false;
+    }
+
+    for (PoemId id = 0; id <= highest; id++)
+    {
+        positions[id] = RELOAD_NO_POSITION;
+    }
+
+    for (size_t i = start; i < end; i++)
+    {
+        positions[string_get_id(vector_get_string_at(vector, i))] = i;
+    }
+
+    // the old base is only needed for the diff
+    IdArray base_ids = reloader_shard->ids;
+    HashArray base_hashes = reloader_shard->hashes;
+    size_t edit_count = reloader_diff(base_hashes.data, base_hashes.size, lines, count, edits);
+    size_t delete_count = 0;
+
+    for (size_t i = 0; i < edit_count; i++)
+    {
+        delete_count += edits[i].operation == RELOAD_DELETE;
+    }
+
+    // the arrays of the removed poems (handed over to the history) are allocated before anything is merged,
+    // so that the merge is either applied or aborted as a whole
+    String*** removals = ALLOCATE_ARRAY(String**, delete_count + 1);
+    size_t removal_count = 0;
+
+    while (removals != NULL && removal_count < delete_count &&
+           (removals[removal_count] = ALLOCATE_ARRAY(String*, 1)) != NULL)
+    {
+        removal_count++;
+    }
+
+    if (removal_count < delete_count)
+    {
+        for (size_t i = 0; removals != NULL && i < removal_count; i++)
+        {
+            DEALLOCATE(removals[i]);
+        }
+
+        DEALLOCATE(removals);
+        hash_array_release(&new_hashes);
+        id_array_release(&new_ids);
+        DEALLOCATE(positions);
+        DEALLOCATE(changes);
+        DEALLOCATE(edits);
+        DEALLOCATE(lines);
+        DEALLOCATE(buffer);
+        return false;
+    }
+
+    reloader_shard->ids = new_ids;
+    reloader_shard->hashes = new_hashes;
+
+    // insertions go after the last poem of the base before them that is still in the shard, wherever it is now
+    size_t anchor = RELOAD_NO_POSITION;
+    size_t change_count = 0;
+
+    for (size_t i = 0; i < edit_count; i++)
+    {
+        const ReloadEdit* edit = &edits[i];
+        PoemId id = edit->operation != RELOAD_INSERT ? base_ids.data[edit->base] : NO_POEM_ID;
+        size_t position = id != NO_POEM_ID && id <= highest ? positions[id] : RELOAD_NO_POSITION;
+
+        switch (edit->operation)
+        {
+        case RELOAD_KEEP:
+            reloader_base_push(reloader_shard, id, base_hashes.data[edit->base]);
+            anchor = position != RELOAD_NO_POSITION ? position : anchor;
+            break;
+        case RELOAD_DELETE:
+            if (position == RELOAD_NO_POSITION)
+            {
+                // removed locally as well
+                break;
+            }
+
+            anchor = position;
+
+            const String* poem = vector_get_string_at(vector, position);
+
+            if (reloader_hash(string_get_data(poem), string_get_length(poem)) != base_hashes.data[edit->base])
+            {
+                fprintf(stderr, "Conflict: \"%s\" was edited here and changed in \"%s\" - both versions are kept.\n",
+                        string_get_data(poem), reloader_shard->path);
+                result->conflicts++;
+                break;
+            }
+
+            changes[change_count] = (ReloadChange){position, false, change_count, NULL, 0};
+            change_count++;
+            result->removed++;
+            break;
+        case RELOAD_INSERT:
+            changes[change_count] = (ReloadChange){anchor != RELOAD_NO_POSITION ? anchor + 1 : start, true, change_count,
+                                                   &lines[edit->line], reloader_shard->ids.size};
+            change_count++;
+            reloader_base_push(reloader_shard, NO_POEM_ID, lines[edit->line].hash);
+            result->inserted++;
+            break;
+        }
+    }
+
+    // applied from the end of the shard, so that the positions of the pending changes stay valid
+    qsort(changes, change_count, sizeof(ReloadChange), reloader_compare_changes);
+
+    if (change_count > 0)
+    {
+        history_begin_step(history);
+    }
+
+    for (size_t i = 0; i < change_count; i++)
+    {
+        if (changes[i].is_insert)
+        {
+            reloader_shard->ids.data[changes[i].slot] =
+                reloader_insert(vector, history, shard, changes[i].position, changes[i].line->data);
+        }
+        else
+        {
+            String** removed = removals[--removal_count];
+            vector_detach_range(vector, changes[i].position, 1, removed);
+            history_record_remove(history, changes[i].position, removed, 1);
+        }
+    }
+
+    // conflicts and poems removed locally as well leave some arrays unused
+    while (removal_count > 0)
+    {
+        DEALLOCATE(removals[--removal_count]);
+    }
+
+    DEALLOCATE(removals);
+
+    reloader_set_extent(reloader_shard, file, status, (off_t)size);
+    id_array_release(&base_ids);
+    hash_array_release(&base_hashes);
+    DEALLOCATE(positions);
+    DEALLOCATE(changes);
+    DEALLOCATE(edits);
+    DEALLOCATE(lines);
+    DEALLOCATE(buffer);
+    return change_count > 0 || result->conflicts > 0;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+Reloader* reloader_construct(void)
+{
+    Reloader* reloader = ALLOCATE(Reloader);
+
+    if (reloader == NULL)
+    {
+        return NULL;
+    }
+
+    // the events are only read between commands, never waited for
+    reloader->descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (reloader->descriptor < 0)
+    {
+        DEALLOCATE(reloader);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < MAX_SHARDS; i++)
+    {
+        reloader->shards[i].watch = -1;
+    }
+
+    // the remaining fields are zeroed by 'ALLOCATE'
+    return reloader;
+}
+
+void reloader_destroy(Reloader* reloader)
+{
+    if (reloader != NULL)
+    {
+        for (size_t i = 0; i < MAX_SHARDS; i++)
+        {
+            DEALLOCATE(reloader->shards[i].path);
+            id_array_release(&reloader->shards[i].ids);
+            hash_array_release(&reloader->shards[i].hashes);
+        }
+
+        close(reloader->descriptor);
+        DEALLOCATE(reloader);
+    }
+}
+
+bool reloader_watch(Reloader* reloader, size_t shard, const char* const path)
+{
+    ReloadShard* reloader_shard = &reloader->shards[shard];
+    size_t length = strlen(path);
+    reloader_shard->path = ALLOCATE_ARRAY(char, length + 1);
+
+    if (reloader_shard->path == NULL)
+    {
+        return false;
+    }
+
+    memcpy(reloader_shard->path, path, length + 1);
+    const char* separator = strrchr(path, '/');
+    reloader_shard->name = reloader_shard->path + (separator != NULL ? (size_t)(separator - path) + 1 : 0);
+
+    // the directory is watched rather than the file, so that a file replaced by a rename is still followed
+    char* directory = ALLOCATE_ARRAY(char, length + 2);
+
+    if (directory == NULL)
+    {
+        return false;
+    }
+
+    if (separator != NULL)
+    {
+        memcpy(directory, path, (size_t)(separator - path) + 1);
+    }
+    else
+    {
+        directory[0] = '.';
+    }
+
+    reloader_shard->watch = inotify_add_watch(reloader->descriptor, directory, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+    DEALLOCATE(directory);
+    return reloader_shard->watch >= 0;
+}
+
+void reloader_set_base(Reloader* reloader, const Vector* const vector, size_t shard)
+{
+    ReloadShard* reloader_shard = &reloader->shards[shard];
+    size_t start = vector_get_shard_start(vector, shard);
+    size_t end = start + vector_get_shard_size(vector, shard);
+    reloader_base_clear(reloader_shard);
+    reloader_base_reserve(reloader_shard, end - start);
+    // compressed poems are hashed from a copy, so that they are not kept decompressed
+    char* copy = NULL;
+    size_t capacity = 0;
+
+    for (size_t i = start; i < end; i++)
+    {
+        const String* poem = vector_get_string_at(vector, i);
+        size_t length = string_get_length(poem);
+
+        if (length > capacity)
+        {
+            DEALLOCATE(copy);
+            capacity = length > DEFAULT_BUFFER_SIZE ? 2 * length : DEFAULT_BUFFER_SIZE;
+            copy = ALLOCATE_ARRAY(char, capacity);
+            capacity = copy != NULL ? capacity : 0;
+        }
+
+        const char* data = copy != NULL ? copy : string_get_data(poem);
+
+        if (copy != NULL)
+        {
+            string_copy_data(poem, copy, capacity);
+        }
+
+        reloader_base_push(reloader_shard, string_get_id(poem), reloader_hash(data, length));
+    }
+
+    DEALLOCATE(copy);
+    reloader_take_extent(reloader_shard);
+}
+
+bool reloader_hash_poems(String* const* poems, size_t count, PoemId* ids, unsigned long long* hashes)
+{
+    char* copy = NULL;
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = string_get_length(poems[i]);
+
+        if (length > capacity)
+        {
+            DEALLOCATE(copy);
+            capacity = length > DEFAULT_BUFFER_SIZE ? 2 * length : DEFAULT_BUFFER_SIZE;
+            copy = ALLOCATE_ARRAY(char, capacity);
+
+            if (copy == NULL)
+            {
+                return false;
+            }
+        }
+
+        string_copy_data(poems[i], copy, capacity);
+        ids[i] = string_get_id(poems[i]);
+        hashes[i] = reloader_hash(copy, length);
+    }
+
+    DEALLOCATE(copy);
+    return true;
+}
+
+void reloader_set_base_hashes(Reloader* reloader, size_t shard, const PoemId* ids, const unsigned long long* hashes,
+                              size_t count)
+{
+    ReloadShard* reloader_shard = &reloader->shards[shard];
+    reloader_base_clear(reloader_shard);
+
+    if (reloader_base_reserve(reloader_shard, count))
+    {
+        ARRAY_INSERT(id_array, &reloader_shard->ids, 0, ids, count);
+        ARRAY_INSERT(hash_array, &reloader_shard->hashes, 0, hashes, count);
+    }
+
+    reloader_take_extent(reloader_shard);
+}
+
+bool reloader_poll(Reloader* reloader)
+{
+    _Alignas(struct inotify_event) char buffer[RELOAD_EVENT_BUFFER_SIZE];
+    bool is_changed = false;
+    ssize_t length;
+
+    while ((length = read(reloader->descriptor, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+            offset += (ssize_t)(sizeof(struct inotify_event) + event->len);
+
+            for (size_t i = 0; i < MAX_SHARDS; i++)
+            {
+                ReloadShard* shard = &reloader->shards[i];
+                bool is_overflow = (event->mask & IN_Q_OVERFLOW) != 0;
+
+                if (shard->watch < 0 ||
+                    (!is_overflow && (event->wd != shard->watch || event->len == 0 || strcmp(event->name, shard->name) != 0)))
+                {
+                    continue;
+                }
+
+                shard->is_pending = true;
+                shard->is_closed = shard->is_closed || is_overflow || (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0;
+                is_changed = true;
+            }
+        }
+    }
+
+    return is_changed;
+}
+
+bool reloader_apply(Reloader* reloader, Vector* vector, History* history, size_t shard, ReloadResult* result)
+{
+    ReloadShard* reloader_shard = &reloader->shards[shard];
+    *result = (ReloadResult){false, 0, 0, 0};
+
+    if (!reloader_shard->is_pending)
+    {
+        return false;
+    }
+
+    reloader_shard->is_pending = false;
+    int file = open(reloader_shard->path, O_RDONLY | O_CLOEXEC);
+    struct stat status;
+
+    // a file that has been removed keeps its poems in the database
+    if (file < 0 || fstat(file, &status) != 0)
+    {
+        if (file >= 0)
+        {
+            close(file);
+        }
+
+        return false;
+    }
+
+    bool is_same = status.st_dev == reloader_shard->device && status.st_ino == reloader_shard->inode &&
+                   status.st_size == reloader_shard->size &&
+                   status.st_mtim.tv_sec == reloader_shard->modified.tv_sec &&
+                   status.st_mtim.tv_nsec == reloader_shard->modified.tv_nsec;
+    bool is_applied = false;
+
+    if (is_same)
+    {
+        // e.g. the events of our own save
+        reloader_shard->is_closed = false;
+    }
+    else if (reloader_is_appended(reloader_shard, file, &status))
+    {
+        is_applied = reloader_apply_tail(reloader_shard, vector, history, shard, file, &status, result);
+    }
+    else if (reloader_shard->is_closed)
+    {
+        // a rewrite is only merged once the writer is done, not halfway through
+        reloader_shard->is_closed = false;
+        is_applied = reloader_apply_rewrite(reloader_shard, vector, history, shard, file, &status, result);
+    }
+
+    close(file);
+    return is_applied;
+}
@@ -0,0 +1,774 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "hdr/Selection.h"
+#include "hdr/MemoryAllocation.h"
+#include "hdr/Array.h"
+
+/* Number of draws from the alias table before falling back to a linear scan (when most weight is reserved). */
+#define SELECTION_MAX_ATTEMPTS 32
+
+typedef struct PoemMetadata {
+    unsigned long long last_used;
+    unsigned score;
+    bool is_reserved;
+} PoemMetadata;
+
+/* A line of a metadata file (see 'selector_read_metadata'). */
+typedef struct MetadataEntry {
+    unsigned long long hash;
+    unsigned long long last_used;
+    unsigned score;
+    // the position of the line, which orders the entries of equal poems
+    size_t line;
+    bool is_taken;
+} MetadataEntry;
+
+DEFINE_ARRAY(MetadataEntryArray, metadata_entry_array, MetadataEntry, ARRAY_DEFAULT_GROWTH)
+
+typedef struct HeapEntry {
+    unsigned long long last_used;
+    PoemId id;
+} HeapEntry;
+
+/* The index of the policy over the poems of a single shard. */
+typedef struct SelectionIndex {
+    // uniform: pool of the drawable poems; weighted: the poems of the alias table
+    PoemId* candidates;
+    size_t candidate_count;
+    size_t capacity;
+    // LRU: min-heap ordered by the last use
+    HeapEntry* heap;
+    size_t heap_size;
+    // weighted: Vose's alias table over 'candidates'
+    double* probability;
+    size_t* alias;
+    double total_score;
+    bool is_built;
+    size_t built_version;
+    bool are_scores_changed;
+    bool is_dirty;
+} SelectionIndex;
+
+struct Selector
+{
+    SelectionPolicy policy;
+    // indexed by 'PoemId'
+    PoemMetadata* metadata;
+    size_t metadata_capacity;
+    // indexed by shard
+    SelectionIndex indexes[MAX_SHARDS];
+};
+
+/* STATIC FUNCTIONS */
+
+static size_t selector_random(size_t bound)
+{
+    size_t random = ((size_t)rand() << 31) ^ (size_t)rand();
+    return random % bound;
+}
+
+static double selector_random_unit(void)
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static unsigned long long selector_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/* Returns the metadata of the poem 'id', growing the table if needed. Returns 'NULL' upon failure. */
+static PoemMetadata* selector_get_metadata(Selector* selector, PoemId id)
+{
+    while (id >= selector->metadata_capacity)
+    {
+        PoemMetadata* metadata = DOUBLE_ARRAY(selector->metadata, selector->metadata_capacity, PoemMetadata);
+
+        if (metadata == NULL)
+        {
+            return NULL;
+        }
+
+        for (size_t i = selector->metadata_capacity; i < 2 * selector->metadata_capacity; i++)
+        {
+            metadata[i] = (PoemMetadata){0, DEFAULT_POEM_SCORE, false};
+        }
+
+        selector->metadata = metadata;
+        selector->metadata_capacity *= 2;
+    }
+
+    return &selector->metadata[id];
+}
+
+/* Orders metadata entries by hash, then by line. */
+static int selector_compare_entries(const void* left, const void* right)
+{
+    const MetadataEntry* const a = left;
+    const MetadataEntry* const b = right;
+
+    if (a->hash != b->hash)
+    {
+        return a->hash < b->hash ? -1 : 1;
+    }
+
+    return a->line < b->line ? -1 : a->line > b->line;
+}
+
+/* Takes the first entry (of sorted 'entries') of the poem with 'hash' not taken yet. Returns 'NULL' if there is none. */
+static MetadataEntry* selector_take_entry(MetadataEntryArray* entries, unsigned long long hash)
+{
+    size_t low = 0;
+    size_t high = entries->size;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (entries->data[middle].hash < hash)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    for (; low < entries->size && entries->data[low].hash == hash; low++)
+    {
+        if (!entries->data[low].is_taken)
+        {
+            entries->data[low].is_taken = true;
+            return &entries->data[low];
+        }
+    }
+
+    return NULL;
+}
+
+static bool selector_heap_less(const HeapEntry* const left, const HeapEntry* const right)
+{
+    return left->last_used < right->last_used || (left->last_used == right->last_used && left->id < right->id);
+}
+
+static void selector_heap_sift_down(SelectionIndex* index, size_t position)
+{
+    for (;;)
+    {
+        size_t smallest = position;
+        size_t left = 2 * position + 1;
+        size_t right = left + 1;
+
+        if (left < index->heap_size && selector_heap_less(&index->heap[left], &index->heap[smallest]))
+        {
+            smallest = left;
+        }
+
+        if (right < index->heap_size && selector_heap_less(&index->heap[right], &index->heap[smallest]))
+        {
+            smallest = right;
+        }
+
+        if (smallest == position)
+        {
+            return;
+        }
+
+        HeapEntry entry = index->heap[position];
+        index->heap[position] = index->heap[smallest];
+        index->heap[smallest] = entry;
+        position = smallest;
+    }
+}
+
+static void selector_heap_push(SelectionIndex* index, HeapEntry entry)
+{
+    size_t position = index->heap_size++;
+
+    while (position > 0 && selector_heap_less(&entry, &index->heap[(position - 1) / 2]))
+    {
+        index->heap[position] = index->heap[(position - 1) / 2];
+        position = (position - 1) / 2;
+    }
+
+    index->heap[position] = entry;
+}
+
+static PoemId selector_heap_pop(SelectionIndex* index)
+{
+    PoemId id = index->heap[0].id;
+    index->heap[0] = index->heap[--index->heap_size];
+    selector_heap_sift_down(index, 0);
+    return id;
+}
+
+/* Vose's algorithm: O(n) construction, O(1) draws. */
+static void selector_build_alias_table(const Selector* const selector, SelectionIndex* index)
+{
+    size_t count = index->candidate_count;
+    // 'small' grows from the front, 'large' from the back of the same work list
+    size_t* work = ALLOCATE_ARRAY(size_t, count > 0 ? count : 1);
+    size_t small_count = 0;
+    size_t large_count = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        index->probability[i] =
+            selector->metadata[index->candidates[i]].score * (double)count / index->total_score;
+        index->alias[i] = i;
+
+        if (index->probability[i] < 1.0)
+        {
+            work[small_count++] = i;
+        }
+        else
+        {
+            work[count - 1 - large_count++] = i;
+        }
+    }
+
+    while (small_count > 0 && large_count > 0)
+    {
+        size_t small = work[--small_count];
+        size_t large = work[count - large_count--];
+        index->alias[small] = large;
+        index->probability[large] += index->probability[small] - 1.0;
+
+        if (index->probability[large] < 1.0)
+        {
+            work[small_count++] = large;
+        }
+        else
+        {
+            work[count - 1 - large_count++] = large;
+        }
+    }
+
+    // whatever is left over is 1 up to rounding errors
+    while (small_count > 0)
+    {
+        index->probability[work[--small_count]] = 1.0;
+    }
+
+    while (large_count > 0)
+    {
+        index->probability[work[count - large_count--]] = 1.0;
+    }
+
+    DEALLOCATE(work);
+}
+
+/* Rebuilds the index of the shard from the poems of 'vector'. Returns false upon failure. */
+static bool selector_build(Selector* selector, const Vector* const vector, size_t shard)
+{
+    SelectionIndex* index = &selector->indexes[shard];
+    size_t size = vector_get_shard_size(vector, shard);
+    size_t start = vector_get_shard_start(vector, shard);
+
+    index->candidate_count = 0;
+    index->heap_size = 0;
+    index->total_score = 0.0;
+    index->is_built = true;
+    index->built_version = vector_get_shard_version(vector, shard);
+    index->are_scores_changed = false;
+
+    // unused shards (most of 'MAX_SHARDS') never allocate an index
+    if (size == 0)
+    {
+        return true;
+    }
+
+    if (size > index->capacity || index->candidates == NULL)
+    {
+        DEALLOCATE(index->candidates);
+        DEALLOCATE(index->heap);
+        DEALLOCATE(index->probability);
+        DEALLOCATE(index->alias);
+        index->capacity = size > 0 ? size : 1;
+        index->candidates = ALLOCATE_ARRAY(PoemId, index->capacity);
+        index->heap = ALLOCATE_ARRAY(HeapEntry, index->capacity);
+        index->probability = ALLOCATE_ARRAY(double, index->capacity);
+        index->alias = ALLOCATE_ARRAY(size_t, index->capacity);
+
+        if (index->candidates == NULL || index->heap == NULL || index->probability == NULL || index->alias == NULL)
+        {
+            index->capacity = 0;
+            index->is_built = false;
+            return false;
+        }
+    }
+
+    // the uniform pool only visits the unused poems, found 64 at a time in the bitmap of the vector
+    bool is_uniform = selector->policy == SELECTION_UNIFORM;
+    size_t end = start + size;
+
+    for (size_t i = is_uniform ? vector_find_unused(vector, start, end) : start; i < end;
+         i = is_uniform ? vector_find_unused(vector, i + 1, end) : i + 1)
+    {
+        PoemId id = string_get_id(vector_get_string_at(vector, i));
+        PoemMetadata* metadata = selector_get_metadata(selector, id);
+
+        if (metadata == NULL)
+        {
+            index->is_built = false;
+            return false;
+        }
+
+        switch (selector->policy)
+        {
+        case SELECTION_UNIFORM:
+            if (!metadata->is_reserved)
+            {
+                index->candidates[index->candidate_count++] = id;
+            }
+            break;
+        case SELECTION_LRU:
+            if (!metadata->is_reserved)
+            {
+                index->heap[index->heap_size++] = (HeapEntry){metadata->last_used, id};
+            }
+            break;
+        case SELECTION_WEIGHTED:
+            // reserved poems stay in the table: reservations change with every round, the table only with the vector
+            if (metadata->score > 0)
+            {
+                index->candidates[index->candidate_count++] = id;
+                index->total_score += metadata->score;
+            }
+            break;
+        }
+    }
+
+    if (selector->policy == SELECTION_LRU)
+    {
+        for (size_t i = index->heap_size / 2; i-- > 0;)
+        {
+            selector_heap_sift_down(index, i);
+        }
+    }
+    else if (selector->policy == SELECTION_WEIGHTED)
+    {
+        selector_build_alias_table(selector, index);
+    }
+
+    return true;
+}
+
+/* Returns whether the index of the shard reflects the current poems of the shard. */
+static bool selector_is_current(const Selector* const selector, const Vector* const vector, size_t shard)
+{
+    const SelectionIndex* index = &selector->indexes[shard];
+    return index->is_built && index->built_version == vector_get_shard_version(vector, shard) &&
+           !(selector->policy == SELECTION_WEIGHTED && index->are_scores_changed);
+}
+
+/* Exact weighted draw over the unreserved candidates, except 'excluded'. Returns 'NO_POEM_ID' if there are none. */
+static PoemId selector_draw_weighted_linear(const Selector* const selector, const SelectionIndex* const index, PoemId excluded)
+{
+    double total = 0.0;
+
+    for (size_t i = 0; i < index->candidate_count; i++)
+    {
+        PoemId id = index->candidates[i];
+        total += id != excluded && !selector->metadata[id].is_reserved ? selector->metadata[id].score : 0;
+    }
+
+    if (total <= 0.0)
+    {
+        return NO_POEM_ID;
+    }
+
+    double target = selector_random_unit() * total;
+    PoemId last = NO_POEM_ID;
+
+    for (size_t i = 0; i < index->candidate_count; i++)
+    {
+        PoemId id = index->candidates[i];
+
+        if (id == excluded || selector->metadata[id].is_reserved)
+        {
+            continue;
+        }
+
+        last = id;
+        target -= selector->metadata[id].score;
+
+        if (target < 0.0)
+        {
+            return id;
+        }
+    }
+
+    return last;
+}
+
+static PoemId selector_draw_weighted(const Selector* const selector, const SelectionIndex* const index, PoemId excluded)
+{
+    if (index->candidate_count == 0)
+    {
+        return NO_POEM_ID;
+    }
+
+    for (size_t attempt = 0; attempt < SELECTION_MAX_ATTEMPTS; attempt++)
+    {
+        size_t position = selector_random(index->candidate_count);
+        PoemId id = index->candidates[selector_random_unit() < index->probability[position] ? position : index->alias[position]];
+
+        if (id != excluded && !selector->metadata[id].is_reserved)
+        {
+            return id;
+        }
+    }
+
+    return selector_draw_weighted_linear(selector, index, excluded);
+}
+
+/* Draws a single poem of the shard, except 'excluded'. Returns 'NO_POEM_ID' if there is none to draw. */
+static PoemId selector_draw_from(Selector* selector, size_t shard, PoemId excluded)
+{
+    SelectionIndex* index = &selector->indexes[shard];
+
+    switch (selector->policy)
+    {
+    case SELECTION_UNIFORM:
+        if (index->candidate_count > 0)
+        {
+            // swap-remove: the drawn poem leaves the pool until it is released
+            size_t position = selector_random(index->candidate_count);
+            PoemId id = index->candidates[position];
+            index->candidates[position] = index->candidates[--index->candidate_count];
+            return id;
+        }
+        break;
+    case SELECTION_LRU:
+        if (index->heap_size > 0)
+        {
+            return selector_heap_pop(index);
+        }
+        break;
+    case SELECTION_WEIGHTED:
+        return selector_draw_weighted(selector, index, excluded);
+    }
+
+    return NO_POEM_ID;
+}
+
+/*
+  Draws a single poem of any of the first 'shard_count' shards, except 'excluded', the same way as if
+  they were a single index: the least recently used poem of every shard (LRU), or a shard chosen by the
+  weight of its poems (uniform: by the number of candidates, weighted: by their total score).
+*/
+static PoemId selector_draw_from_any(Selector* selector, size_t shard_count, PoemId excluded)
+{
+    if (selector->policy == SELECTION_LRU)
+    {
+        size_t oldest = MAX_SHARDS;
+
+        for (size_t shard = 0; shard < shard_count; shard++)
+        {
+            const SelectionIndex* index = &selector->indexes[shard];
+
+            if (index->heap_size > 0 &&
+                (oldest == MAX_SHARDS || selector_heap_less(&index->heap[0], &selector->indexes[oldest].heap[0])))
+            {
+                oldest = shard;
+            }
+        }
+
+        return oldest < MAX_SHARDS ? selector_heap_pop(&selector->indexes[oldest]) : NO_POEM_ID;
+    }
+
+    double weights[MAX_SHARDS];
+    double total = 0.0;
+
+    for (size_t shard = 0; shard < shard_count; shard++)
+    {
+        const SelectionIndex* index = &selector->indexes[shard];
+        weights[shard] = selector->policy == SELECTION_UNIFORM ? (double)index->candidate_count : index->total_score;
+        total += weights[shard];
+    }
+
+    // the weight of a shard includes its reserved poems, so a chosen shard may have nothing left to draw
+    while (total > 0.0)
+    {
+        double target = selector_random_unit() * total;
+        size_t chosen = shard_count;
+
+        for (size_t shard = 0; shard < shard_count && chosen == shard_count; shard++)
+        {
+            target -= weights[shard];
+
+            if (weights[shard] > 0.0 && target < 0.0)
+            {
+                chosen = shard;
+            }
+        }
+
+        // rounding errors: the last shard with any weight
+        for (size_t shard = shard_count; chosen == shard_count && shard-- > 0;)
+        {
+            chosen = weights[shard] > 0.0 ? shard : shard_count;
+        }
+
+        PoemId id = selector_draw_from(selector, chosen, excluded);
+
+        if (id != NO_POEM_ID)
+        {
+            return id;
+        }
+
+        total -= weights[chosen];
+        weights[chosen] = 0.0;
+    }
+
+    return NO_POEM_ID;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+Selector* selector_construct(SelectionPolicy policy)
+{
+    Selector* selector = ALLOCATE(Selector);
+
+    if (selector == NULL)
+    {
+        return NULL;
+    }
+
+    selector->metadata = ALLOCATE_ARRAY(PoemMetadata, 1);
+
+    if (selector->metadata == NULL)
+    {
+        DEALLOCATE(selector);
+        return NULL;
+    }
+
+    selector->metadata[0] = (PoemMetadata){0, DEFAULT_POEM_SCORE, false};
+    selector->metadata_capacity = 1;
+    selector->policy = policy;
+    // the remaining fields (and the indexes) are zeroed by 'ALLOCATE'
+    return selector;
+}
+
+void selector_destroy(Selector* selector)
+{
+    if (selector != NULL)
+    {
+        for (size_t shard = 0; shard < MAX_SHARDS; shard++)
+        {
+            DEALLOCATE(selector->indexes[shard].candidates);
+            DEALLOCATE(selector->indexes[shard].heap);
+            DEALLOCATE(selector->indexes[shard].probability);
+            DEALLOCATE(selector->indexes[shard].alias);
+        }
+
+        DEALLOCATE(selector->metadata);
+        DEALLOCATE(selector);
+    }
+}
+
+SelectionPolicy selector_get_policy(const Selector* const selector)
+{
+    return selector->policy;
+}
+
+bool selector_draw(Selector* selector, const Vector* const vector, size_t shard, PoemId drawn[2])
+{
+    bool is_any = shard == SELECTION_ALL_SHARDS;
+    size_t first = is_any ? 0 : shard;
+    size_t last = is_any ? MAX_SHARDS : shard + 1;
+
+    // only the indexes of the shards that have changed are rebuilt
+    for (size_t i = first; i < last; i++)
+    {
+        if (!selector_is_current(selector, vector, i) && !selector_build(selector, vector, i))
+        {
+            return false;
+        }
+    }
+
+    drawn[0] = is_any ? selector_draw_from_any(selector, MAX_SHARDS, NO_POEM_ID) : selector_draw_from(selector, shard, NO_POEM_ID);
+
+    if (drawn[0] == NO_POEM_ID)
+    {
+        return false;
+    }
+
+    selector->metadata[drawn[0]].is_reserved = true;
+    drawn[1] = is_any ? selector_draw_from_any(selector, MAX_SHARDS, drawn[0]) : selector_draw_from(selector, shard, drawn[0]);
+
+    if (drawn[1] == NO_POEM_ID)
+    {
+        // the first poem goes back to its index
+        selector_release(selector, vector, drawn[0], false);
+        return false;
+    }
+
+    selector->metadata[drawn[1]].is_reserved = true;
+    return true;
+}
+
+void selector_release(Selector* selector, const Vector* const vector, PoemId id, bool is_chosen)
+{
+    PoemMetadata* metadata = selector_get_metadata(selector, id);
+
+    if (metadata == NULL)
+    {
+        return;
+    }
+
+    const String* poem = vector_get_string_by_id(vector, id);
+    metadata->is_reserved = false;
+
+    if (is_chosen)
+    {
+        metadata->last_used = selector_now();
+    }
+
+    // the metadata of a removed poem is not saved anyway
+    if (poem == NULL)
+    {
+        return;
+    }
+
+    size_t shard = string_get_shard(poem);
+    SelectionIndex* index = &selector->indexes[shard];
+    index->is_dirty = index->is_dirty || is_chosen;
+
+    // a stale index is rebuilt by the next draw anyway
+    if (!index->is_built || index->built_version != vector_get_shard_version(vector, shard))
+    {
+        return;
+    }
+
+    if (selector->policy == SELECTION_UNIFORM && !string_get_is_used(poem))
+    {
+        index->candidates[index->candidate_count++] = id;
+    }
+    else if (selector->policy == SELECTION_LRU)
+    {
+        selector_heap_push(index, (HeapEntry){metadata->last_used, id});
+    }
+}
+
+void selector_set_score(Selector* selector, const Vector* const vector, PoemId id, unsigned score)
+{
+    PoemMetadata* metadata = selector_get_metadata(selector, id);
+    const String* poem = vector_get_string_by_id(vector, id);
+
+    if (metadata != NULL && poem != NULL && metadata->score != score)
+    {
+        metadata->score = score;
+        selector->indexes[string_get_shard(poem)].are_scores_changed = true;
+        selector->indexes[string_get_shard(poem)].is_dirty = true;
+    }
+}
+
+unsigned selector_get_score(const Selector* const selector, PoemId id)
+{
+    return id < selector->metadata_capacity ? selector->metadata[id].score : DEFAULT_POEM_SCORE;
+}
+
+bool selector_is_dirty(const Selector* const selector, size_t shard)
+{
+    return selector->indexes[shard].is_dirty;
+}
+
+void selector_mark_dirty(Selector* selector, size_t shard)
+{
+    selector->indexes[shard].is_dirty = true;
+}
+
+bool selector_read_metadata(Selector* selector, const Vector* const vector, size_t shard,
+                            const unsigned long long* hashes, FILE* source)
+{
+    size_t start = vector_get_shard_start(vector, shard);
+    size_t count = vector_get_shard_size(vector, shard);
+    MetadataEntryArray entries;
+    metadata_entry_array_initialise(&entries);
+    bool is_hashed = hashes != NULL;
+    bool is_read = true;
+    char line[128];
+
+    while (is_read && fgets(line, sizeof(line), source) != NULL)
+    {
+        MetadataEntry entry = {0, 0, 0, entries.size, false};
+
+        if (sscanf(line, "%llx %llu %u", &entry.hash, &entry.last_used, &entry.score) != 3)
+        {
+            // an entry without a hash
+            is_hashed = false;
+
+            if (sscanf(line, "%llu %u", &entry.last_used, &entry.score) != 2)
+            {
+                continue;
+            }
+        }
+
+        is_read = ARRAY_PUSH(metadata_entry_array, &entries, entry);
+    }
+
+    is_read = is_read && (is_hashed || entries.size == count);
+
+    if (is_read && is_hashed)
+    {
+        qsort(entries.data, entries.size, sizeof(MetadataEntry), selector_compare_entries);
+    }
+
+    for (size_t i = 0; is_read && i < count; i++)
+    {
+        const MetadataEntry* entry = is_hashed ? selector_take_entry(&entries, hashes[i]) : &entries.data[i];
+        PoemMetadata* metadata = entry != NULL ? selector_get_metadata(selector, string_get_id(vector_get_string_at(vector, start + i)))
+                                               : NULL;
+
+        if (metadata != NULL)
+        {
+            metadata->last_used = entry->last_used;
+            metadata->score = entry->score;
+        }
+    }
+
+    metadata_entry_array_release(&entries);
+    selector->indexes[shard].are_scores_changed = true;
+    // what could not be matched is written back without it
+    selector->indexes[shard].is_dirty = !is_read;
+    return is_read;
+}
+
+void selector_copy_metadata(Selector* selector, const Vector* const vector, size_t shard,
+                            unsigned long long* last_used, unsigned* scores)
+{
+    size_t start = vector_get_shard_start(vector, shard);
+    size_t end = start + vector_get_shard_size(vector, shard);
+
+    for (size_t i = start; i < end; i++)
+    {
+        PoemId id = string_get_id(vector_get_string_at(vector, i));
+        last_used[i - start] = id < selector->metadata_capacity ? selector->metadata[id].last_used : 0;
+        scores[i - start] = selector_get_score(selector, id);
+    }
+
+    selector->indexes[shard].is_dirty = false;
+}
+
+void selector_write_metadata(const unsigned long long* hashes, const unsigned long long* last_used, const unsigned* scores,
+                             size_t count, FILE* destination)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (hashes != NULL)
+        {
+            fprintf(destination, "%016llx %llu %u\n", hashes[i], last_used[i], scores[i]);
+        }
+        else
+        {
+            fprintf(destination, "%llu %u\n", last_used[i], scores[i]);
+        }
+    }
+}
@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hdr/Sort.h"
+#include "hdr/MemoryAllocation.h"
+
+/* Runs shorter than this are sorted by insertion before merging. */
+#define SORT_INSERTION_LENGTH 16
+/* Number of bytes of a string covered by a single prefix. */
+#define SORT_PREFIX_SIZE sizeof(unsigned long long)
+
+/*
+  An element of the sort: the prefix of the key it is currently sorted by and its index in the array of strings.
+  The contents are cached as well, so that reading the next prefix does not go through the 'String'.
+*/
+typedef struct SortEntry {
+    unsigned long long prefix;
+    const char* data;
+    size_t index;
+} SortEntry;
+
+typedef struct SortJob {
+    String* const* strings;
+    const SortKey* keys;
+    size_t key_count;
+    size_t count;
+    size_t thread_count;
+    SortEntry* entries;
+    SortEntry* buffer;
+    size_t* order;
+    // the merge phase merges pairs of adjacent groups of 'run_width' runs from 'source' into 'destination'
+    SortEntry* source;
+    SortEntry* destination;
+    size_t run_width;
+    // the refinement phase: thread 't' breaks the ties of the groups starting in [group_starts[t]..group_starts[t + 1])
+    size_t group_starts[SORT_MAX_THREADS + 1];
+} SortJob;
+
+typedef struct SortWorker {
+    SortJob* job;
+    size_t thread;
+    pthread_t handle;
+    bool is_started;
+} SortWorker;
+
+/* STATIC FUNCTIONS */
+
+/*
+  Returns the prefix of 'entry' by 'key'. Only the alphabetical key needs more than one prefix: there,
+  'depth' is the offset of the 8 bytes of the prefix (the previous prefix must not have ended the string).
+*/
+static unsigned long long sort_get_prefix(const SortJob* const job, const SortEntry* const entry, SortKey key, size_t depth)
+{
+    switch (key)
+    {
+    case SORT_LENGTH:
+        return string_get_length(job->strings[entry->index]);
+    case SORT_USED:
+        return string_get_is_used(job->strings[entry->index]) ? 1 : 0;
+    case SORT_SHARD:
+        return string_get_shard(job->strings[entry->index]);
+    case SORT_ALPHABETICAL:
+    default:
+        break;
+    }
+
+    // 8 bytes in big-endian order, padded with '\0' like 'strcmp' sees a shorter string
+    const unsigned char* data = (const unsigned char*)entry->data + depth;
+    unsigned long long prefix = 0;
+    size_t i = 0;
+
+    for (; i < SORT_PREFIX_SIZE && data[i] != '\0'; i++)
+    {
+        prefix = prefix << 8 | data[i];
+    }
+
+    // shifting the bytes read to the top ('prefix' is 0 if the string ends right at 'depth')
+    return i > 0 ? prefix << 8 * (SORT_PREFIX_SIZE - i) : 0;
+}
+
+/* Entries are only ever compared by their prefixes, so the strings are not touched while merging (see 'sort_refine'). */
+static int sort_compare(const SortEntry* const left, const SortEntry* const right)
+{
+    return (left->prefix > right->prefix) - (left->prefix < right->prefix);
+}
+
+/* Returns the index of the first element of the run 'run' (the runs are numbered from 0 to 'thread_count'). */
+static size_t sort_get_run_start(const SortJob* const job, size_t run)
+{
+    return job->count * run / job->thread_count;
+}
+
+/* Stable merge of 'left' and 'right' into 'destination'. On ties, the element of 'left' comes first. */
+static void sort_merge(const SortEntry* left, size_t left_count,
+                       const SortEntry* right, size_t right_count,
+                       SortEntry* destination)
+{
+    const SortEntry* left_end = left + left_count;
+    const SortEntry* right_end = right + right_count;
+
+    while (left < left_end && right < right_end)
+    {
+        *destination++ = sort_compare(right, left) < 0 ? *right++ : *left++;
+    }
+
+    memcpy(destination, left, (size_t)(left_end - left) * sizeof(SortEntry));
+    destination += left_end - left;
+    memcpy(destination, right, (size_t)(right_end - right) * sizeof(SortEntry));
+}
+
+/*
+  Returns how many elements of 'left' are among the first 'rank' elements of the merge of 'left' and 'right'.
+  This is where a thread starts writing when the merge is split between several threads.
+*/
+static size_t sort_co_rank(const SortEntry* left, size_t left_count,
+                           const SortEntry* right, size_t right_count,
+                           size_t rank)
+{
+    size_t low = rank > right_count ? rank - right_count : 0;
+    size_t high = rank < left_count ? rank : left_count;
+
+    // the smallest 'i' for which 'left[i]' follows 'right[rank - i - 1]' in the merge
+    while (low < high)
+    {
+        size_t i = low + (high - low) / 2;
+
+        if (sort_compare(&right[rank - i - 1], &left[i]) < 0)
+        {
+            high = i;
+        }
+        else
+        {
+            low = i + 1;
+        }
+    }
+
+    return low;
+}
+
+/* Sorts 'entries' using 'buffer' (of the same size) as scratch space. The result is left in 'entries'. */
+static void sort_run(SortEntry* entries, SortEntry* buffer, size_t count)
+{
+    for (size_t from = 0; from < count; from += SORT_INSERTION_LENGTH)
+    {
+        size_t to = from + SORT_INSERTION_LENGTH < count ? from + SORT_INSERTION_LENGTH : count;
+
+        for (size_t i = from + 1; i < to; i++)
+        {
+            SortEntry current = entries[i];
+            size_t j = i;
+
+            while (j > from && sort_compare(&current, &entries[j - 1]) < 0)
+            {
+                entries[j] = entries[j - 1];
+                j--;
+            }
+
+            entries[j] = current;
+        }
+    }
+
+    SortEntry* source = entries;
+    SortEntry* destination = buffer;
+
+    for (size_t width = SORT_INSERTION_LENGTH; width < count; width *= 2)
+    {
+        for (size_t from = 0; from < count; from += 2 * width)
+        {
+            size_t middle = from + width < count ? from + width : count;
+            size_t to = from + 2 * width < count ? from + 2 * width : count;
+            sort_merge(source + from, middle - from, source + middle, to - middle, destination + from);
+        }
+
+        SortEntry* swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != entries)
+    {
+        memcpy(entries, source, count * sizeof(SortEntry));
+    }
+}
+
+/*
+  Returns whether the entries of a group of equal prefixes (of key 'key' at 'depth') may still differ, and if so,
+  sets 'key' and 'depth' to the next prefix: the next 8 bytes of an alphabetical key, or the first prefix of the next key.
+*/
+static bool sort_get_next_prefix(const SortJob* const job, const SortEntry* const group, size_t* key, size_t* depth)
+{
+    // a prefix ending in '\0' covers the end of the string, so the strings of the group are equal
+    if (job->keys[*key] == SORT_ALPHABETICAL && (group->prefix & 0xFF) != 0)
+    {
+        *depth += SORT_PREFIX_SIZE;
+        return true;
+    }
+
+    *key += 1;
+    *depth = 0;
+    return *key < job->key_count;
+}
+
+/* Replaces the prefixes of 'entries' by the prefix of key 'key' at 'depth' and sorts them by it. */
+static void sort_resort(const SortJob* const job, SortEntry* entries, SortEntry* buffer, size_t count, size_t key, size_t depth)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        entries[i].prefix = sort_get_prefix(job, &entries[i], job->keys[key], depth);
+    }
+
+    sort_run(entries, buffer, count);
+}
+
+/*
+  Breaks the ties of 'entries', which are sorted by the prefix of key 'key' at 'depth'.
+  Each group of equal prefixes is sorted by the next prefix, until the groups are single entries or equal by every key.
+  Each string of a group is therefore read once per level, instead of once per comparison.
+*/
+static void sort_refine(const SortJob* const job, SortEntry* entries, SortEntry* buffer, size_t count, size_t key, size_t depth)
+{
+    size_t from = 0;
+
+    while (from < count)
+    {
+        size_t to = from + 1;
+
+        while (to < count && entries[to].prefix == entries[from].prefix)
+        {
+            to++;
+        }
+
+        size_t next_key = key;
+        size_t next_depth = depth;
+
+        if (to - from > 1 && sort_get_next_prefix(job, &entries[from], &next_key, &next_depth))
+        {
+            sort_resort(job, entries + from, buffer + from, to - from, next_key, next_depth);
+
+            if (from == 0 && to == count)
+            {
+                // the whole range is still a single group (e.g. duplicates): the next level is taken without recursion
+                key = next_key;
+                depth = next_depth;
+                continue;
+            }
+
+            sort_refine(job, entries + from, buffer + from, to - from, next_key, next_depth);
+        }
+
+        from = to;
+    }
+}
+
+/* First phase: each thread fills in the entries of its run and sorts them. */
+static void* sort_phase_runs(void* argument)
+{
+    SortWorker* worker = argument;
+    SortJob* job = worker->job;
+    size_t from = sort_get_run_start(job, worker->thread);
+    size_t to = sort_get_run_start(job, worker->thread + 1);
+
+    for (size_t i = from; i < to; i++)
+    {
+        job->entries[i].data = string_get_data(job->strings[i]);
+        job->entries[i].index = i;
+        job->entries[i].prefix = sort_get_prefix(job, &job->entries[i], job->keys[0], 0);
+    }
+
+    sort_run(job->entries + from, job->buffer + from, to - from);
+    return NULL;
+}
+
+/* Merge phase: the threads of each pair of groups write an equal share of the merged group. */
+static void* sort_phase_merge(void* argument)
+{
+    SortWorker* worker = argument;
+    SortJob* job = worker->job;
+    size_t threads_per_pair = 2 * job->run_width;
+    size_t first_run = worker->thread / threads_per_pair * threads_per_pair;
+    size_t part = worker->thread % threads_per_pair;
+
+    size_t left_start = sort_get_run_start(job, first_run);
+    size_t right_start = sort_get_run_start(job, first_run + job->run_width);
+    size_t right_end = sort_get_run_start(job, first_run + threads_per_pair);
+    const SortEntry* left = job->source + left_start;
+    const SortEntry* right = job->source + right_start;
+    size_t left_count = right_start - left_start;
+    size_t right_count = right_end - right_start;
+
+    size_t total = left_count + right_count;
+    size_t rank_from = total * part / threads_per_pair;
+    size_t rank_to = total * (part + 1) / threads_per_pair;
+    size_t left_from = sort_co_rank(left, left_count, right, right_count, rank_from);
+    size_t left_to = sort_co_rank(left, left_count, right, right_count, rank_to);
+
+    sort_merge(left + left_from, left_to - left_from,
+               right + (rank_from - left_from), (rank_to - left_to) - (rank_from - left_from),
+               job->destination + left_start + rank_from);
+    return NULL;
+}
+
+/* Each thread finds the first group of equal prefixes that starts in its run. */
+static void* sort_phase_group_starts(void* argument)
+{
+    SortWorker* worker = argument;
+    SortJob* job = worker->job;
+    size_t start = sort_get_run_start(job, worker->thread);
+
+    while (start > 0 && start < job->count && job->source[start - 1].prefix == job->source[start].prefix)
+    {
+        start++;
+    }
+
+    job->group_starts[worker->thread] = start;
+    return NULL;
+}
+
+/* Refinement phase: each thread breaks the ties of the groups that start in its run. */
+static void* sort_phase_refine(void* argument)
+{
+    SortWorker* worker = argument;
+    SortJob* job = worker->job;
+    size_t from = job->group_starts[worker->thread];
+    size_t to = job->group_starts[worker->thread + 1];
+
+    if (from < to)
+    {
+        sort_refine(job, job->source + from, job->destination + from, to - from, 0, 0);
+    }
+
+    return NULL;
+}
+
+/* Last phase: the sorted indices are copied out to 'order'. */
+static void* sort_phase_order(void* argument)
+{
+    SortWorker* worker = argument;
+    SortJob* job = worker->job;
+    size_t to = sort_get_run_start(job, worker->thread + 1);
+
+    for (size_t i = sort_get_run_start(job, worker->thread); i < to; i++)
+    {
+        job->order[i] = job->source[i].index;
+    }
+
+    return NULL;
+}
+
+/* Runs 'phase' on every worker and waits for all of them. A thread that cannot be started is run in place. */
+static void sort_run_phase(SortWorker* workers, size_t thread_count, void* (*phase)(void*))
+{
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        workers[i].is_started = pthread_create(&workers[i].handle, NULL, phase, &workers[i]) == 0;
+
+        if (!workers[i].is_started)
+        {
+            phase(&workers[i]);
+        }
+    }
+
+    phase(&workers[0]);
+
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        if (workers[i].is_started)
+        {
+            pthread_join(workers[i].handle, NULL);
+        }
+    }
+}
+
+/* Returns the number of threads to sort 'count' strings with: a power of two, each thread getting a large enough run. */
+static size_t sort_get_thread_count(size_t count)
+{
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = 1;
+
+    while (threads * 2 <= SORT_MAX_THREADS &&
+           (long)(threads * 2) <= processors &&
+           count / (threads * 2) >= SORT_MIN_RUN_LENGTH)
+    {
+        threads *= 2;
+    }
+
+    return threads;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+bool sort_strings(String* const* strings, size_t count, const SortKey* keys, size_t key_count, size_t* order)
+{
+    if (count == 0)
+    {
+        return true;
+    }
+
+    SortJob job;
+    job.strings = strings;
+    job.keys = keys;
+    job.key_count = key_count;
+    job.count = count;
+    job.thread_count = sort_get_thread_count(count);
+    job.order = order;
+    job.entries = ALLOCATE_ARRAY(SortEntry, count);
+    job.buffer = ALLOCATE_ARRAY(SortEntry, count);
+    SortWorker workers[SORT_MAX_THREADS];
+
+    if (job.entries == NULL || job.buffer == NULL)
+    {
+        DEALLOCATE(job.entries);
+        DEALLOCATE(job.buffer);
+        return false;
+    }
+
+    for (size_t i = 0; i < job.thread_count; i++)
+    {
+        workers[i].job = &job;
+        workers[i].thread = i;
+    }
+
+    sort_run_phase(workers, job.thread_count, sort_phase_runs);
+    job.source = job.entries;
+    job.destination = job.buffer;
+
+    for (job.run_width = 1; job.run_width < job.thread_count; job.run_width *= 2)
+    {
+        sort_run_phase(workers, job.thread_count, sort_phase_merge);
+        SortEntry* merged = job.destination;
+        job.destination = job.source;
+        job.source = merged;
+    }
+
+    // the group starts are found before any prefix is rewritten by the refinement
+    sort_run_phase(workers, job.thread_count, sort_phase_group_starts);
+    job.group_starts[job.thread_count] = count;
+    sort_run_phase(workers, job.thread_count, sort_phase_refine);
+    sort_run_phase(workers, job.thread_count, sort_phase_order);
+    DEALLOCATE(job.entries);
+    DEALLOCATE(job.buffer);
+    return true;
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hdr/SpillFile.h"
+#include "hdr/MemoryAllocation.h"
+
+struct SpillFile
+{
+    int descriptor;
+    char* buffer;
+    size_t fill;
+    // bytes written to the file; the buffer holds the ones after them
+    unsigned long long flushed;
+    pthread_mutex_t lock;
+};
+
+/* STATIC FUNCTIONS */
+
+static bool spill_file_write_all(int descriptor, const char* data, size_t size, unsigned long long offset)
+{
+    while (size > 0)
+    {
+        ssize_t written = pwrite(descriptor, data, size, (off_t)offset);
+
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            return false;
+        }
+
+        data += written;
+        size -= (size_t)written;
+        offset += (unsigned long long)written;
+    }
+
+    return true;
+}
+
+/* Writes the buffer to the file. The lock must be held. */
+static bool spill_file_flush(SpillFile* file)
+{
+    if (!spill_file_write_all(file->descriptor, file->buffer, file->fill, file->flushed))
+    {
+        return false;
+    }
+
+    file->flushed += file->fill;
+    file->fill = 0;
+    return true;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+SpillFile* spill_file_construct(const char* const directory)
+{
+    SpillFile* file = ALLOCATE(SpillFile);
+    char* path = ALLOCATE_ARRAY(char, strlen(directory) + sizeof(SPILL_FILE_TEMPLATE) + 1);
+
+    if (file == NULL || path == NULL)
+    {
+        DEALLOCATE(path);
+        DEALLOCATE(file);
+        return NULL;
+    }
+
+    sprintf(path, "%s/%s", directory, SPILL_FILE_TEMPLATE);
+    file->descriptor = mkstemp(path);
+    file->buffer = ALLOCATE_ARRAY(char, SPILL_FILE_BUFFER_SIZE);
+    file->fill = 0;
+    file->flushed = 0;
+
+    if (file->descriptor >= 0)
+    {
+        // nothing else needs to see it: the file is gone once it is closed
+        unlink(path);
+    }
+
+    DEALLOCATE(path);
+
+    if (file->descriptor < 0 || file->buffer == NULL)
+    {
+        if (file->descriptor >= 0)
+        {
+            close(file->descriptor);
+        }
+
+        DEALLOCATE(file->buffer);
+        DEALLOCATE(file);
+        return NULL;
+    }
+
+    pthread_mutex_init(&file->lock, NULL);
+    return file;
+}
+
+void spill_file_destroy(SpillFile* file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+
+    close(file->descriptor);
+    pthread_mutex_destroy(&file->lock);
+    DEALLOCATE(file->buffer);
+    DEALLOCATE(file);
+}
+
+bool spill_file_append(SpillFile* file, const void* data, size_t size, unsigned long long* offset)
+{
+    pthread_mutex_lock(&file->lock);
+    bool is_written = file->fill + size <= SPILL_FILE_BUFFER_SIZE || spill_file_flush(file);
+
+    if (is_written && size > SPILL_FILE_BUFFER_SIZE)
+    {
+        // a body larger than the buffer is written on its own
+        is_written = spill_file_write_all(file->descriptor, data, size, file->flushed);
+        *offset = file->flushed;
+        file->flushed += is_written ? size : 0;
+    }
+    else if (is_written)
+    {
+        memcpy(file->buffer + file->fill, data, size);
+        *offset = file->flushed + file->fill;
+        file->fill += size;
+    }
+
+    pthread_mutex_unlock(&file->lock);
+    return is_written;
+}
+
+bool spill_file_read(SpillFile* file, unsigned long long offset, void* destination, size_t size)
+{
+    pthread_mutex_lock(&file->lock);
+
+    // a body is either in the buffer or in the file as a whole
+    if (offset >= file->flushed)
+    {
+        memcpy(destination, file->buffer + (offset - file->flushed), size);
+        pthread_mutex_unlock(&file->lock);
+        return true;
+    }
+
+    pthread_mutex_unlock(&file->lock);
+    char* cursor = destination;
+
+    while (size > 0)
+    {
+        ssize_t read_size = pread(file->descriptor, cursor, size, (off_t)offset);
+
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (read_size <= 0)
+        {
+            return false;
+        }
+
+        cursor += read_size;
+        size -= (size_t)read_size;
+        offset += (unsigned long long)read_size;
+    }
+
+    return true;
+}
+
+unsigned long long spill_file_get_size(SpillFile* file)
+{
+    pthread_mutex_lock(&file->lock);
+    unsigned long long size = file->flushed + file->fill;
+    pthread_mutex_unlock(&file->lock);
+    return size;
+}
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "hdr/SprinkleEngine.h"
+#include "hdr/Trace.h"
+#include "hdr/MemoryAllocation.h"
+
+typedef enum SprinkleMessageType {
+    SPRINKLE_GO,       // parent -> bunny: start a round
+    SPRINKLE_ARRIVED,  // bunny -> parent: replaces SIGUSR1
+    SPRINKLE_POEMS,    // parent -> bunny: replaces the pipe
+    SPRINKLE_CHOSEN,   // bunny -> parent: replaces the message queue and 'waitpid'
+    SPRINKLE_STOP      // parent -> bunny: the thread exits
+} SprinkleMessageType;
+
+typedef struct SprinkleMessage {
+    SprinkleMessageType type;
+    size_t bunny;
+    int choice;
+    const char* poems[2];
+} SprinkleMessage;
+
+/*
+  Bounded lock-free queue (D. Vyukov's algorithm). Each cell carries a sequence number that tells
+  whether it is ready to be written or read in the current lap; producers and consumers claim positions
+  with a compare-and-swap, so the same ring serves one or many producers.
+  'items' counts the published messages; it is only used to put an idle consumer to sleep.
+*/
+typedef struct SprinkleQueueCell {
+    atomic_size_t sequence;
+    SprinkleMessage message;
+} SprinkleQueueCell;
+
+typedef struct SprinkleQueue {
+    SprinkleQueueCell cells[SPRINKLE_QUEUE_CAPACITY];
+    atomic_size_t enqueue_position;
+    atomic_size_t dequeue_position;
+    sem_t items;
+} SprinkleQueue;
+
+typedef struct Bunny {
+    pthread_t thread;
+    SprinkleQueue inbox;
+    SprinkleQueue* outbox;
+    size_t index;
+    unsigned int seed;
+    // the copies of the poems of the current round, only read by the bunny until it pushes its choice
+    char poems[2][MSQUEUE_BUFFER];
+    // set when the choice was popped while the parent was waiting for another bunny to arrive
+    bool is_finished;
+    int choice;
+} Bunny;
+
+struct SprinkleEngine {
+    SprinkleQueue outbox;
+    Bunny* bunnies;
+    size_t bunny_count;
+};
+
+/* STATIC FUNCTIONS */
+
+static bool sprinkle_queue_initialise(SprinkleQueue* queue)
+{
+    for (size_t i = 0; i < SPRINKLE_QUEUE_CAPACITY; i++)
+    {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+
+    atomic_init(&queue->enqueue_position, 0);
+    atomic_init(&queue->dequeue_position, 0);
+    return sem_init(&queue->items, 0, 0) == 0;
+}
+
+static bool sprinkle_queue_try_push(SprinkleQueue* queue, const SprinkleMessage* const message)
+{
+    size_t position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+    SprinkleQueueCell* cell;
+
+    for (;;)
+    {
+        cell = &queue->cells[position & (SPRINKLE_QUEUE_CAPACITY - 1)];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // full
+            return false;
+        }
+        else
+        {
+            position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    cell->message = *message;
+    // publishing the message to the consumer
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    return true;
+}
+
+static bool sprinkle_queue_try_pop(SprinkleQueue* queue, SprinkleMessage* message)
+{
+    size_t position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+    SprinkleQueueCell* cell;
+
+    for (;;)
+    {
+        cell = &queue->cells[position & (SPRINKLE_QUEUE_CAPACITY - 1)];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // empty
+            return false;
+        }
+        else
+        {
+            position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+        }
+    }
+
+    *message = cell->message;
+    // handing the cell back to the producers of the next lap
+    atomic_store_explicit(&cell->sequence, position + SPRINKLE_QUEUE_CAPACITY, memory_order_release);
+    return true;
+}
+
+/* A producer facing a full queue yields the processor until the consumer catches up. */
+static void sprinkle_queue_push(SprinkleQueue* queue, const SprinkleMessage* const message)
+{
+    while (!sprinkle_queue_try_push(queue, message))
+    {
+        sched_yield();
+    }
+
+    sem_post(&queue->items);
+}
+
+/* Returns false if the queue is empty and 'wait' is false. Otherwise, it sleeps until a message arrives. */
+static bool sprinkle_queue_pop(SprinkleQueue* queue, SprinkleMessage* message, bool wait)
+{
+    if (!wait)
+    {
+        if (sem_trywait(&queue->items) != 0)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        while (sem_wait(&queue->items) != 0 && errno == EINTR)
+        {
+        }
+    }
+
+    // the count is raised only after the message is published, so this does not spin in practice
+    while (!sprinkle_queue_try_pop(queue, message))
+    {
+        sched_yield();
+    }
+
+    return true;
+}
+
+/* The bunny's side of a round, mirroring 'application_command_sprinkle_child_async'. */
+static void sprinkle_engine_bunny_round(Bunny* bunny, SprinkleMessage* message)
+{
+    unsigned long long bunny_start = trace_now();
+    unsigned long long phase_start = bunny_start;
+    message->type = SPRINKLE_ARRIVED;
+    message->bunny = bunny->index;
+    sprinkle_queue_push(bunny->outbox, message);
+    trace_record(TRACE_ARRIVAL_PUSH, phase_start);
+
+    phase_start = trace_now();
+    sprinkle_queue_pop(&bunny->inbox, message, true);
+    trace_record(TRACE_POEMS_POP, phase_start);
+
+    puts("[CHILD] Received poems:");
+
+    for (int i = 0; i < 2; i++)
+    {
+        printf("[%d] %s\n", i + 1, message->poems[i]);
+    }
+
+    int random = rand_r(&bunny->seed) % 2;
+    puts("[CHILD] Poem has been chosen");
+    puts(message->poems[random]);
+    puts("Szabad-e locsolni?");
+    puts("[CHILD] Poem has been sent");
+
+    // the buffers may be refilled for the next round once the choice is pushed
+    message->type = SPRINKLE_CHOSEN;
+    message->bunny = bunny->index;
+    message->choice = random;
+    // the ring may be merged as soon as the choice is pushed, so the round ends here
+    trace_record(TRACE_BUNNY, bunny_start);
+    sprinkle_queue_push(bunny->outbox, message);
+}
+
+static void* sprinkle_engine_bunny_main(void* argument)
+{
+    Bunny* bunny = argument;
+    SprinkleMessage message;
+    trace_enter_child(bunny->index);
+
+    for (;;)
+    {
+        sprinkle_queue_pop(&bunny->inbox, &message, true);
+
+        if (message.type == SPRINKLE_STOP)
+        {
+            return NULL;
+        }
+
+        sprinkle_engine_bunny_round(bunny, &message);
+    }
+}
+
+/* NON-STATIC FUNCTIONS */
+
+SprinkleEngine* sprinkle_engine_construct(size_t bunnies)
+{
+    SprinkleEngine* engine = ALLOCATE(SprinkleEngine);
+
+    if (engine == NULL)
+    {
+        return NULL;
+    }
+
+    engine->bunnies = ALLOCATE_ARRAY(Bunny, bunnies);
+
+    if (engine->bunnies == NULL)
+    {
+        DEALLOCATE(engine);
+        return NULL;
+    }
+
+    engine->bunny_count = 0;
+
+    if (!sprinkle_queue_initialise(&engine->outbox))
+    {
+        DEALLOCATE(engine->bunnies);
+        DEALLOCATE(engine);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < bunnies; i++)
+    {
+        Bunny* bunny = &engine->bunnies[i];
+
+        if (!sprinkle_queue_initialise(&bunny->inbox))
+        {
+            sprinkle_engine_destroy(engine);
+            return NULL;
+        }
+
+        bunny->outbox = &engine->outbox;
+        bunny->index = i;
+        bunny->is_finished = false;
+        bunny->seed = (unsigned int)time(NULL) ^ (unsigned int)(i * 2654435761U);
+
+        if (pthread_create(&bunny->thread, NULL, sprinkle_engine_bunny_main, bunny) != 0)
+        {
+            sem_destroy(&bunny->inbox.items);
+            sprinkle_engine_destroy(engine);
+            return NULL;
+        }
+
+        engine->bunny_count++;
+    }
+
+    return engine;
+}
+
+void sprinkle_engine_start(SprinkleEngine* engine, size_t bunny, const char* poems[2])
+{
+    Bunny* target = &engine->bunnies[bunny];
+    SprinkleQueue* inbox = &target->inbox;
+    SprinkleMessage message;
+    message.type = SPRINKLE_GO;
+
+    unsigned long long phase_start = trace_now();
+    sprinkle_queue_push(inbox, &message);
+    trace_record(TRACE_WAKE, phase_start);
+
+    phase_start = trace_now();
+    sprinkle_queue_pop(&engine->outbox, &message, true);
+
+    // other rounds may finish while waiting for the arrival
+    while (message.type == SPRINKLE_CHOSEN)
+    {
+        engine->bunnies[message.bunny].is_finished = true;
+        engine->bunnies[message.bunny].choice = message.choice;
+        sprinkle_queue_pop(&engine->outbox, &message, true);
+    }
+
+    trace_record(TRACE_ARRIVAL_WAIT, phase_start);
+    puts("Signal from child process has arrived");
+
+    // the bunny is idle, so its buffers are free; the poems of the parent may be freed as soon as this returns
+    for (int i = 0; i < 2; i++)
+    {
+        strncpy(target->poems[i], poems[i], MSQUEUE_BUFFER - 1);
+        target->poems[i][MSQUEUE_BUFFER - 1] = '\0';
+    }
+
+    message.type = SPRINKLE_POEMS;
+    message.poems[0] = target->poems[0];
+    message.poems[1] = target->poems[1];
+    phase_start = trace_now();
+    sprinkle_queue_push(inbox, &message);
+    trace_record(TRACE_POEMS_PUSH, phase_start);
+}
+
+bool sprinkle_engine_collect(SprinkleEngine* engine, bool wait, size_t* bunny, int* choice)
+{
+    for (size_t i = 0; i < engine->bunny_count; i++)
+    {
+        if (engine->bunnies[i].is_finished)
+        {
+            engine->bunnies[i].is_finished = false;
+            *bunny = i;
+            *choice = engine->bunnies[i].choice;
+            return true;
+        }
+    }
+
+    SprinkleMessage message;
+    unsigned long long phase_start = trace_now();
+
+    if (!sprinkle_queue_pop(&engine->outbox, &message, wait))
+    {
+        return false;
+    }
+
+    trace_record(TRACE_CHOICE_POP, phase_start);
+    *bunny = message.bunny;
+    *choice = message.choice;
+    return true;
+}
+
+void sprinkle_engine_destroy(SprinkleEngine* engine)
+{
+    if (engine == NULL)
+    {
+        return;
+    }
+
+    SprinkleMessage message;
+    message.type = SPRINKLE_STOP;
+
+    for (size_t i = 0; i < engine->bunny_count; i++)
+    {
+        sprinkle_queue_push(&engine->bunnies[i].inbox, &message);
+        pthread_join(engine->bunnies[i].thread, NULL);
+        sem_destroy(&engine->bunnies[i].inbox.items);
+    }
+
+    sem_destroy(&engine->outbox.items);
+    DEALLOCATE(engine->bunnies);
+    DEALLOCATE(engine);
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "hdr/Statistics.h"
+
+/* Number of linear buckets in each power of two. */
+#define SUB_BUCKETS (1 << STATISTICS_SUB_BUCKET_BITS)
+/* Buckets needed to cover the whole range of 'unsigned long long'. */
+#define BUCKET_COUNT ((64 - STATISTICS_SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct LatencyHistogram {
+    unsigned long long buckets[BUCKET_COUNT];
+    unsigned long long count;
+    unsigned long long total;
+    unsigned long long max;
+} LatencyHistogram;
+
+typedef struct Statistics {
+    LatencyHistogram histograms[STATISTICS_MAX_CATEGORIES];
+    // the counters may be updated from several threads (e.g. while the shards are loaded)
+    atomic_ullong allocations;
+    atomic_ullong bytes_read;
+    atomic_ullong bytes_written;
+    atomic_ullong sprinkles;
+} Statistics;
+
+/* Process-wide, since allocations are counted from macros that know nothing about 'Application'. */
+static Statistics statistics;
+
+/* The first 'SUB_BUCKETS' values get a bucket of their own, above them each power of two is split linearly. */
+static size_t statistics_bucket_index(unsigned long long value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+
+    size_t exponent = 63 - (size_t)__builtin_clzll(value);
+    size_t shift = exponent - STATISTICS_SUB_BUCKET_BITS;
+    size_t sub_bucket = (size_t)(value >> shift) & (SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + sub_bucket;
+}
+
+/* Returns the highest value that falls into the bucket. */
+static unsigned long long statistics_bucket_upper_bound(size_t index)
+{
+    if (index < SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    size_t shift = index / SUB_BUCKETS - 1;
+    unsigned long long lower = (unsigned long long)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void statistics_record_latency(size_t category, unsigned long long nanoseconds)
+{
+    if (category >= STATISTICS_MAX_CATEGORIES)
+    {
+        return;
+    }
+
+    LatencyHistogram* histogram = &statistics.histograms[category];
+    histogram->buckets[statistics_bucket_index(nanoseconds)]++;
+    histogram->count++;
+    histogram->total += nanoseconds;
+    histogram->max = nanoseconds > histogram->max ? nanoseconds : histogram->max;
+}
+
+void statistics_count_allocation(void)
+{
+    atomic_fetch_add_explicit(&statistics.allocations, 1, memory_order_relaxed);
+}
+
+void statistics_add_bytes_read(size_t bytes)
+{
+    atomic_fetch_add_explicit(&statistics.bytes_read, bytes, memory_order_relaxed);
+}
+
+void statistics_add_bytes_written(size_t bytes)
+{
+    atomic_fetch_add_explicit(&statistics.bytes_written, bytes, memory_order_relaxed);
+}
+
+void statistics_count_sprinkle(void)
+{
+    atomic_fetch_add_explicit(&statistics.sprinkles, 1, memory_order_relaxed);
+}
+
+unsigned long long statistics_get_percentile(size_t category, double percentile)
+{
+    if (category >= STATISTICS_MAX_CATEGORIES || statistics.histograms[category].count == 0)
+    {
+        return 0;
+    }
+
+    const LatencyHistogram* histogram = &statistics.histograms[category];
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * histogram->count + 0.5);
+    unsigned long long seen = 0;
+    rank = rank == 0 ? 1 : rank;
+
+    for (size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += histogram->buckets[i];
+
+        if (seen >= rank)
+        {
+            unsigned long long bound = statistics_bucket_upper_bound(i);
+            // the bucket may be wider than the largest sample
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+void statistics_print(FILE* output, const char* const* names, size_t category_count)
+{
+    if (!STATISTICS_ENABLED)
+    {
+        fputs("Statistics are disabled in this build.\n", output);
+        return;
+    }
+
+    fprintf(output, "%-10s %10s %12s %12s %12s %12s %12s\n",
+            "command", "count", "mean [us]", "p50 [us]", "p90 [us]", "p99 [us]", "max [us]");
+
+    for (size_t i = 0; i < category_count && i < STATISTICS_MAX_CATEGORIES; i++)
+    {
+        const LatencyHistogram* histogram = &statistics.histograms[i];
+
+        if (histogram->count > 0)
+        {
+            fprintf(output, "%-10s %10llu %12.3f %12.3f %12.3f %12.3f %12.3f\n",
+                    names[i], histogram->count,
+                    histogram->total / 1e3 / histogram->count,
+                    statistics_get_percentile(i, 50.0) / 1e3,
+                    statistics_get_percentile(i, 90.0) / 1e3,
+                    statistics_get_percentile(i, 99.0) / 1e3,
+                    histogram->max / 1e3);
+        }
+    }
+
+    fprintf(output, "allocations: %llu\n", atomic_load(&statistics.allocations));
+    fprintf(output, "bytes read: %llu\n", atomic_load(&statistics.bytes_read));
+    fprintf(output, "bytes written: %llu\n", atomic_load(&statistics.bytes_written));
+    fprintf(output, "sprinkles completed: %llu\n", atomic_load(&statistics.sprinkles));
+}
+
+void statistics_write_json(FILE* output, const char* const* names, size_t category_count)
+{
+    bool is_first = true;
+    fputs("{\n  \"commands\": {", output);
+
+    for (size_t i = 0; i < category_count && i < STATISTICS_MAX_CATEGORIES; i++)
+    {
+        const LatencyHistogram* histogram = &statistics.histograms[i];
+
+        if (histogram->count == 0)
+        {
+            continue;
+        }
+
+        fprintf(output,
+                "%s\n    \"%s\": {\"count\": %llu, \"total_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+                "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                is_first ? "" : ",", names[i], histogram->count, histogram->total,
+                statistics_get_percentile(i, 50.0), statistics_get_percentile(i, 90.0),
+                statistics_get_percentile(i, 99.0), statistics_get_percentile(i, 99.9), histogram->max);
+        is_first = false;
+    }
+
+    fprintf(output, "%s},\n", is_first ? "" : "\n  ");
+    fprintf(output, "  \"allocations\": %llu,\n", atomic_load(&statistics.allocations));
+    fprintf(output, "  \"bytes_read\": %llu,\n", atomic_load(&statistics.bytes_read));
+    fprintf(output, "  \"bytes_written\": %llu,\n", atomic_load(&statistics.bytes_written));
+    fprintf(output, "  \"sprinkles_completed\": %llu\n}\n", atomic_load(&statistics.sprinkles));
+}
@@ -0,0 +1,651 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "hdr/Storage.h"
+#include "hdr/AsyncIo.h"
+#include "hdr/MemoryAllocation.h"
+#include "hdr/Statistics.h"
+#include "hdr/Array.h"
+
+#define STORAGE_CRC_POLYNOMIAL 0xEDB88320u
+#define STORAGE_FOOTER_MAGIC_LENGTH (sizeof(STORAGE_FOOTER_MAGIC) - 1)
+
+DEFINE_ARRAY(ChecksumArray, checksum_array, unsigned, ARRAY_DEFAULT_GROWTH)
+DEFINE_ARRAY(PoemArray, poem_array, String*, ARRAY_DEFAULT_GROWTH)
+DEFINE_ARRAY(CharArray, char_array, char, ARRAY_DEFAULT_GROWTH)
+
+/* The CRC-32 of each block of the poems, computed as the bytes go by. */
+typedef struct StorageChecksums {
+    ChecksumArray values;
+    // of the current (incomplete) block
+    unsigned current;
+    size_t fill;
+    size_t total;
+    bool is_failed;
+} StorageChecksums;
+
+/*
+  Buffered writer: the file is written in chunks of 'STORAGE_BUFFER_SIZE' bytes. While a chunk is being written,
+  the next one is filled in another of the 'STORAGE_PIPELINE_DEPTH' buffers.
+*/
+typedef struct StorageWriter {
+    int file;
+    AsyncIo* io;
+    char* buffers[STORAGE_PIPELINE_DEPTH];
+    // the size of the write of each buffer in flight, 0 if it is free
+    size_t writing[STORAGE_PIPELINE_DEPTH];
+    // the buffer being filled
+    size_t current;
+    char* buffer;
+    size_t fill;
+    // the position of the current buffer in the file
+    unsigned long long offset;
+    size_t total;
+    bool is_failed;
+} StorageWriter;
+
+/* State of a file being loaded, carried from one chunk to the next. */
+typedef struct StorageLoader {
+    size_t shard;
+    StorageChecksums checksums;
+    StorageStatus status;
+    PoemArray poems;
+    // a line that spans two chunks is gathered here
+    CharArray carry;
+    bool is_failed;
+} StorageLoader;
+
+static unsigned storage_crc_table[256];
+static pthread_once_t storage_crc_once = PTHREAD_ONCE_INIT;
+static StorageBackend storage_backend = STORAGE_BACKEND_URING;
+
+/* STATIC FUNCTIONS */
+
+static void storage_crc_initialise(void)
+{
+    for (unsigned i = 0; i < 256; i++)
+    {
+        unsigned crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ STORAGE_CRC_POLYNOMIAL : crc >> 1;
+        }
+
+        storage_crc_table[i] = crc;
+    }
+}
+
+static unsigned storage_crc_update(unsigned crc, const char* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = storage_crc_table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static void storage_checksums_push(StorageChecksums* checksums)
+{
+    if (!ARRAY_PUSH(checksum_array, &checksums->values, ~checksums->current))
+    {
+        checksums->is_failed = true;
+        return;
+    }
+
+    checksums->current = ~0u;
+    checksums->fill = 0;
+}
+
+static void storage_checksums_update(StorageChecksums* checksums, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        size_t chunk = STORAGE_BLOCK_SIZE - checksums->fill < length ? STORAGE_BLOCK_SIZE - checksums->fill : length;
+        checksums->current = storage_crc_update(checksums->current, data, chunk);
+        checksums->fill += chunk;
+        checksums->total += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (checksums->fill == STORAGE_BLOCK_SIZE)
+        {
+            storage_checksums_push(checksums);
+        }
+    }
+}
+
+/* Closes the last, partial block. */
+static void storage_checksums_finish(StorageChecksums* checksums)
+{
+    if (checksums->fill > 0)
+    {
+        storage_checksums_push(checksums);
+    }
+}
+
+/* Checks the footer line ('\0'-terminated) against the checksums of the poems before it. */
+static bool storage_check_footer(const char* line, const StorageChecksums* const checksums)
+{
+    char* cursor = NULL;
+    unsigned long long block_size = strtoull(line + STORAGE_FOOTER_MAGIC_LENGTH, &cursor, 10);
+    unsigned long long size = strtoull(cursor, &cursor, 10);
+    unsigned long long count = strtoull(cursor, &cursor, 10);
+
+    if (checksums->is_failed || block_size != STORAGE_BLOCK_SIZE || size != checksums->total || count != checksums->values.size)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < checksums->values.size; i++)
+    {
+        char* end = NULL;
+        unsigned long value = strtoul(cursor, &end, 16);
+
+        if (end == cursor || value != checksums->values.data[i])
+        {
+            return false;
+        }
+
+        cursor = end;
+    }
+
+    return true;
+}
+
+static bool storage_write_all(int file, const char* data, size_t length, unsigned long long offset)
+{
+    while (length > 0)
+    {
+        ssize_t written = pwrite(file, data, length, (off_t)offset);
+
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            return false;
+        }
+
+        data += written;
+        length -= (size_t)written;
+        offset += (unsigned long long)written;
+    }
+
+    return true;
+}
+
+/* Waits for the write of a buffer to complete, and frees the buffer. */
+static void storage_writer_wait(StorageWriter* writer)
+{
+    size_t tag = 0;
+    long long result = 0;
+
+    if (async_io_wait(writer->io, &tag, &result))
+    {
+        writer->is_failed = writer->is_failed || result != (long long)writer->writing[tag];
+        errno = result < 0 ? (int)-result : errno;
+        writer->writing[tag] = 0;
+    }
+}
+
+/* Starts writing the current buffer and moves on to the next free one. */
+static void storage_writer_flush(StorageWriter* writer)
+{
+    if (writer->fill > 0 && !writer->is_failed)
+    {
+        async_io_write(writer->io, writer->file, writer->buffer, writer->fill, writer->offset, writer->current);
+        async_io_submit(writer->io);
+        writer->writing[writer->current] = writer->fill;
+        writer->current = (writer->current + 1) % STORAGE_PIPELINE_DEPTH;
+        writer->buffer = writer->buffers[writer->current];
+    }
+
+    writer->offset += writer->fill;
+    writer->fill = 0;
+
+    while (writer->writing[writer->current] > 0)
+    {
+        storage_writer_wait(writer);
+    }
+}
+
+static void storage_writer_append(StorageWriter* writer, const char* data, size_t length)
+{
+    if (writer->fill + length > STORAGE_BUFFER_SIZE)
+    {
+        storage_writer_flush(writer);
+    }
+
+    // a single poem larger than the buffer is written directly
+    if (length > STORAGE_BUFFER_SIZE)
+    {
+        writer->is_failed = writer->is_failed || !storage_write_all(writer->file, data, length, writer->offset);
+        writer->offset += length;
+    }
+    else
+    {
+        memcpy(writer->buffer + writer->fill, data, length);
+        writer->fill += length;
+    }
+
+    writer->total += length;
+}
+
+/* Returns a new string of 'path' followed by 'suffix'. */
+static char* storage_path(const char* const path, const char* const suffix)
+{
+    size_t length = strlen(path);
+    char* result = ALLOCATE_ARRAY(char, length + strlen(suffix) + 1);
+
+    if (result != NULL)
+    {
+        memcpy(result, path, length);
+        strcpy(result + length, suffix);
+    }
+
+    return result;
+}
+
+/* Makes the rename of a file of the directory of 'path' durable. */
+static void storage_sync_directory(const char* const path)
+{
+    const char* separator = strrchr(path, '/');
+    char* directory = separator != NULL ? ALLOCATE_ARRAY(char, (size_t)(separator - path) + 2) : NULL;
+
+    if (directory != NULL)
+    {
+        memcpy(directory, path, (size_t)(separator - path) + 1);
+    }
+
+    int file = open(directory != NULL ? directory : ".", O_RDONLY | O_CLOEXEC);
+
+    if (file >= 0)
+    {
+        fsync(file);
+        close(file);
+    }
+
+    DEALLOCATE(directory);
+}
+
+/* Handles a line of the file (terminated in place). Returns false if it could not be stored. */
+static bool storage_load_line(StorageLoader* loader, char* line, size_t length, bool has_newline)
+{
+    if (loader->status == STORAGE_UNCHECKED && storage_is_footer(line, length))
+    {
+        storage_checksums_finish(&loader->checksums);
+        line[length] = '\0';
+        loader->status = storage_check_footer(line, &loader->checksums) ? STORAGE_VALID : STORAGE_CORRUPT;
+        return true;
+    }
+
+    // the lines after the footer were appended by other programs
+    if (loader->status == STORAGE_UNCHECKED)
+    {
+        // the newline of a line gathered across two reads is not part of 'line'
+        storage_checksums_update(&loader->checksums, line, length);
+        storage_checksums_update(&loader->checksums, "\n", has_newline ? 1 : 0);
+    }
+
+    if (length == 0)
+    {
+        // no empty strings are added
+        return true;
+    }
+
+    if (!ARRAY_GROW(poem_array, &loader->poems, loader->poems.size + 1))
+    {
+        return false;
+    }
+
+    line[length] = '\0';
+    String* poem = string_construct(line);
+    string_set_shard(poem, loader->shard);
+    // made cold right away, so that the whole database is never held decompressed
+    string_admit(poem);
+    ARRAY_PUSH(poem_array, &loader->poems, poem);
+    return true;
+}
+
+/* Splits a chunk of the file into lines. The last line of the chunk is carried over to the next one. */
+static void storage_load_chunk(StorageLoader* loader, char* buffer, size_t size)
+{
+    size_t start = 0;
+
+    while (!loader->is_failed && start < size)
+    {
+        char* newline = memchr(buffer + start, '\n', size - start);
+        size_t end = newline != NULL ? (size_t)(newline - buffer) : size;
+
+        if (newline != NULL && loader->carry.size == 0)
+        {
+            loader->is_failed = !storage_load_line(loader, buffer + start, end - start, true);
+        }
+        else
+        {
+            // one more byte for the '\0' written by 'storage_load_line'
+            loader->is_failed = !ARRAY_GROW(char_array, &loader->carry, loader->carry.size + (end - start) + 1) ||
+                                !ARRAY_INSERT(char_array, &loader->carry, loader->carry.size, buffer + start, end - start);
+
+            if (!loader->is_failed && newline != NULL)
+            {
+                loader->is_failed = !storage_load_line(loader, loader->carry.data, loader->carry.size, true);
+                char_array_clear(&loader->carry);
+            }
+        }
+
+        start = end + 1;
+    }
+}
+
+/* NON-STATIC FUNCTIONS */
+
+bool storage_is_footer(const char* const line, size_t length)
+{
+    return length >= STORAGE_FOOTER_MAGIC_LENGTH && memcmp(line, STORAGE_FOOTER_MAGIC, STORAGE_FOOTER_MAGIC_LENGTH) == 0;
+}
+
+void storage_set_backend(StorageBackend backend)
+{
+    storage_backend = backend;
+}
+
+StorageStatus storage_load(const char* const path, size_t shard, String*** poems, size_t* count)
+{
+    pthread_once(&storage_crc_once, storage_crc_initialise);
+    *poems = NULL;
+    *count = 0;
+
+    int file = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    AsyncIo* io = async_io_construct(STORAGE_PIPELINE_DEPTH, storage_backend == STORAGE_BACKEND_URING);
+    char* buffers[STORAGE_PIPELINE_DEPTH] = {NULL};
+    bool is_allocated = io != NULL;
+
+    for (size_t i = 0; i < STORAGE_PIPELINE_DEPTH; i++)
+    {
+        buffers[i] = ALLOCATE_ARRAY(char, STORAGE_BUFFER_SIZE);
+        is_allocated = is_allocated && buffers[i] != NULL;
+    }
+
+    StorageLoader loader = {shard, {{NULL, 0, 0}, ~0u, 0, 0, false}, STORAGE_UNCHECKED, {NULL, 0, 0}, {NULL, 0, 0},
+                            file < 0 || !is_allocated};
+    // chunk 'i' of the file is read to buffer 'i % STORAGE_PIPELINE_DEPTH'; the reads run ahead of the parsing
+    long long results[STORAGE_PIPELINE_DEPTH];
+    bool is_ready[STORAGE_PIPELINE_DEPTH] = {false};
+    size_t requested = 0;
+    bool is_end = false;
+
+    for (; !loader.is_failed && requested < STORAGE_PIPELINE_DEPTH; requested++)
+    {
+        async_io_read(io, file, buffers[requested], STORAGE_BUFFER_SIZE,
+                      (unsigned long long)requested * STORAGE_BUFFER_SIZE, requested);
+    }
+
+    for (size_t chunk = 0; !loader.is_failed && !is_end && chunk < requested; chunk++)
+    {
+        size_t slot = chunk % STORAGE_PIPELINE_DEPTH;
+        size_t tag = 0;
+        long long result = 0;
+
+        while (!is_ready[slot] && async_io_wait(io, &tag, &result))
+        {
+            results[tag] = result;
+            is_ready[tag] = true;
+        }
+
+        is_ready[slot] = false;
+        loader.is_failed = results[slot] < 0;
+        size_t size = results[slot] > 0 ? (size_t)results[slot] : 0;
+        STATISTICS_ADD_BYTES_READ(size);
+        storage_load_chunk(&loader, buffers[slot], size);
+        // a short read is the end of the file
+        is_end = size < STORAGE_BUFFER_SIZE;
+
+        if (!is_end && !loader.is_failed)
+        {
+            async_io_read(io, file, buffers[slot], STORAGE_BUFFER_SIZE,
+                          (unsigned long long)requested * STORAGE_BUFFER_SIZE, slot);
+            requested++;
+        }
+    }
+
+    // the reads beyond the end (or after a failure) are waited for, so that the buffers can be released
+    size_t tag = 0;
+    long long result = 0;
+
+    while (io != NULL && async_io_wait(io, &tag, &result))
+    {
+    }
+
+    // the last line may lack its newline
+    if (!loader.is_failed && loader.carry.size > 0)
+    {
+        loader.is_failed = !storage_load_line(&loader, loader.carry.data, loader.carry.size, false);
+    }
+
+    if (file >= 0)
+    {
+        close(file);
+    }
+
+    for (size_t i = 0; i < STORAGE_PIPELINE_DEPTH; i++)
+    {
+        DEALLOCATE(buffers[i]);
+    }
+
+    async_io_destroy(io);
+    char_array_release(&loader.carry);
+    checksum_array_release(&loader.checksums.values);
+    *poems = loader.poems.data;
+    *count = loader.poems.size;
+    return loader.is_failed ? STORAGE_FAILED : loader.status;
+}
+
+size_t storage_read_sample(const char* const path, char* buffer, size_t size)
+{
+    int file = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat status;
+
+    if (file < 0 || fstat(file, &status) != 0)
+    {
+        if (file >= 0)
+        {
+            close(file);
+        }
+
+        return 0;
+    }
+
+    size_t file_size = (size_t)status.st_size;
+    size_t pieces = file_size > size ? STORAGE_SAMPLE_PIECES : 1;
+    size_t piece_size = size / pieces;
+    size_t used = 0;
+
+    for (size_t i = 0; i < pieces; i++)
+    {
+        off_t offset = (off_t)(file_size / pieces * i);
+        ssize_t read_size = pread(file, buffer + used, piece_size, offset);
+        char* piece = buffer + used;
+        size_t end = read_size > 0 ? (size_t)read_size : 0;
+        size_t start = 0;
+
+        // the first line may have begun before the piece, the last one may go on after it
+        if (offset > 0)
+        {
+            char* newline = memchr(piece, '\n', end);
+            start = newline != NULL ? (size_t)(newline - piece) + 1 : end;
+        }
+
+        while (end > start && piece[end - 1] != '\n')
+        {
+            end--;
+        }
+
+        memmove(piece, piece + start, end - start);
+        used += end - start;
+    }
+
+    close(file);
+    return used;
+}
+
+bool storage_save(String* const* poems, size_t count, const char* const path, bool is_previous_kept)
+{
+    pthread_once(&storage_crc_once, storage_crc_initialise);
+
+    char* temporary = storage_path(path, STORAGE_TEMPORARY_SUFFIX);
+    char* previous = storage_path(path, STORAGE_PREVIOUS_SUFFIX);
+    StorageWriter writer = {-1, async_io_construct(STORAGE_PIPELINE_DEPTH, storage_backend == STORAGE_BACKEND_URING),
+                            {NULL}, {0}, 0, NULL, 0, 0, 0, false};
+    StorageChecksums checksums = {{NULL, 0, 0}, ~0u, 0, 0, false};
+    bool is_allocated = temporary != NULL && previous != NULL && writer.io != NULL;
+
+    for (size_t i = 0; i < STORAGE_PIPELINE_DEPTH; i++)
+    {
+        writer.buffers[i] = ALLOCATE_ARRAY(char, STORAGE_BUFFER_SIZE);
+        is_allocated = is_allocated && writer.buffers[i] != NULL;
+    }
+
+    writer.buffer = writer.buffers[0];
+
+    if (is_allocated)
+    {
+        writer.file = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+
+    writer.is_failed = writer.file < 0;
+
+    for (size_t i = 0; i < count && !writer.is_failed; i++)
+    {
+        const String* poem = poems[i];
+        size_t length = string_get_length(poem);
+
+        if (length + 1 > STORAGE_BUFFER_SIZE)
+        {
+            // copied rather than decompressed in place, as this may run on a thread other than the owner's
+            char* copy = ALLOCATE_ARRAY(char, length + 1);
+            writer.is_failed = copy == NULL;
+            length = copy != NULL ? string_copy_data(poem, copy, length + 1) : 0;
+            storage_writer_append(&writer, copy, length);
+            storage_writer_append(&writer, "\n", 1);
+            storage_checksums_update(&checksums, copy, length);
+            storage_checksums_update(&checksums, "\n", 1);
+            DEALLOCATE(copy);
+            continue;
+        }
+
+        if (writer.fill + length + 1 > STORAGE_BUFFER_SIZE)
+        {
+            storage_writer_flush(&writer);
+        }
+
+        // copied straight into the buffer, so that compressed poems are not kept decompressed
+        char* destination = writer.buffer + writer.fill;
+        string_copy_data(poem, destination, STORAGE_BUFFER_SIZE - writer.fill);
+        destination[length] = '\n';
+        storage_checksums_update(&checksums, destination, length + 1);
+        writer.fill += length + 1;
+        writer.total += length + 1;
+    }
+
+    storage_checksums_finish(&checksums);
+
+    // footer: the block size, the size of the poems, the number of blocks and the checksum of each block
+    char field[64];
+    int length = snprintf(field, sizeof(field), "%s%d %zu %zu", STORAGE_FOOTER_MAGIC,
+                          STORAGE_BLOCK_SIZE, checksums.total, checksums.values.size);
+    storage_writer_append(&writer, field, (size_t)length);
+
+    for (size_t i = 0; i < checksums.values.size && !writer.is_failed; i++)
+    {
+        length = snprintf(field, sizeof(field), " %08x", checksums.values.data[i]);
+        storage_writer_append(&writer, field, (size_t)length);
+    }
+
+    storage_writer_append(&writer, "\n", 1);
+    storage_writer_flush(&writer);
+
+    while (writer.io != NULL && async_io_get_pending(writer.io) > 0)
+    {
+        storage_writer_wait(&writer);
+    }
+
+    bool is_saved = !writer.is_failed && !checksums.is_failed && fsync(writer.file) == 0;
+    is_saved = (writer.file < 0 || close(writer.file) == 0) && is_saved;
+
+    if (is_saved && !is_previous_kept)
+    {
+        // the current file stays reachable as the previous generation; it may not exist yet
+        unlink(previous);
+        link(path, previous);
+    }
+
+    if (is_saved)
+    {
+        is_saved = rename(temporary, path) == 0;
+    }
+
+    int error = errno;
+
+    if (is_saved)
+    {
+        storage_sync_directory(path);
+        STATISTICS_ADD_BYTES_WRITTEN(writer.total);
+    }
+    else if (temporary != NULL)
+    {
+        unlink(temporary);
+    }
+
+    for (size_t i = 0; i < STORAGE_PIPELINE_DEPTH; i++)
+    {
+        DEALLOCATE(writer.buffers[i]);
+    }
+
+    async_io_destroy(writer.io);
+    checksum_array_release(&checksums.values);
+    DEALLOCATE(previous);
+    DEALLOCATE(temporary);
+    errno = error;
+    return is_saved;
+}
+
+FILE* storage_open_temporary(const char* const path)
+{
+    char* temporary = storage_path(path, STORAGE_TEMPORARY_SUFFIX);
+    FILE* file = temporary != NULL ? fopen(temporary, "w") : NULL;
+    DEALLOCATE(temporary);
+    return file;
+}
+
+bool storage_commit(FILE* file, const char* const path)
+{
+    char* temporary = storage_path(path, STORAGE_TEMPORARY_SUFFIX);
+    bool is_saved = temporary != NULL && fflush(file) == 0 && !ferror(file) && fsync(fileno(file)) == 0;
+    is_saved = fclose(file) == 0 && is_saved;
+    is_saved = is_saved && rename(temporary, path) == 0;
+    int error = errno;
+
+    if (is_saved)
+    {
+        storage_sync_directory(path);
+    }
+    else if (temporary != NULL)
+    {
+        unlink(temporary);
+    }
+
+    DEALLOCATE(temporary);
+    errno = error;
+    return is_saved;
+}
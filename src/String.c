@@ -1,18 +1,332 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "hdr/String.h"
 #include "hdr/MemoryAllocation.h"
 
+/* 'hot_slot' of a string that is not in the hot set. */
+#define NO_HOT_SLOT UINT_MAX
+/* Strings up to half this size are compressed in a buffer on the stack, and spilled ones up to this size read back to it. */
+#define STRING_ENCODE_STACK_SIZE 1024
+
 struct String
 {
+    // 'NULL' while only the compressed or the spilled form exists
     char* data;
+    // compressed form (see 'string_set_symbol_table'), or 'NULL'
+    unsigned char* packed;
     size_t length;
-    size_t size;
+    PoemId id;
+    // position of the body in the spill file (see 'string_set_spill_file') if 'is_spilled'
+    unsigned long long spill_offset;
+    unsigned references;
+    unsigned shard;
+    unsigned packed_size;
+    // size of the body in the spill file, which is compressed if 'is_spill_packed'
+    unsigned spill_size;
+    // position in 'string_hot', or 'NO_HOT_SLOT'
+    unsigned hot_slot;
     bool is_used;
+    // accessed since the CLOCK hand last passed it
+    bool is_referenced;
+    bool is_spilled;
+    bool is_spill_packed;
 };
 
+/*
+  Cold strings. While a symbol table or a spill file is set, every string with a decompressed body is in the hot set,
+  and 'string_trim_hot' makes the least recently accessed ones cold (CLOCK): they are compressed in memory or,
+  with a spill file, moved to it. The lock guards the hot set and the counters; the bodies are owned by their strings.
+*/
+static const SymbolTable* string_symbol_table = NULL;
+static SpillFile* string_spill_file = NULL;
+static size_t string_hot_capacity = SIZE_MAX;
+static size_t string_hot_budget = SIZE_MAX;
+static String** string_hot = NULL;
+static size_t string_hot_count = 0;
+static size_t string_hot_bytes = 0;
+static size_t string_hot_allocated = 0;
+static size_t string_hot_hand = 0;
+static size_t string_packed_count = 0;
+static size_t string_packed_bytes = 0;
+static size_t string_packed_length = 0;
+static size_t string_spilled_count = 0;
+static size_t string_thaws = 0;
+static atomic_size_t string_hot_hits;
+static atomic_size_t string_spill_reads;
+static pthread_mutex_t string_hot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* STATIC FUNCTIONS */
+
+/* Returns whether the strings are tracked in the hot set. */
+static bool string_is_cold_enabled(void)
+{
+    return string_symbol_table != NULL || string_spill_file != NULL;
+}
+
+/* Returns whether the hot set holds more than it may: bytes with a spill file, strings otherwise. The lock must be held. */
+static bool string_is_hot_full(void)
+{
+    return string_spill_file != NULL ? string_hot_bytes > string_hot_budget : string_hot_count > string_hot_capacity;
+}
+
+/* Adds the string to the hot set. The lock must be held. */
+static void string_hot_insert(String* const string)
+{
+    if (string_hot_count == string_hot_allocated)
+    {
+        String** grown = string_hot_allocated > 0 ? DOUBLE_ARRAY(string_hot, string_hot_allocated, String*)
+                                                  : ALLOCATE_ARRAY(String*, DEFAULT_BUFFER_SIZE);
+
+        if (grown == NULL)
+        {
+            // the string just stays decompressed
+            return;
+        }
+
+        string_hot = grown;
+        string_hot_allocated = string_hot_allocated > 0 ? 2 * string_hot_allocated : DEFAULT_BUFFER_SIZE;
+    }
+
+    string->hot_slot = (unsigned)string_hot_count;
+    string_hot[string_hot_count++] = string;
+    string_hot_bytes += string->length + 1;
+}
+
+/* Removes the string from the hot set (the last string takes its slot). The lock must be held. */
+static void string_hot_remove(String* const string)
+{
+    size_t slot = string->hot_slot;
+    string_hot[slot] = string_hot[--string_hot_count];
+    string_hot[slot]->hot_slot = (unsigned)slot;
+    string->hot_slot = NO_HOT_SLOT;
+    string_hot_bytes -= string->length + 1;
+}
+
+/* Forgets the hot set once neither compression nor spilling is enabled. The lock must be held. */
+static void string_hot_clear(void)
+{
+    if (string_is_cold_enabled())
+    {
+        return;
+    }
+
+    // the remaining strings (if any) stay decompressed
+    for (size_t i = 0; i < string_hot_count; i++)
+    {
+        string_hot[i]->hot_slot = NO_HOT_SLOT;
+    }
+
+    DEALLOCATE(string_hot);
+    string_hot = NULL;
+    string_hot_count = 0;
+    string_hot_bytes = 0;
+    string_hot_allocated = 0;
+    string_hot_hand = 0;
+}
+
+/* Returns a new compressed form of the body and writes its size to 'size', or 'NULL' if it would not be smaller. */
+static unsigned char* string_encode(const String* const string, unsigned* size)
+{
+    if (string->length == 0 || string->length > UINT_MAX / 2)
+    {
+        return NULL;
+    }
+
+    unsigned char stack_buffer[STRING_ENCODE_STACK_SIZE];
+    unsigned char* buffer = 2 * string->length <= sizeof(stack_buffer) ? stack_buffer
+                                                                       : ALLOCATE_ARRAY(unsigned char, 2 * string->length);
+    size_t encoded = buffer != NULL ? symbol_table_compress(string_symbol_table, string->data, string->length, buffer)
+                                    : string->length;
+    unsigned char* packed = encoded < string->length ? ALLOCATE_ARRAY(unsigned char, encoded) : NULL;
+
+    if (packed != NULL)
+    {
+        memcpy(packed, buffer, encoded);
+        *size = (unsigned)encoded;
+    }
+
+    if (buffer != stack_buffer)
+    {
+        DEALLOCATE(buffer);
+    }
+
+    return packed;
+}
+
+/* Attaches the compressed form of the body. The lock must be held. */
+static void string_set_packed(String* const string, unsigned char* packed, unsigned size)
+{
+    string->packed = packed;
+    string->packed_size = size;
+    string_packed_count++;
+    string_packed_bytes += size;
+    string_packed_length += string->length;
+}
+
+/* Drops the compressed form of the body (e.g. the contents change). The lock must be held. */
+static void string_unpack(String* const string)
+{
+    string_packed_count--;
+    string_packed_bytes -= string->packed_size;
+    string_packed_length -= string->length;
+    DEALLOCATE(string->packed);
+    string->packed = NULL;
+    string->packed_size = 0;
+}
+
+/*
+  Makes the string cold by moving its body to the spill file, as 'packed' (its compressed form, which is released)
+  or as it is if 'packed' is 'NULL'. A body spilled before is not written again, as it has not changed since.
+  Returns false if the string stays hot. The lock must be held.
+*/
+static bool string_spill(String* const string, unsigned char* packed, unsigned size)
+{
+    if (!string->is_spilled && packed == NULL && string->length > UINT_MAX)
+    {
+        return false;
+    }
+
+    if (!string->is_spilled)
+    {
+        const void* body = packed != NULL ? (const void*)packed : (const void*)string->data;
+        unsigned body_size = packed != NULL ? size : (unsigned)string->length;
+
+        if (!spill_file_append(string_spill_file, body, body_size, &string->spill_offset))
+        {
+            DEALLOCATE(packed);
+            return false;
+        }
+
+        string->is_spilled = true;
+        string->is_spill_packed = packed != NULL;
+        string->spill_size = body_size;
+        string_spilled_count++;
+    }
+
+    DEALLOCATE(packed);
+    DEALLOCATE(string->data);
+    string->data = NULL;
+
+    if (string->hot_slot != NO_HOT_SLOT)
+    {
+        string_hot_remove(string);
+    }
+
+    return true;
+}
+
+/*
+  Makes the string cold: only the compressed (or the spilled) form is kept. Without a spill file, a string that does
+  not compress leaves the hot set uncompressed for good. Returns false if the string stays hot. The lock must be held.
+*/
+static bool string_freeze(String* const string)
+{
+    if (string->references > 1)
+    {
+        // the body may be in use by the holder of the other reference
+        return false;
+    }
+
+    unsigned size = 0;
+
+    if (string_spill_file != NULL)
+    {
+        unsigned char* packed = !string->is_spilled && string_symbol_table != NULL ? string_encode(string, &size) : NULL;
+        return string_spill(string, packed, size);
+    }
+
+    unsigned char* packed = string->packed == NULL ? string_encode(string, &size) : NULL;
+
+    if (packed != NULL)
+    {
+        string_set_packed(string, packed, size);
+    }
+
+    if (string->packed != NULL)
+    {
+        DEALLOCATE(string->data);
+        string->data = NULL;
+    }
+
+    if (string->hot_slot != NO_HOT_SLOT)
+    {
+        string_hot_remove(string);
+    }
+
+    return true;
+}
+
+/* Reads the body of a spilled string to 'destination' ('capacity' bytes, at least the length) and decompresses it if needed. */
+static void string_read_spilled(const String* const string, char* destination, size_t capacity)
+{
+    bool is_read = false;
+    atomic_fetch_add_explicit(&string_spill_reads, 1, memory_order_relaxed);
+
+    if (!string->is_spill_packed)
+    {
+        is_read = spill_file_read(string_spill_file, string->spill_offset, destination, string->spill_size);
+    }
+    else
+    {
+        unsigned char stack_buffer[STRING_ENCODE_STACK_SIZE];
+        unsigned char* buffer = string->spill_size <= sizeof(stack_buffer) ? stack_buffer
+                                                                            : ALLOCATE_ARRAY(unsigned char, string->spill_size);
+        is_read = buffer != NULL && spill_file_read(string_spill_file, string->spill_offset, buffer, string->spill_size);
+
+        if (is_read)
+        {
+            symbol_table_decompress(string_symbol_table, buffer, string->spill_size, destination, capacity);
+        }
+
+        if (buffer != stack_buffer)
+        {
+            DEALLOCATE(buffer);
+        }
+    }
+
+    if (!is_read)
+    {
+        // the spilled body is kept, so a later access tries again
+        fprintf(stderr, "Error: a poem could not be read back from the spill file.\n");
+        memset(destination, 0, string->length);
+    }
+}
+
+/* Decompresses (or reads back) the body of a cold string and adds it to the hot set. */
+static void string_thaw(String* const string)
+{
+    char* data = ALLOCATE_ARRAY(char, string->length + 1);
+
+    if (data == NULL)
+    {
+        return;
+    }
+
+    string_copy_data(string, data, string->length + 1);
+    data[string->length] = '\0';
+    pthread_mutex_lock(&string_hot_lock);
+
+    // another thread may have thawed it in the meantime; one copying it without the lock sees the whole body
+    if (string->data == NULL)
+    {
+        __atomic_store_n(&string->data, data, __ATOMIC_RELEASE);
+        string_thaws++;
+        string_hot_insert(string);
+        data = NULL;
+    }
+
+    pthread_mutex_unlock(&string_hot_lock);
+    DEALLOCATE(data);
+}
+
+/* NON-STATIC FUNCTIONS */
+
 String* string_construct(const char* const str)
 {
     if (str == NULL)
@@ -28,24 +342,87 @@ String* string_construct(const char* const str)
     }
 
     string->length = strlen(str);
-    string->size = string->length + 1;
-    string->data = ALLOCATE_ARRAY(char, string->size);
+    string->data = ALLOCATE_ARRAY(char, string->length + 1);
+    string->packed = NULL;
+    string->packed_size = 0;
+    string->references = 1;
+    string->id = NO_POEM_ID;
+    string->shard = 0;
+    string->spill_offset = 0;
+    string->spill_size = 0;
+    string->hot_slot = NO_HOT_SLOT;
     string->is_used = false;
-    strncpy(string->data, str, string->size);
+    string->is_referenced = false;
+    string->is_spilled = false;
+    string->is_spill_packed = false;
+    memcpy(string->data, str, string->length + 1);
+
+    if (string_is_cold_enabled())
+    {
+        pthread_mutex_lock(&string_hot_lock);
+        string_hot_insert(string);
+        pthread_mutex_unlock(&string_hot_lock);
+    }
+
     return string;
 }
 
 void string_destroy(String* str)
 {
-    if (str != NULL)
+    if (str != NULL && --str->references == 0)
     {
-        free(str->data);
-        free(str);
+        if (str->hot_slot != NO_HOT_SLOT || str->packed != NULL || str->is_spilled)
+        {
+            pthread_mutex_lock(&string_hot_lock);
+
+            if (str->hot_slot != NO_HOT_SLOT)
+            {
+                string_hot_remove(str);
+            }
+
+            if (str->packed != NULL)
+            {
+                string_unpack(str);
+            }
+
+            // its place in the spill file is not reused
+            string_spilled_count -= str->is_spilled ? 1 : 0;
+            pthread_mutex_unlock(&string_hot_lock);
+        }
+
+        DEALLOCATE(str->data);
+        DEALLOCATE(str);
     }
 
     str = NULL;
 }
 
+String* string_retain(String* const string)
+{
+    string->references++;
+    return string;
+}
+
+PoemId string_get_id(const String* const string)
+{
+    return string->id;
+}
+
+void string_set_id(String* const string, PoemId id)
+{
+    string->id = id;
+}
+
+size_t string_get_shard(const String* const string)
+{
+    return string->shard;
+}
+
+void string_set_shard(String* const string, size_t shard)
+{
+    string->shard = (unsigned)shard;
+}
+
 size_t string_get_length(const String* const string)
 {
     return string->length;
@@ -53,12 +430,163 @@ size_t string_get_length(const String* const string)
 
 size_t string_get_size(const String *const string)
 {
-    return string->size;
+    return string->length + 1;
+}
+
+size_t string_get_footprint(const String* const string)
+{
+    return sizeof(String) + (string->data != NULL ? string->length + 1 : 0) + string->packed_size;
 }
 
 const char* string_get_data(const String* const string)
 {
-    return string->data;
+    // decompressing the body does not change the contents of the string
+    String* cached = (String*)string;
+
+    if (string_is_cold_enabled())
+    {
+        cached->is_referenced = true;
+
+        if (cached->data == NULL)
+        {
+            string_thaw(cached);
+        }
+        else if (cached->packed != NULL || cached->is_spilled)
+        {
+            atomic_fetch_add_explicit(&string_hot_hits, 1, memory_order_relaxed);
+        }
+    }
+
+    return cached->data;
+}
+
+size_t string_copy_data(const String* const string, char* destination, size_t capacity)
+{
+    // a string held by another reference is not frozen, so its body only goes from cold to hot under a copy
+    const char* data = __atomic_load_n(&string->data, __ATOMIC_ACQUIRE);
+
+    if (data != NULL)
+    {
+        memcpy(destination, data, string->length);
+        return string->length;
+    }
+
+    if (string->packed != NULL)
+    {
+        return symbol_table_decompress(string_symbol_table, string->packed, string->packed_size, destination, capacity);
+    }
+
+    string_read_spilled(string, destination, capacity);
+    return string->length;
+}
+
+void string_set_symbol_table(const SymbolTable* const table, size_t hot_capacity)
+{
+    pthread_mutex_lock(&string_hot_lock);
+    string_symbol_table = table;
+    string_hot_capacity = table != NULL ? hot_capacity : SIZE_MAX;
+    string_hot_clear();
+    pthread_mutex_unlock(&string_hot_lock);
+}
+
+void string_set_spill_file(SpillFile* const file, size_t budget)
+{
+    pthread_mutex_lock(&string_hot_lock);
+    string_spill_file = file;
+    string_hot_budget = file != NULL ? budget : SIZE_MAX;
+    string_hot_clear();
+    pthread_mutex_unlock(&string_hot_lock);
+}
+
+void string_admit(String* const string)
+{
+    if (!string_is_cold_enabled() || string->data == NULL || string->references > 1)
+    {
+        return;
+    }
+
+    if (string_spill_file != NULL)
+    {
+        pthread_mutex_lock(&string_hot_lock);
+        bool is_within_budget = string_hot_bytes <= string_hot_budget;
+        pthread_mutex_unlock(&string_hot_lock);
+
+        if (is_within_budget)
+        {
+            return;
+        }
+    }
+
+    // encoded outside of the lock, so that several loader threads can compress at once
+    unsigned size = 0;
+    unsigned char* packed = string->packed == NULL && string_symbol_table != NULL ? string_encode(string, &size) : NULL;
+    pthread_mutex_lock(&string_hot_lock);
+
+    if (string_spill_file != NULL)
+    {
+        string_spill(string, packed, size);
+        pthread_mutex_unlock(&string_hot_lock);
+        return;
+    }
+
+    if (packed != NULL)
+    {
+        string_set_packed(string, packed, size);
+    }
+
+    if (string->packed != NULL)
+    {
+        DEALLOCATE(string->data);
+        string->data = NULL;
+    }
+
+    if (string->hot_slot != NO_HOT_SLOT)
+    {
+        string_hot_remove(string);
+    }
+
+    pthread_mutex_unlock(&string_hot_lock);
+}
+
+void string_trim_hot(void)
+{
+    pthread_mutex_lock(&string_hot_lock);
+
+    // two full turns of the hand clear every reference bit; beyond that, only pinned strings are left
+    size_t limit = 2 * string_hot_count + 1;
+
+    for (size_t steps = 0; string_is_hot_full() && steps < limit; steps++)
+    {
+        string_hot_hand = string_hot_hand < string_hot_count ? string_hot_hand : 0;
+        String* string = string_hot[string_hot_hand];
+
+        if (string->is_referenced)
+        {
+            string->is_referenced = false;
+            string_hot_hand++;
+        }
+        else if (!string_freeze(string))
+        {
+            string_hot_hand++;
+        }
+    }
+
+    pthread_mutex_unlock(&string_hot_lock);
+}
+
+void string_get_cache_statistics(StringCacheStatistics* statistics)
+{
+    pthread_mutex_lock(&string_hot_lock);
+    statistics->packed_count = string_packed_count;
+    statistics->packed_bytes = string_packed_bytes;
+    statistics->packed_length = string_packed_length;
+    statistics->hot_count = string_hot_count;
+    statistics->hot_bytes = string_hot_bytes;
+    statistics->spilled_count = string_spilled_count;
+    statistics->spill_reads = atomic_load_explicit(&string_spill_reads, memory_order_relaxed);
+    statistics->hits = atomic_load_explicit(&string_hot_hits, memory_order_relaxed);
+    statistics->misses = string_thaws;
+    pthread_mutex_unlock(&string_hot_lock);
 }
 
 bool string_get_is_used(const String* const string)
@@ -73,7 +601,7 @@ void string_set_is_used(String *const string, bool value)
 
 int string_compare(const String* const left, const String* const right)
 {
-    return strcmp(left->data, right->data);
+    return strcmp(string_get_data(left), string_get_data(right));
 }
 
 String* string_read_line(FILE* source)
@@ -99,7 +627,7 @@ String* string_read_line(FILE* source)
 
     if (size == 0 && character == EOF)
     {
-        free(buffer);
+        DEALLOCATE(buffer);
         return string_construct("");
     }
 
@@ -109,8 +637,8 @@ String* string_read_line(FILE* source)
     trimmed_buffer[size] = '\0';
 
     String* string = string_construct(trimmed_buffer);
-    free(buffer);
-    free(trimmed_buffer);
+    DEALLOCATE(buffer);
+    DEALLOCATE(trimmed_buffer);
     return string;
 }
 
@@ -121,11 +649,28 @@ bool string_are_equal(const String* const left, const String* const right)
 
 bool string_are_equal_c(const String* const left, const char* const right)
 {
-    return strncmp(left->data, right, left->size) == 0;
+    return strncmp(string_get_data(left), right, left->length + 1) == 0;
 }
 
 void string_transform_to_upper(String* const string)
 {
+    string_get_data(string);
+
+    if (string->packed != NULL || string->is_spilled)
+    {
+        // the cold forms would be stale
+        pthread_mutex_lock(&string_hot_lock);
+
+        if (string->packed != NULL)
+        {
+            string_unpack(string);
+        }
+
+        string_spilled_count -= string->is_spilled ? 1 : 0;
+        string->is_spilled = false;
+        pthread_mutex_unlock(&string_hot_lock);
+    }
+
     for (size_t i = 0; i < string->length; i++)
     {
         if (isalpha(string->data[i]))
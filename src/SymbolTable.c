@@ -0,0 +1,379 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdr/SymbolTable.h"
+#include "hdr/MemoryAllocation.h"
+
+/* The symbols of 3 or more bytes are found by hashing their first 3 bytes. */
+#define SYMBOL_TABLE_HASH_BITS 12
+#define SYMBOL_TABLE_HASH_SIZE (1 << SYMBOL_TABLE_HASH_BITS)
+/* While training, codes 256 to 511 stand for the escaped bytes, so that frequent bytes can become symbols. */
+#define SYMBOL_TABLE_PSEUDO_CODES 512
+
+typedef struct Symbol {
+    // the bytes of the symbol, the first one in the lowest 8 bits
+    unsigned long long value;
+    size_t length;
+    char bytes[SYMBOL_TABLE_MAX_SYMBOL_LENGTH];
+} Symbol;
+
+/* A symbol that may enter the table, and the number of bytes it would have saved on the sample. */
+typedef struct SymbolCandidate {
+    Symbol symbol;
+    unsigned long long gain;
+} SymbolCandidate;
+
+struct SymbolTable
+{
+    Symbol symbols[SYMBOL_TABLE_ESCAPE];
+    size_t count;
+    // code + 1 of the symbol of 3 or more bytes whose first 3 bytes hash to the slot, or 0
+    unsigned short hash[SYMBOL_TABLE_HASH_SIZE];
+    // (length << 8 | code) of the longest symbol of at most 2 bytes starting with the (2) bytes, or 0 if none
+    unsigned short short_codes[1 << 16];
+    unsigned short byte_codes[1 << 8];
+};
+
+/* STATIC FUNCTIONS */
+
+/* Returns up to 8 bytes of 'data' as a number, the first byte in the lowest 8 bits. */
+static unsigned long long symbol_table_load(const char* data, size_t remaining)
+{
+    unsigned long long value = 0;
+    size_t length = remaining < SYMBOL_TABLE_MAX_SYMBOL_LENGTH ? remaining : SYMBOL_TABLE_MAX_SYMBOL_LENGTH;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (length == sizeof(value))
+    {
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+#endif
+
+    for (size_t i = 0; i < length; i++)
+    {
+        value |= (unsigned long long)(unsigned char)data[i] << (8 * i);
+    }
+
+    return value;
+}
+
+static unsigned long long symbol_table_mask(size_t length)
+{
+    return length >= SYMBOL_TABLE_MAX_SYMBOL_LENGTH ? ~0ull : (1ull << (8 * length)) - 1;
+}
+
+static size_t symbol_table_hash(unsigned long long value)
+{
+    return (size_t)(((unsigned)(value & 0xFFFFFF) * 0x9E3779B1u) >> (32 - SYMBOL_TABLE_HASH_BITS));
+}
+
+static Symbol symbol_table_make_symbol(unsigned long long value, size_t length)
+{
+    Symbol symbol = {value & symbol_table_mask(length), length, {0}};
+
+    for (size_t i = 0; i < length; i++)
+    {
+        symbol.bytes[i] = (char)(unsigned char)(value >> (8 * i));
+    }
+
+    return symbol;
+}
+
+/* Returns the symbol of a code, or of a pseudo code (an escaped byte) while training. */
+static Symbol symbol_table_get_symbol(const SymbolTable* const table, size_t code)
+{
+    return code < table->count ? table->symbols[code] : symbol_table_make_symbol(code - 256, 1);
+}
+
+/* Returns the code of the longest symbol at the beginning of 'data' and writes its length, or the escape code. */
+static size_t symbol_table_find(const SymbolTable* const table, const char* data, size_t remaining, size_t* length)
+{
+    unsigned long long value = symbol_table_load(data, remaining);
+
+    if (remaining >= 3)
+    {
+        size_t slot = table->hash[symbol_table_hash(value)];
+
+        if (slot != 0)
+        {
+            const Symbol* symbol = &table->symbols[slot - 1];
+
+            if (symbol->length <= remaining && (value & symbol_table_mask(symbol->length)) == symbol->value)
+            {
+                *length = symbol->length;
+                return slot - 1;
+            }
+        }
+    }
+
+    unsigned short entry = remaining >= 2 ? table->short_codes[value & 0xFFFF] : table->byte_codes[value & 0xFF];
+    *length = entry != 0 ? (size_t)(entry >> 8) : 1;
+    return entry != 0 ? (size_t)(entry & 0xFF) : SYMBOL_TABLE_ESCAPE;
+}
+
+/* Fills in the lookup tables with the best candidates (in order) that fit. */
+static void symbol_table_build(SymbolTable* table, const SymbolCandidate* candidates, size_t count)
+{
+    table->count = 0;
+    memset(table->hash, 0, sizeof(table->hash));
+    memset(table->byte_codes, 0, sizeof(table->byte_codes));
+
+    for (size_t i = 0; i < count && table->count < SYMBOL_TABLE_ESCAPE; i++)
+    {
+        const Symbol* symbol = &candidates[i].symbol;
+        size_t code = table->count;
+
+        if (symbol->length >= 3)
+        {
+            size_t slot = symbol_table_hash(symbol->value);
+
+            // a single symbol per slot: the one that saves more bytes came first
+            if (table->hash[slot] != 0)
+            {
+                continue;
+            }
+
+            table->hash[slot] = (unsigned short)(code + 1);
+        }
+        else if (symbol->length == 1)
+        {
+            table->byte_codes[symbol->value] = (unsigned short)(1 << 8 | code);
+        }
+
+        table->symbols[table->count++] = *symbol;
+    }
+
+    // a pair of bytes without a symbol of its own starts with the symbol of its first byte, if any
+    for (size_t i = 0; i < (1 << 16); i++)
+    {
+        table->short_codes[i] = table->byte_codes[i & 0xFF];
+    }
+
+    for (size_t code = 0; code < table->count; code++)
+    {
+        if (table->symbols[code].length == 2)
+        {
+            table->short_codes[table->symbols[code].value] = (unsigned short)(2 << 8 | code);
+        }
+    }
+}
+
+/* Compresses a sample with the current table, counting the (pseudo) codes and the pairs of consecutive codes. */
+static void symbol_table_count(const SymbolTable* const table, const char* data, size_t length, unsigned* singles, unsigned* pairs)
+{
+    size_t previous = SYMBOL_TABLE_PSEUDO_CODES;
+
+    for (size_t position = 0; position < length;)
+    {
+        size_t symbol_length = 0;
+        size_t code = symbol_table_find(table, data + position, length - position, &symbol_length);
+        size_t byte_code = 256 + (unsigned char)data[position];
+        code = code == SYMBOL_TABLE_ESCAPE ? byte_code : code;
+        singles[code]++;
+
+        // the first byte is counted on its own as well, so that it can compete with the longer symbol
+        if (code != byte_code)
+        {
+            singles[byte_code]++;
+        }
+
+        if (previous < SYMBOL_TABLE_PSEUDO_CODES)
+        {
+            pairs[previous * SYMBOL_TABLE_PSEUDO_CODES + code]++;
+        }
+
+        previous = code;
+        position += symbol_length;
+    }
+}
+
+/* Orders the candidates by their bytes, so that equal ones are next to each other (see 'qsort'). */
+static int symbol_table_compare_symbols(const void* left, const void* right)
+{
+    const Symbol* left_symbol = &((const SymbolCandidate*)left)->symbol;
+    const Symbol* right_symbol = &((const SymbolCandidate*)right)->symbol;
+
+    if (left_symbol->length != right_symbol->length)
+    {
+        return left_symbol->length < right_symbol->length ? -1 : 1;
+    }
+
+    return left_symbol->value < right_symbol->value ? -1 : left_symbol->value > right_symbol->value;
+}
+
+/* Orders the candidates by the bytes they save, most first; longer symbols first among equal gains (see 'qsort'). */
+static int symbol_table_compare_gains(const void* left, const void* right)
+{
+    const SymbolCandidate* left_candidate = left;
+    const SymbolCandidate* right_candidate = right;
+
+    if (left_candidate->gain != right_candidate->gain)
+    {
+        return left_candidate->gain > right_candidate->gain ? -1 : 1;
+    }
+
+    return -symbol_table_compare_symbols(left, right);
+}
+
+/* Writes the candidates of the next generation to 'candidates'. Returns their number. */
+static size_t symbol_table_gather(const SymbolTable* const table, const unsigned* singles, const unsigned* pairs,
+                                  SymbolCandidate* candidates)
+{
+    size_t count = 0;
+
+    for (size_t code = 0; code < SYMBOL_TABLE_PSEUDO_CODES; code++)
+    {
+        if (singles[code] == 0)
+        {
+            continue;
+        }
+
+        Symbol symbol = symbol_table_get_symbol(table, code);
+        candidates[count++] = (SymbolCandidate){symbol, (unsigned long long)singles[code] * symbol.length};
+
+        for (size_t next = 0; next < SYMBOL_TABLE_PSEUDO_CODES && symbol.length < SYMBOL_TABLE_MAX_SYMBOL_LENGTH; next++)
+        {
+            unsigned frequency = pairs[code * SYMBOL_TABLE_PSEUDO_CODES + next];
+
+            if (frequency == 0)
+            {
+                continue;
+            }
+
+            Symbol second = symbol_table_get_symbol(table, next);
+            size_t length = symbol.length + second.length;
+            length = length < SYMBOL_TABLE_MAX_SYMBOL_LENGTH ? length : SYMBOL_TABLE_MAX_SYMBOL_LENGTH;
+            Symbol joined = symbol_table_make_symbol(symbol.value | second.value << (8 * symbol.length), length);
+            candidates[count++] = (SymbolCandidate){joined, (unsigned long long)frequency * length};
+        }
+    }
+
+    // the same symbol may come from several pairs
+    qsort(candidates, count, sizeof(SymbolCandidate), symbol_table_compare_symbols);
+    size_t merged = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (merged > 0 && symbol_table_compare_symbols(&candidates[merged - 1], &candidates[i]) == 0)
+        {
+            candidates[merged - 1].gain += candidates[i].gain;
+        }
+        else
+        {
+            candidates[merged++] = candidates[i];
+        }
+    }
+
+    qsort(candidates, merged, sizeof(SymbolCandidate), symbol_table_compare_gains);
+    return merged;
+}
+
+/* NON-STATIC FUNCTIONS */
+
+SymbolTable* symbol_table_train(const char* const* samples, const size_t* lengths, size_t count)
+{
+    SymbolTable* table = ALLOCATE(SymbolTable);
+    unsigned* singles = ALLOCATE_ARRAY(unsigned, SYMBOL_TABLE_PSEUDO_CODES);
+    unsigned* pairs = ALLOCATE_ARRAY(unsigned, SYMBOL_TABLE_PSEUDO_CODES * SYMBOL_TABLE_PSEUDO_CODES);
+    SymbolCandidate* candidates = ALLOCATE_ARRAY(SymbolCandidate, SYMBOL_TABLE_PSEUDO_CODES * (SYMBOL_TABLE_PSEUDO_CODES + 1));
+
+    if (table == NULL || singles == NULL || pairs == NULL || candidates == NULL)
+    {
+        DEALLOCATE(candidates);
+        DEALLOCATE(pairs);
+        DEALLOCATE(singles);
+        DEALLOCATE(table);
+        return NULL;
+    }
+
+    symbol_table_build(table, NULL, 0);
+
+    for (size_t generation = 0; generation < SYMBOL_TABLE_GENERATIONS; generation++)
+    {
+        memset(singles, 0, SYMBOL_TABLE_PSEUDO_CODES * sizeof(unsigned));
+        memset(pairs, 0, SYMBOL_TABLE_PSEUDO_CODES * SYMBOL_TABLE_PSEUDO_CODES * sizeof(unsigned));
+
+        for (size_t i = 0; i < count; i++)
+        {
+            symbol_table_count(table, samples[i], lengths[i], singles, pairs);
+        }
+
+        size_t candidate_count = symbol_table_gather(table, singles, pairs, candidates);
+        symbol_table_build(table, candidates, candidate_count);
+    }
+
+    DEALLOCATE(candidates);
+    DEALLOCATE(pairs);
+    DEALLOCATE(singles);
+    return table;
+}
+
+void symbol_table_destroy(SymbolTable* table)
+{
+    DEALLOCATE(table);
+}
+
+size_t symbol_table_get_symbol_count(const SymbolTable* const table)
+{
+    return table->count;
+}
+
+size_t symbol_table_compress(const SymbolTable* const table, const char* data, size_t length, unsigned char* destination)
+{
+    size_t size = 0;
+
+    for (size_t position = 0; position < length;)
+    {
+        size_t symbol_length = 0;
+        size_t code = symbol_table_find(table, data + position, length - position, &symbol_length);
+        destination[size++] = (unsigned char)code;
+
+        if (code == SYMBOL_TABLE_ESCAPE)
+        {
+            destination[size++] = (unsigned char)data[position];
+        }
+
+        position += symbol_length;
+    }
+
+    return size;
+}
+
+size_t symbol_table_decompress(const SymbolTable* const table, const unsigned char* packed, size_t size,
+                               char* destination, size_t capacity)
+{
+    size_t length = 0;
+    size_t i = 0;
+
+    // whole symbols are copied as long as they fit, then only their actual bytes
+    while (i < size && length + SYMBOL_TABLE_MAX_SYMBOL_LENGTH <= capacity)
+    {
+        size_t code = packed[i++];
+
+        if (code == SYMBOL_TABLE_ESCAPE)
+        {
+            destination[length++] = (char)packed[i++];
+            continue;
+        }
+
+        memcpy(destination + length, table->symbols[code].bytes, SYMBOL_TABLE_MAX_SYMBOL_LENGTH);
+        length += table->symbols[code].length;
+    }
+
+    while (i < size)
+    {
+        size_t code = packed[i++];
+
+        if (code == SYMBOL_TABLE_ESCAPE)
+        {
+            destination[length++] = (char)packed[i++];
+            continue;
+        }
+
+        memcpy(destination + length, table->symbols[code].bytes, table->symbols[code].length);
+        length += table->symbols[code].length;
+    }
+
+    return length;
+}
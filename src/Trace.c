@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include "hdr/Trace.h"
+#include "hdr/MemoryAllocation.h"
+
+#define TRACE_PARENT_RING 0
+/* The parent's ring followed by the ring of each slot. */
+#define TRACE_RINGS (TRACE_MAX_SLOTS + 1)
+
+typedef struct TraceEvent {
+    TracePhase phase;
+    pid_t pid;
+    pid_t tid;
+    unsigned long long start;
+    unsigned long long duration;
+} TraceEvent;
+
+/* Single-producer ring: only the owning process or thread writes, the parent reads after the round. */
+typedef struct TraceRing {
+    atomic_size_t head;
+    TraceEvent events[TRACE_RING_CAPACITY];
+} TraceRing;
+
+typedef struct Trace {
+    TraceRing* rings;
+    TraceEvent* log;
+    size_t log_size;
+    size_t log_capacity;
+    size_t rounds;
+} Trace;
+
+static const char* const trace_phase_names[] = {
+    "round", "msgget", "pipe", "fork", "signal wait (pause)", "pipe write", "msgrcv", "waitpid",
+    "child", "signal send (kill)", "pipe read", "msgsnd",
+    "wake bunny", "arrival wait", "poems push", "choice pop",
+    "bunny", "arrival push", "poems pop"
+};
+
+/* Ring of the calling thread. Bunny threads switch to the ring of their slot, the main thread stays on the parent's. */
+static _Thread_local size_t trace_ring_index = TRACE_PARENT_RING;
+
+static Trace trace = {NULL, NULL, 0, 0, 0};
+
+/* STATIC FUNCTIONS */
+
+/* Appends 'event' to the log. Without memory to grow the log, the event is dropped. */
+static void trace_log_append(const TraceEvent* const event)
+{
+    if (trace.log_size == trace.log_capacity)
+    {
+        TraceEvent* log = DOUBLE_ARRAY(trace.log, trace.log_capacity, TraceEvent);
+
+        if (log == NULL)
+        {
+            return;
+        }
+
+        trace.log = log;
+        trace.log_capacity *= 2;
+    }
+
+    trace.log[trace.log_size++] = *event;
+}
+
+static void trace_merge_ring(TraceRing* ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t first = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+
+    for (size_t i = first; i < head; i++)
+    {
+        trace_log_append(&ring->events[i % TRACE_RING_CAPACITY]);
+    }
+}
+
+/* NON-STATIC FUNCTIONS */
+
+bool trace_enable(void)
+{
+    if (trace.rings != NULL)
+    {
+        return true;
+    }
+
+    void* memory = mmap(NULL, TRACE_RINGS * sizeof(TraceRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    trace.log = ALLOCATE_ARRAY(TraceEvent, 1);
+
+    if (trace.log == NULL)
+    {
+        munmap(memory, TRACE_RINGS * sizeof(TraceRing));
+        return false;
+    }
+
+    trace.rings = memory;
+    trace.log_capacity = 1;
+    return true;
+}
+
+bool trace_is_enabled(void)
+{
+    return trace.rings != NULL;
+}
+
+unsigned long long trace_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+void trace_begin_round(size_t slot)
+{
+    if (trace.rings == NULL || slot >= TRACE_MAX_SLOTS)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&trace.rings[slot + 1].head, 0, memory_order_release);
+}
+
+void trace_enter_child(size_t slot)
+{
+    trace_ring_index = slot < TRACE_MAX_SLOTS ? slot + 1 : TRACE_PARENT_RING;
+}
+
+void trace_record(TracePhase phase, unsigned long long start)
+{
+    if (trace.rings == NULL)
+    {
+        return;
+    }
+
+    unsigned long long end = trace_now();
+    TraceRing* ring = &trace.rings[trace_ring_index];
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->events[head % TRACE_RING_CAPACITY] = (TraceEvent){phase, getpid(), (pid_t)syscall(SYS_gettid), start, end - start};
+    // publishing the event -- the reader only looks at slots below 'head'
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_end_round(size_t slot)
+{
+    if (trace.rings == NULL || slot >= TRACE_MAX_SLOTS)
+    {
+        return;
+    }
+
+    // the parent's ring holds the events of every round started or finished since the last merge
+    trace_merge_ring(&trace.rings[TRACE_PARENT_RING]);
+    atomic_store_explicit(&trace.rings[TRACE_PARENT_RING].head, 0, memory_order_relaxed);
+    trace_merge_ring(&trace.rings[slot + 1]);
+    trace.rounds++;
+}
+
+void trace_write_chrome_json(FILE* output)
+{
+    fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [", output);
+
+    for (size_t i = 0; i < trace.log_size; i++)
+    {
+        const TraceEvent* event = &trace.log[i];
+        fprintf(output,
+                "%s\n  {\"name\": \"%s\", \"cat\": \"sprinkle\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                i == 0 ? "" : ",", trace_phase_names[event->phase],
+                event->start / 1e3, event->duration / 1e3, (int)event->pid, (int)event->tid);
+    }
+
+    fprintf(output, "\n], \"otherData\": {\"rounds\": %lu}}\n", trace.rounds);
+}
+
+void trace_destroy(void)
+{
+    if (trace.rings != NULL)
+    {
+        munmap(trace.rings, TRACE_RINGS * sizeof(TraceRing));
+    }
+
+    DEALLOCATE(trace.log);
+    trace = (Trace){NULL, NULL, 0, 0, 0};
+}
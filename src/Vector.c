@@ -1,51 +1,386 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "hdr/Vector.h"
 #include "hdr/MemoryAllocation.h"
+#include "hdr/Array.h"
 
+/* Number of strings whose 'used' flags share a word of 'Vector.used'. */
+#define VECTOR_WORD_BITS 64
+
+DEFINE_ARRAY(StringArray, string_array, String*, ARRAY_DEFAULT_GROWTH)
+DEFINE_ARRAY(LengthArray, length_array, unsigned, ARRAY_DEFAULT_GROWTH)
+DEFINE_ARRAY(WordArray, word_array, unsigned long long, ARRAY_DEFAULT_GROWTH)
+DEFINE_ARRAY(IndexArray, index_array, size_t, ARRAY_DEFAULT_GROWTH)
+
+static bool vector_is_output_buffered = false;
+
+/*
+  The table of the poems, kept as parallel arrays: 'strings.data[i]' is the string at index 'i', 'lengths.data[i]'
+  its length (bodies are shorter than 4 GiB, like in 'String') and bit 'i' of 'used' whether it is used. The scans
+  that only need these (counting or finding unused poems, the lengths of a listing) run over dense memory without
+  touching the strings.
+*/
 struct Vector
 {
-    String** data;
-    size_t size;
-    size_t capacity;
+    StringArray strings;
+    LengthArray lengths;
+    // at least one word more than the strings need, so that 'vector_shift_bits' may read the word after the last one in use
+    WordArray used;
     size_t used_count;
+    size_t text_length;
+    // 'by_id.data[id]' is the string currently holding poem 'id', or NULL if it is not in the vector
+    StringArray by_id;
+    /*
+      'slots.data[id]' is the index of poem 'id'. It is kept up to date as the slots are written, but inserting or
+      removing strings shifts the ones after them: only the strings below 'slots_valid' are known to be where
+      'slots' says. The rest is caught up on the next lookup.
+    */
+    IndexArray slots;
+    size_t slots_valid;
+    PoemId next_id;
+    size_t version;
+    size_t shard_sizes[MAX_SHARDS];
+    size_t shard_versions[MAX_SHARDS];
 };
 
 /* STATIC FUNCTIONS */
 
-static void vector_double_capacity(Vector* vector)
+/* Makes room for 'size' strings in every array of the table. Returns false upon failure. */
+static bool vector_grow(Vector* vector, size_t size)
 {
-    vector->data = DOUBLE_ARRAY(vector->data, vector->capacity, String*);
-    vector->capacity = 2 * vector->capacity;
+    size_t words = size / VECTOR_WORD_BITS + 2;
+    return ARRAY_GROW(string_array, &vector->strings, size) && ARRAY_GROW(length_array, &vector->lengths, size) &&
+           (vector->used.size >= words || ARRAY_RESIZE(word_array, &vector->used, words));
+}
 
-    for (size_t i = vector->size; i < vector->capacity; i++)
+static bool vector_is_bit_set(const Vector* const vector, size_t index)
+{
+    return (vector->used.data[index / VECTOR_WORD_BITS] >> (index % VECTOR_WORD_BITS)) & 1;
+}
+
+static void vector_set_bit(Vector* vector, size_t index, bool value)
+{
+    unsigned long long mask = 1ULL << (index % VECTOR_WORD_BITS);
+    unsigned long long* word = &vector->used.data[index / VECTOR_WORD_BITS];
+    *word = value ? *word | mask : *word & ~mask;
+}
+
+/*
+  Shifts the 'used' bits from 'index' on by 'count' places: down (removing the bits of [index..index+count))
+  if 'is_removal' is true, up (opening a gap of 'count' bits at 'index') otherwise. 'size' is the number of bits
+  in use after the shift. The bits below 'index' are kept; the bits of the gap are left undefined.
+*/
+static void vector_shift_bits(Vector* vector, size_t index, size_t count, size_t size, bool is_removal)
+{
+    if (size <= index)
     {
-        vector->data[i] = NULL;
+        return;
     }
+
+    unsigned long long* used = vector->used.data;
+    size_t first = index / VECTOR_WORD_BITS;
+    size_t last = (size - 1) / VECTOR_WORD_BITS;
+    size_t words = count / VECTOR_WORD_BITS;
+    size_t bits = count % VECTOR_WORD_BITS;
+    // the bits below 'index' in its word stay in place
+    unsigned long long kept = (1ULL << (index % VECTOR_WORD_BITS)) - 1;
+    unsigned long long first_word = used[first];
+
+    // a word is only overwritten after every word it is read from, so the shift runs away from its source
+    if (is_removal)
+    {
+        for (size_t word = first; word <= last; word++)
+        {
+            used[word] = bits == 0 ? used[word + words]
+                                   : (used[word + words] >> bits) | (used[word + words + 1] << (VECTOR_WORD_BITS - bits));
+        }
+    }
+    else
+    {
+        for (size_t word = last + 1; word-- > first;)
+        {
+            unsigned long long high = word >= words ? used[word - words] : 0;
+            unsigned long long low = word >= words + 1 ? used[word - words - 1] : 0;
+            used[word] = bits == 0 ? high : (high << bits) | (low >> (VECTOR_WORD_BITS - bits));
+        }
+    }
+
+    used[first] = (first_word & kept) | (used[first] & ~kept);
 }
 
-/* NON-STATIC FUNCTIONS */
+/* Writes the string and its entries to the slot 'index'. The string must be registered (see 'vector_register'). */
+static void vector_set_slot(Vector* vector, size_t index, String* const string)
+{
+    PoemId id = string_get_id(string);
+    vector->strings.data[index] = string;
+    vector->lengths.data[index] = (unsigned)string_get_length(string);
+    vector_set_bit(vector, index, string_get_is_used(string));
 
-Vector* vector_construct(void)
+    if (id < vector->slots.size)
+    {
+        vector->slots.data[id] = index;
+    }
+
+    // e.g. appending keeps every slot valid
+    if (vector->slots_valid == index)
+    {
+        vector->slots_valid++;
+    }
+}
+
+/* The strings from 'index' on have moved (see 'Vector.slots'). */
+static void vector_invalidate_slots(Vector* vector, size_t index)
 {
-    Vector* vector = ALLOCATE(Vector);
+    vector->slots_valid = index < vector->slots_valid ? index : vector->slots_valid;
+}
 
-    if (vector == NULL)
+/* Returns whether the poem 'string' is at the index 'slots' records for it. */
+static bool vector_is_slot_valid(const Vector* const vector, const String* const string)
+{
+    PoemId id = string_get_id(string);
+    return id < vector->slots.size && vector->slots.data[id] < vector->slots_valid &&
+           vector->strings.data[vector->slots.data[id]] == string;
+}
+
+/* Returns the index of the poem 'string', or the size of the vector if it is not in the vector. */
+static size_t vector_find_slot(Vector* vector, const String* const string)
+{
+    if (!vector_is_slot_valid(vector, string))
     {
-        return NULL;
+        // the strings that have moved since the last lookup are recorded again, once
+        for (size_t i = vector->slots_valid; i < vector->strings.size; i++)
+        {
+            PoemId id = string_get_id(vector->strings.data[i]);
+
+            if (id < vector->slots.size)
+            {
+                vector->slots.data[id] = i;
+            }
+        }
+
+        vector->slots_valid = vector->strings.size;
+    }
+
+    return vector_is_slot_valid(vector, string) ? vector->slots.data[string_get_id(string)] : vector->strings.size;
+}
+
+/* Shifts the entries after the range [index..index+count) down to fill it. The strings of the range are already gone. */
+static void vector_close_gap(Vector* vector, size_t index, size_t count)
+{
+    vector_invalidate_slots(vector, index);
+    vector_shift_bits(vector, index, count, vector->strings.size - count, true);
+    string_array_erase(&vector->strings, index, count);
+    length_array_erase(&vector->lengths, index, count);
+
+    // the memory of a table that has shrunk a lot is given back (the bitmap is small enough to keep)
+    if (vector->strings.size < vector->strings.capacity / 4)
+    {
+        ARRAY_SHRINK_TO_FIT(string_array, &vector->strings);
+        ARRAY_SHRINK_TO_FIT(length_array, &vector->lengths);
+    }
+}
+
+/* Gives 'string' a new identifier if it has none yet, and records where that poem lives now. */
+static void vector_register(Vector* vector, String* const string)
+{
+    if (string_get_id(string) == NO_POEM_ID)
+    {
+        string_set_id(string, vector->next_id++);
+    }
+
+    PoemId id = string_get_id(string);
+
+    // without room for it, the poem cannot be looked up by its identifier (nor its index, see 'vector_find_slot')
+    if (id < vector->by_id.size || ARRAY_RESIZE(string_array, &vector->by_id, id + 1))
+    {
+        vector->by_id.data[id] = string;
+    }
+
+    if (id >= vector->slots.size)
+    {
+        ARRAY_RESIZE(index_array, &vector->slots, id + 1);
+    }
+
+    vector->text_length += string_get_length(string);
+    vector->version++;
+    vector->shard_sizes[string_get_shard(string)]++;
+    vector->shard_versions[string_get_shard(string)]++;
+}
+
+/* The poem held by 'string' is no longer in the vector. */
+static void vector_unregister(Vector* vector, const String* const string)
+{
+    PoemId id = string_get_id(string);
+
+    if (id < vector->by_id.size && vector->by_id.data[id] == string)
+    {
+        vector->by_id.data[id] = NULL;
+    }
+
+    vector->text_length -= string_get_length(string);
+    vector->version++;
+    vector->shard_sizes[string_get_shard(string)]--;
+    vector->shard_versions[string_get_shard(string)]++;
+}
+
+/* Writes the whole buffer to 'stdout', retrying on partial writes. */
+static void vector_write_all(const char* buffer, size_t size)
+{
+    if (vector_is_output_buffered)
+    {
+        fwrite(buffer, 1, size, stdout);
+        return;
+    }
+
+    while (size > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, buffer, size);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return;
+        }
+
+        buffer += written;
+        size -= (size_t)written;
+    }
+}
+
+/* Writes the decimal form of 'number' to 'destination'. Returns the number of characters written. */
+static size_t vector_format_index(char* destination, size_t number)
+{
+    char digits[20];
+    size_t count = 0;
+
+    do
+    {
+        digits[count++] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        destination[i] = digits[count - 1 - i];
+    }
+
+    return count;
+}
+
+/*
+  Prints out the elements in the range [from..to). Each entry is numbered as 'index - base + 1',
+  preceded by 'label:' if 'is_labelled' is true.
+  The entries are formatted into a large buffer that is written to 'stdout' in a few system calls
+  (or to its stdio buffer, see 'vector_set_buffered_output').
+*/
+static void vector_print_entries(const Vector* const vector, size_t from, size_t to, bool is_labelled, size_t label, size_t base)
+{
+    // anything still buffered by stdio has to precede the entries
+    if (!vector_is_output_buffered)
+    {
+        fflush(stdout);
     }
 
-    vector->data = ALLOCATE_ARRAY(String*, 1);
+    char* buffer = ALLOCATE_ARRAY(char, OUTPUT_BUFFER_SIZE);
+
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    size_t used = 0;
+
+    for (size_t i = from; i < to; i++)
+    {
+        size_t length = vector->lengths.data[i];
+        bool is_used = vector_is_bit_set(vector, i);
+        // "[" + up to 20 digits + ":" + up to 20 digits + "] " + poem + " (USED)" + "\n"
+        size_t entry_size = length + 56;
+
+        if (used + entry_size > OUTPUT_BUFFER_SIZE)
+        {
+            vector_write_all(buffer, used);
+            used = 0;
+        }
+
+        if (entry_size > OUTPUT_BUFFER_SIZE)
+        {
+            // poem longer than the buffer itself -- printed on its own
+            if (is_labelled)
+            {
+                printf("[%lu:%lu] %s%s\n", label, i - base + 1, vector_get_at(vector, i), is_used ? " (USED)" : "");
+            }
+            else
+            {
+                printf("[%lu] %s%s\n", i - base + 1, vector_get_at(vector, i), is_used ? " (USED)" : "");
+            }
+
+            if (!vector_is_output_buffered)
+            {
+                fflush(stdout);
+            }
+
+            continue;
+        }
+
+        buffer[used++] = '[';
+
+        if (is_labelled)
+        {
+            used += vector_format_index(buffer + used, label);
+            buffer[used++] = ':';
+        }
+
+        used += vector_format_index(buffer + used, i - base + 1);
+        buffer[used++] = ']';
+        buffer[used++] = ' ';
+        // copied without keeping compressed poems decompressed (see 'string_copy_data')
+        used += string_copy_data(vector->strings.data[i], buffer + used, OUTPUT_BUFFER_SIZE - used);
+
+        if (is_used)
+        {
+            memcpy(buffer + used, " (USED)", 7);
+            used += 7;
+        }
+
+        buffer[used++] = '\n';
+    }
+
+    vector_write_all(buffer, used);
+    DEALLOCATE(buffer);
+}
+
+/* NON-STATIC FUNCTIONS */
+
+Vector* vector_construct(void)
+{
+    Vector* vector = ALLOCATE(Vector);
 
-    if (vector->data == NULL)
+    if (vector == NULL)
     {
         return NULL;
     }
 
-    vector->capacity = 1;
-    vector->size = 0;
+    // nothing else is allocated until the first string is added
+    string_array_initialise(&vector->strings);
+    length_array_initialise(&vector->lengths);
+    word_array_initialise(&vector->used);
+    string_array_initialise(&vector->by_id);
+    index_array_initialise(&vector->slots);
+    vector->slots_valid = 0;
     vector->used_count = 0;
+    vector->text_length = 0;
+    vector->next_id = NO_POEM_ID + 1;
+    vector->version = 0;
+    // 'shard_sizes' and 'shard_versions' are zeroed by 'ALLOCATE'
     return vector;
 }
 
@@ -53,21 +388,63 @@ void vector_destroy(Vector* vector)
 {
     if (vector != NULL)
     {
-        for (size_t i = 0; i < vector->size; i++)
+        for (size_t i = 0; i < vector->strings.size; i++)
         {
-            string_destroy(vector->data[i]);
+            string_destroy(vector->strings.data[i]);
         }
 
-        free(vector->data);
-        free(vector);
+        string_array_release(&vector->strings);
+        length_array_release(&vector->lengths);
+        word_array_release(&vector->used);
+        string_array_release(&vector->by_id);
+        index_array_release(&vector->slots);
+        DEALLOCATE(vector);
     }
 
     vector = NULL;
 }
 
+bool vector_reserve(Vector* vector, size_t capacity)
+{
+    size_t words = capacity / VECTOR_WORD_BITS + 2;
+    // the strings added get the next identifiers
+    size_t ids = vector->next_id + (capacity > vector->strings.size ? capacity - vector->strings.size : 0);
+    return ARRAY_RESERVE(string_array, &vector->strings, capacity) &&
+           ARRAY_RESERVE(length_array, &vector->lengths, capacity) &&
+           (vector->used.size >= words || ARRAY_RESIZE(word_array, &vector->used, words)) &&
+           ARRAY_RESERVE(string_array, &vector->by_id, ids) && ARRAY_RESERVE(index_array, &vector->slots, ids);
+}
+
 size_t vector_get_size(const Vector* const vector)
 {
-    return vector->size;
+    return vector->strings.size;
+}
+
+size_t vector_get_version(const Vector* const vector)
+{
+    return vector->version;
+}
+
+size_t vector_get_shard_size(const Vector* const vector, size_t shard)
+{
+    return vector->shard_sizes[shard];
+}
+
+size_t vector_get_shard_start(const Vector* const vector, size_t shard)
+{
+    size_t start = 0;
+
+    for (size_t i = 0; i < shard; i++)
+    {
+        start += vector->shard_sizes[i];
+    }
+
+    return start;
+}
+
+size_t vector_get_shard_version(const Vector* const vector, size_t shard)
+{
+    return vector->shard_versions[shard];
 }
 
 size_t vector_get_used_count(const Vector *const vector)
@@ -75,26 +452,95 @@ size_t vector_get_used_count(const Vector *const vector)
     return vector->used_count;
 }
 
-void vector_print(const Vector* const vector)
+size_t vector_count_used(const Vector* const vector, size_t from, size_t to)
 {
-    if (vector->size == 0)
+    to = to < vector->strings.size ? to : vector->strings.size;
+
+    if (from >= to)
     {
-        puts("(empty)");
+        return 0;
     }
-    else
+
+    size_t count = 0;
+    size_t last = (to - 1) / VECTOR_WORD_BITS;
+
+    for (size_t word = from / VECTOR_WORD_BITS; word <= last; word++)
     {
-        for (size_t i = 0; i < vector->size; i++)
-        {
-            printf("[%lu] %s", i + 1, vector_get_at(vector, i));
+        unsigned long long bits = vector->used.data[word];
+        bits &= word == from / VECTOR_WORD_BITS ? ~0ULL << (from % VECTOR_WORD_BITS) : ~0ULL;
+        bits &= word == last && to % VECTOR_WORD_BITS != 0 ? ~0ULL >> (VECTOR_WORD_BITS - to % VECTOR_WORD_BITS) : ~0ULL;
+        count += (size_t)__builtin_popcountll(bits);
+    }
 
-            if (string_get_is_used(vector->data[i]))
-            {
-                printf(" (USED)");
-            }
+    return count;
+}
+
+size_t vector_find_unused(const Vector* const vector, size_t from, size_t to)
+{
+    to = to < vector->strings.size ? to : vector->strings.size;
 
-            printf("\n");
+    if (from >= to)
+    {
+        return to;
+    }
+
+    size_t last = (to - 1) / VECTOR_WORD_BITS;
+
+    for (size_t word = from / VECTOR_WORD_BITS; word <= last; word++)
+    {
+        unsigned long long bits = ~vector->used.data[word];
+        bits &= word == from / VECTOR_WORD_BITS ? ~0ULL << (from % VECTOR_WORD_BITS) : ~0ULL;
+
+        if (bits != 0)
+        {
+            size_t index = word * VECTOR_WORD_BITS + (size_t)__builtin_ctzll(bits);
+            return index < to ? index : to;
         }
     }
+
+    return to;
+}
+
+size_t vector_get_text_length(const Vector* const vector)
+{
+    return vector->text_length;
+}
+
+void vector_set_buffered_output(bool is_buffered)
+{
+    vector_is_output_buffered = is_buffered;
+}
+
+void vector_print(const Vector* const vector)
+{
+    vector_print_range(vector, 0, vector->strings.size);
+}
+
+void vector_print_range(const Vector* const vector, size_t from, size_t to)
+{
+    if (vector->strings.size == 0)
+    {
+        puts("(empty)");
+        return;
+    }
+
+    to = to < vector->strings.size ? to : vector->strings.size;
+    vector_print_entries(vector, from, to, false, 0, 0);
+}
+
+void vector_print_shard_range(const Vector* const vector, size_t shard, size_t label, size_t from, size_t to)
+{
+    size_t size = vector->shard_sizes[shard];
+
+    if (size == 0)
+    {
+        puts("(empty)");
+        return;
+    }
+
+    size_t start = vector_get_shard_start(vector, shard);
+    to = to < size ? to : size;
+    vector_print_entries(vector, start + from, start + to, true, label, start);
 }
 
 void vector_append(Vector* vector, String* const string)
@@ -102,109 +548,205 @@ void vector_append(Vector* vector, String* const string)
     if (vector == NULL)
         return;
 
-    if (vector->capacity == vector->size)
+    if (!vector_grow(vector, vector->strings.size + 1))
     {
-        vector_double_capacity(vector);
+        return;
     }
 
-    vector->data[vector->size] = string;
-    vector->size++;
+    vector_register(vector, string);
+    // the room is there already; the slot is filled in below
+    vector->strings.size++;
+    vector->lengths.size++;
+    vector_set_slot(vector, vector->strings.size - 1, string);
 }
 
 const char* vector_get_at(const Vector* const vector, size_t index)
 {
-    if (index >= vector->size)
+    if (index >= vector->strings.size)
     {
         return NULL;
     }
 
-    return string_get_data(vector->data[index]);
+    return string_get_data(vector->strings.data[index]);
 }
 
 String* vector_get_string_at(const Vector* const vector, size_t index)
 {
-    if (index >= vector->size)
+    if (index >= vector->strings.size)
     {
         return NULL;
     }
 
-    return vector->data[index];
+    return vector->strings.data[index];
+}
+
+size_t vector_get_length_at(const Vector* const vector, size_t index)
+{
+    return index < vector->strings.size ? vector->lengths.data[index] : 0;
+}
+
+bool vector_is_used_at(const Vector* const vector, size_t index)
+{
+    return index < vector->strings.size && vector_is_bit_set(vector, index);
 }
 
 void vector_set_at(Vector *vector, size_t index, String* const string)
 {
-    if (index >= vector->size)
+    if (index >= vector->strings.size)
     {
         return;
     }
 
-    string_destroy(vector->data[index]);
-    vector->data[index] = string;
+    if (string_get_id(string) == NO_POEM_ID)
+    {
+        string_set_id(string, string_get_id(vector->strings.data[index]));
+    }
+
+    string_set_shard(string, string_get_shard(vector->strings.data[index]));
+
+    vector->used_count -= vector_is_bit_set(vector, index) ? 1 : 0;
+    vector->used_count += string_get_is_used(string) ? 1 : 0;
+    vector_unregister(vector, vector->strings.data[index]);
+    string_destroy(vector->strings.data[index]);
+    vector_register(vector, string);
+    vector_set_slot(vector, index, string);
 }
 
-/*
-  Note: I'm absolutely sure there's a far more efficient algorithm
-  that does not require to deep-copy or needlessly allocate memory
-  on the heap. The primary reason of choosing this solution was that
-  it proved to be the most memory-safe and avoided memory leaks.
-*/
 void vector_remove_at(Vector* vector, size_t index)
 {
-    if (index >= vector->size)
+    vector_remove_range(vector, index, 1);
+}
+
+void vector_remove_range(Vector* vector, size_t index, size_t count)
+{
+    if (count == 0 || index >= vector->strings.size || count > vector->strings.size - index)
     {
         return;
     }
 
-    // if the removal does not cause the vector to become empty
-    if (vector->size - 1 != 0)
+    for (size_t i = index; i < index + count; i++)
     {
-        bool str_is_used = string_get_is_used(vector->data[index]);
-        size_t vec_used_count = vector->used_count;
-        String** string_arr = ALLOCATE_ARRAY(String*, vector->size - 1);
-        size_t arr_index = 0;
+        vector->used_count -= vector_is_bit_set(vector, i) ? 1 : 0;
+        vector_unregister(vector, vector->strings.data[i]);
+        string_destroy(vector->strings.data[i]);
+    }
 
-        // deep-copying strings that are supposed to be preserved
-        for (size_t i = 0; i < vector->size; i++)
-        {
-            if (i != index)
-            {
-                string_arr[arr_index] = string_construct(string_get_data(vector->data[i]));
-                string_set_is_used(string_arr[arr_index], string_get_is_used(vector->data[i]));
-                arr_index++;
-            }
-        }
+    vector_close_gap(vector, index, count);
+}
 
-        // deallocating original array
-        for (size_t i = 0; i < vector->size; i++)
-        {
-            string_destroy(vector->data[i]);
-        }
+void vector_insert_range(Vector* vector, size_t index, String* const* strings, size_t count)
+{
+    if (index > vector->strings.size)
+    {
+        return;
+    }
+
+    if (!vector_grow(vector, vector->strings.size + count))
+    {
+        return;
+    }
+
+    vector_invalidate_slots(vector, index);
+    vector_shift_bits(vector, index, count, vector->strings.size + count, false);
+    ARRAY_INSERT(string_array, &vector->strings, index, strings, count);
+    ARRAY_INSERT(length_array, &vector->lengths, index, NULL, count);
 
-        free(vector->data);
-        vector->data = string_arr;
-        vector->size = arr_index;
-        vector->capacity = arr_index;
-        vector->used_count = (size_t)(str_is_used ? vec_used_count - 1 : vec_used_count);
+    for (size_t i = 0; i < count; i++)
+    {
+        vector_register(vector, strings[i]);
+        vector_set_slot(vector, index + i, strings[i]);
+        vector->used_count += string_get_is_used(strings[i]) ? 1 : 0;
     }
-    else // avoiding calloc()-ing memory of 0 bytes
+}
+
+void vector_detach_range(Vector* vector, size_t index, size_t count, String** destination)
+{
+    if (count == 0 || index >= vector->strings.size || count > vector->strings.size - index)
     {
-        for (size_t i = 0; i < vector->size; i++)
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        destination[i] = vector->strings.data[index + i];
+        vector->used_count -= vector_is_bit_set(vector, index + i) ? 1 : 0;
+        vector_unregister(vector, destination[i]);
+    }
+
+    vector_close_gap(vector, index, count);
+}
+
+String* vector_replace_at(Vector* vector, size_t index, String* const string)
+{
+    if (index >= vector->strings.size)
+    {
+        return NULL;
+    }
+
+    String* previous = vector->strings.data[index];
+    vector->used_count -= vector_is_bit_set(vector, index) ? 1 : 0;
+    vector->used_count += string_get_is_used(string) ? 1 : 0;
+
+    // an edited poem is still the same poem, in the same shard
+    if (string_get_id(string) == NO_POEM_ID)
+    {
+        string_set_id(string, string_get_id(previous));
+    }
+
+    string_set_shard(string, string_get_shard(previous));
+
+    vector_unregister(vector, previous);
+    vector_register(vector, string);
+    vector_set_slot(vector, index, string);
+    return previous;
+}
+
+void vector_permute(Vector* vector, String** order)
+{
+    for (size_t i = 0; i < vector->strings.size; i++)
+    {
+        String* previous = vector->strings.data[i];
+
+        if (previous != order[i])
         {
-            string_destroy(vector->data[i]);
+            vector->shard_versions[string_get_shard(order[i])]++;
+            vector_set_slot(vector, i, order[i]);
         }
 
-        free(vector->data);
-        vector->data = ALLOCATE_ARRAY(String*, 1);
-        vector->size = 0;
-        vector->capacity = 1;
+        order[i] = previous;
     }
 }
 
 void vector_set_used(Vector* vector, size_t index)
 {
-    if (!string_get_is_used(vector->data[index]))
+    if (!vector_is_bit_set(vector, index))
     {
-        string_set_is_used(vector->data[index], true);
+        string_set_is_used(vector->strings.data[index], true);
+        vector_set_bit(vector, index, true);
         vector->used_count++;
     }
-}
\ No newline at end of file
+}
+
+String* vector_get_string_by_id(const Vector* const vector, PoemId id)
+{
+    return id < vector->by_id.size ? vector->by_id.data[id] : NULL;
+}
+
+bool vector_set_used_by_id(Vector* vector, PoemId id)
+{
+    String* string = vector_get_string_by_id(vector, id);
+
+    if (string == NULL)
+    {
+        return false;
+    }
+
+    size_t index = vector_find_slot(vector, string);
+
+    if (index < vector->strings.size)
+    {
+        vector_set_used(vector, index);
+    }
+
+    return true;
+}
@@ -2,12 +2,37 @@
 #define Application_H
 
 #include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "Vector.h"
+#include "History.h"
+#include "SprinkleEngine.h"
+#include "Selection.h"
+#include "Reload.h"
+#include "SymbolTable.h"
+#include "SpillFile.h"
 
 #define FILENAME "./src/file/poems.txt"
+/* Last use and score of each poem, one line per poem of 'FILENAME' (see 'Selection.h'). */
+#define METADATA_FILENAME "./src/file/poems.meta"
+/* Extension of the shard files of a directory (see '--shards'). */
+#define SHARD_EXTENSION ".txt"
+/* Extension of the metadata file of a shard, which replaces 'SHARD_EXTENSION' in the name of the shard file. */
+#define METADATA_EXTENSION ".meta"
+#define SHARD_PATH_MAX_LENGTH 1024
 #define MAX_NUMBER_OF_CHILDREN 4
 #define PROGRAM_NAME_MAX_LENGTH 1024
+/* Size of the 'stdout' buffer in batch mode. Output is only flushed when it fills up or at exit. */
+#define BATCH_OUTPUT_BUFFER_SIZE (1 << 20)
+/* Number of poems kept decompressed between commands with '--compress' (see 'string_trim_hot'). */
+#define COMPRESSION_HOT_POEMS 4096
+/* Directory of the spill file with '--memory-budget', unless 'TMPDIR' is set. */
+#define SPILL_DIRECTORY "/tmp"
+/* How long 's' waits for its save before it returns to the prompt and leaves the save to the background. */
+#define SAVE_FOREGROUND_MILLISECONDS 100
+/* Separator of multiple commands in a single line. */
+#define COMMAND_SEPARATOR ';'
 
 typedef enum Command {
     NO_COMMAND,
@@ -19,29 +44,204 @@ typedef enum Command {
     QUIT,
     EDIT,
     REMOVE,
+    UNDO,
+    REDO,
+    STATS,
+    SCORE,
+    SORT,
+    UNIQ,
+    SHARDS,
     ERROR
 } Command;
 
+/* Number of values in 'Command'. */
+#define NUMBER_OF_COMMANDS (ERROR + 1)
+
 typedef unsigned long Argument;
 #define NO_ARGUMENTS (Argument)0
 
+/* Maximum number of arguments a single command may take. */
+#define MAX_ARGUMENTS 16
+/* Number of tokens of a command (name + arguments) held without allocating; longer lines are rejected by the arity checks. */
+#define MAX_TOKENS (MAX_ARGUMENTS + 1)
+
+/*
+  A non-owning slice of the input line.
+  Tokens point into the line they were tokenised from; they are NOT null-terminated.
+*/
+typedef struct Token {
+    const char* data;
+    size_t length;
+} Token;
+
+/*
+  Closed range of indices [first..last]. A single index is stored as [index..index].
+  Given as 'shard:index' (or 'shard:from-to'), the indices are relative to the shard, numbered from 1;
+  such ranges are converted to indices of the whole database before the command is executed.
+*/
+typedef struct ArgumentRange {
+    Argument first;
+    Argument last;
+    // 0 if the indices are not relative to a shard
+    Argument shard;
+} ArgumentRange;
+
+/*
+  A decoded command. Arguments that match a keyword of the command (see 'CommandDescriptor') are stored
+  in 'keywords' as the index of the keyword, in the order they were given; every other argument is a range.
+*/
 typedef struct ApplicationCommand {
     Command command;
-    Argument argument;
+    size_t argument_count;
+    ArgumentRange arguments[MAX_ARGUMENTS];
+    size_t keyword_count;
+    size_t keywords[MAX_ARGUMENTS];
 } ApplicationCommand;
 
+/* Accumulated execution time of a particular command. */
+typedef struct CommandTiming {
+    size_t count;
+    unsigned long long total_nanoseconds;
+} CommandTiming;
+
+/*
+  A sprinkle round that has been started but not collected yet.
+  The round holds a reference to both poems, so they survive edits and removals while it is in flight;
+  the used-mark is applied to the poem's identifier when the round is collected.
+*/
+typedef struct SprinkleRound {
+    bool is_active;
+    pid_t child;
+    int msqueue_id;
+    String* poems[2];
+    unsigned long long start;
+} SprinkleRound;
+
+/*
+  A collection of poems stored in its own file, loaded into the range of its shard in the vector (see 'Vector.h').
+  A shard is only written back when its poems (or their metadata) have changed since it was loaded or saved.
+*/
+typedef struct Shard {
+    char path[SHARD_PATH_MAX_LENGTH];
+    char metadata_path[SHARD_PATH_MAX_LENGTH];
+    // 'vector_get_shard_version' when the shard was loaded or saved last
+    size_t saved_version;
+    // the file was found corrupt when loaded, so it must not become the previous generation (see 'storage_save')
+    bool is_corrupt;
+} Shard;
+
+/*
+  A shard written by a background save. The poems and their metadata are taken when the save starts, so the
+  database can be edited while the files are written; each poem is held by a reference of the job.
+*/
+typedef struct SaveJob {
+    size_t number;
+    const char* path;
+    const char* metadata_path;
+    // whether the poems are written (not only their metadata), and 'vector_get_shard_version' when the save started
+    bool is_changed;
+    size_t version;
+    // whether the previous generation is kept as it is ('Shard.is_corrupt')
+    bool is_previous_kept;
+    String** poems;
+    size_t count;
+    unsigned long long* last_used;
+    unsigned* scores;
+    // the base of the reloader, computed by the save thread ('NULL' without a reloader)
+    PoemId* ids;
+    unsigned long long* hashes;
+    bool is_hashed;
+    bool is_saved;
+    bool is_metadata_saved;
+    // 'errno' of a failed save
+    int error;
+} SaveJob;
+
+/* The save in flight (see 'application_start_save'). Its thread only touches the jobs. */
+typedef struct BackgroundSave {
+    bool is_running;
+    atomic_bool is_done;
+    pthread_t thread;
+    SaveJob jobs[MAX_SHARDS];
+    size_t job_count;
+    // 'history_get_state' when the save started
+    unsigned long history_state;
+} BackgroundSave;
+
 /* Type definition of 'Application'. */
 typedef struct Application {
-    FILE *file;
+    FILE *input;
     Vector *vector;
+    History *history;
+    Selector *selector;
+    // 'NULL' if the shard files cannot be watched
+    Reloader *reloader;
+    // 'NULL' unless the poems are compressed
+    SymbolTable *symbol_table;
+    // 'NULL' unless the poems are held to a memory budget
+    SpillFile *spill_file;
+    size_t memory_budget;
+    BackgroundSave save;
+    Shard shards[MAX_SHARDS];
+    size_t shard_count;
     bool quit_state;
     bool is_edited;
+    bool is_interactive;
+    bool save_requested;
+    bool is_quiet;
+    char* output_buffer;
+    const char* statistics_path;
+    const char* trace_path;
+    SprinkleEngine* sprinkle_engine;
+    SprinkleRound rounds[MAX_NUMBER_OF_CHILDREN];
+    size_t active_rounds;
+    CommandTiming timings[NUMBER_OF_COMMANDS];
     ApplicationCommand command_to_execute;
     char program_name[PROGRAM_NAME_MAX_LENGTH];
 } Application;
 
-/* Initialises the 'Application' object. */
-void application_initialise(Application* const application, const char* const name);
+/* Signature of the function executing a particular command. */
+typedef void (*CommandHandler)(Application* application, const ApplicationCommand* const command);
+
+/*
+  Entry of the command table: name, accepted number of arguments (ranges and keywords together),
+  the function to call and the keywords accepted as arguments ('NULL'-terminated, or 'NULL' if none).
+*/
+typedef struct CommandDescriptor {
+    const char* name;
+    Command command;
+    size_t min_arity;
+    size_t max_arity;
+    CommandHandler handler;
+    const char* const* keywords;
+} CommandDescriptor;
+
+/*
+  Initialises the 'Application' object based on the command line arguments.
+  Usage: bunny [--quiet] [--history bytes] [--stats-json path] [--trace path] [--engine process|thread]
+                [--policy uniform|lru|weighted] [--shards directory] [--compress]
+                [--memory-budget bytes] [--io uring|blocking] [--batch [script]]
+  With '--quiet', the database is not listed at startup.
+  '--history' sets the memory budget of the undo/redo history (0 disables it).
+  With '--stats-json', the runtime statistics are written to 'path' as JSON on exit.
+  With '--trace', the phases of each sprinkle round are traced and written to 'path' in Chrome's trace-event format on exit.
+  '--engine' selects whether the bunnies of a sprinkle round are forked processes (default) or threads.
+  '--policy' selects how the poems of a sprinkle round are drawn (see 'Selection.h').
+  With '--shards', every '*.txt' file of 'directory' is a shard of the database (in the order of the file names)
+  instead of 'FILENAME'; the shards are loaded in parallel, one thread per shard.
+  With '--compress', the poems are compressed in memory with a symbol table trained on them at startup
+  (see 'SymbolTable.h'); a poem is decompressed when it is accessed, and the 'COMPRESSION_HOT_POEMS'
+  most recently accessed ones stay decompressed.
+  With '--memory-budget', the bodies of the poems take at most about 'bytes' of memory between commands: the least
+  recently accessed ones are moved to a spill file in 'SPILL_DIRECTORY' (compressed with '--compress') and read back
+  when accessed. Only the per-poem headers (index, length, identifier, used flag) stay in memory for good.
+  '--io' selects how the database files are read and written (see 'StorageBackend'): through io_uring
+  (the default, with blocking calls where it is not available) or with blocking calls only.
+  In batch mode, commands are read from 'script' (or 'stdin' if omitted or "-") without any prompts,
+  the output is fully buffered and saving is deferred to a single save at the end of the run.
+  Batch mode is also selected when 'stdin' is not a terminal (e.g. it is piped).
+*/
+void application_initialise(Application* const application, int argc, char** argv);
 
 /*
   Runs (executes) the application. 
@@ -50,4 +250,17 @@ void application_initialise(Application* const application, const char* const na
 */
 int application_run(Application* application);
 
+/*
+  Writes each shard of the database that was edited to its file and waits for it. If none was, it does nothing.
+  Each file is replaced atomically and keeps its previous generation (see 'Storage.h'); a corrupt file
+  is replaced by its previous generation when the database is loaded.
+*/
+void application_save(Application* const application);
+
+/*
+  Releases every resource held by the application. Called by 'application_run' before returning.
+  Returns 0 if the resources were released successfully. Otherwise, a non-zero value is returned.
+*/
+int application_destroy(Application* const application);
+
 #endif // Application_H
\ No newline at end of file
@@ -0,0 +1,220 @@
+#ifndef Array_H
+#define Array_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "MemoryAllocation.h"
+
+/*
+  Type-specialised dynamic arrays, generated for each element type (a C analogue of a class template).
+  'DEFINE_ARRAY(Name, prefix, TYPE, GROWTH)' defines the type 'Name', holding elements of 'TYPE' by value,
+  and the functions 'prefix_initialise', 'prefix_push', etc. below. 'DEFINE_SMALL_ARRAY' adds room for
+  'INLINE_CAPACITY' elements inside the object itself, so an array that never grows beyond it never allocates;
+  such an array must not be copied (by value) while it uses that room.
+  - The elements are accessed directly through 'data', at the indices [0..size).
+  - When the array is full, its capacity is multiplied by 'GROWTH' percent (200 doubles it), but it is at least
+    'ARRAY_MIN_CAPACITY' on the heap.
+  - Elements past 'size' are undefined, unless written by 'prefix_resize'.
+  The functions that allocate return false upon failure, leaving the array unchanged. They are called through the
+  'ARRAY_' macros below, which pass the call site on, so memory accounting reports the caller instead of this file.
+*/
+
+/* Smallest capacity of an array on the heap. */
+#define ARRAY_MIN_CAPACITY 16
+/* Growth factor (in percent) of most arrays. */
+#define ARRAY_DEFAULT_GROWTH 200
+
+#define ARRAY_RESERVE(prefix, array, capacity) prefix##_reserve((array), (capacity), __FILE__, __LINE__)
+#define ARRAY_GROW(prefix, array, size) prefix##_grow((array), (size), __FILE__, __LINE__)
+#define ARRAY_SHRINK_TO_FIT(prefix, array) prefix##_shrink_to_fit((array), __FILE__, __LINE__)
+#define ARRAY_PUSH(prefix, array, value) prefix##_push((array), (value), __FILE__, __LINE__)
+#define ARRAY_INSERT(prefix, array, index, values, count) prefix##_insert((array), (index), (values), (count), __FILE__, __LINE__)
+#define ARRAY_RESIZE(prefix, array, size) prefix##_resize((array), (size), __FILE__, __LINE__)
+
+#define DEFINE_ARRAY(Name, prefix, TYPE, GROWTH) \
+    typedef struct Name { \
+        TYPE* data; \
+        size_t size; \
+        size_t capacity; \
+    } Name; \
+    ARRAY_DEFINE_FUNCTIONS(Name, prefix, TYPE, 0, GROWTH, NULL)
+
+#define DEFINE_SMALL_ARRAY(Name, prefix, TYPE, INLINE_CAPACITY, GROWTH) \
+    typedef struct Name { \
+        TYPE* data; \
+        size_t size; \
+        size_t capacity; \
+        TYPE inline_data[INLINE_CAPACITY]; \
+    } Name; \
+    ARRAY_DEFINE_FUNCTIONS(Name, prefix, TYPE, INLINE_CAPACITY, GROWTH, array->inline_data)
+
+/* The functions shared by both kinds of arrays. 'INLINE_DATA' is the inline room of 'array' ('NULL' if none). */
+#define ARRAY_DEFINE_FUNCTIONS(Name, prefix, TYPE, INLINE_CAPACITY, GROWTH, INLINE_DATA) \
+    /* Makes the array empty, without allocating. */ \
+    static inline void prefix##_initialise(Name* array) \
+    { \
+        array->data = INLINE_DATA; \
+        array->size = 0; \
+        array->capacity = (INLINE_CAPACITY); \
+    } \
+    \
+    /* Releases the memory of the array, which is left empty. */ \
+    static inline void prefix##_release(Name* array) \
+    { \
+        if (array->data != INLINE_DATA) \
+        { \
+            DEALLOCATE(array->data); \
+        } \
+        \
+        prefix##_initialise(array); \
+    } \
+    \
+    /* \
+      Moves the elements to storage for exactly 'capacity' elements (at least the size), inline if they fit. \
+      The allocation is accounted to 'file':'line', like that of each function below taking them. \
+    */ \
+    static inline bool prefix##_reallocate(Name* array, size_t capacity, const char* file, int line) \
+    { \
+        TYPE* inline_data = INLINE_DATA; \
+        TYPE* data = NULL; \
+        \
+        if (inline_data != NULL && capacity <= (INLINE_CAPACITY)) \
+        { \
+            if (array->data != inline_data) \
+            { \
+                memcpy(inline_data, array->data, array->size * sizeof(TYPE)); \
+                DEALLOCATE(array->data); \
+                array->data = inline_data; \
+                array->capacity = (INLINE_CAPACITY); \
+            } \
+            \
+            return true; \
+        } \
+        \
+        if (array->data == inline_data) \
+        { \
+            data = ALLOCATE_ARRAY_AT(TYPE, capacity, file, line); \
+            \
+            if (data != NULL && array->size > 0) \
+            { \
+                memcpy(data, array->data, array->size * sizeof(TYPE)); \
+            } \
+        } \
+        else \
+        { \
+            data = RESIZE_ARRAY_AT(array->data, capacity, TYPE, file, line); \
+        } \
+        \
+        if (data == NULL) \
+        { \
+            return false; \
+        } \
+        \
+        array->data = data; \
+        array->capacity = capacity; \
+        return true; \
+    } \
+    \
+    /* Makes room for at least 'capacity' elements, exactly that many if it has to allocate. */ \
+    static inline bool prefix##_reserve(Name* array, size_t capacity, const char* file, int line) \
+    { \
+        return capacity <= array->capacity || prefix##_reallocate(array, capacity, file, line); \
+    } \
+    \
+    /* Makes room for at least 'size' elements, growing the capacity by 'GROWTH' percent at least. */ \
+    static inline bool prefix##_grow(Name* array, size_t size, const char* file, int line) \
+    { \
+        if (size <= array->capacity) \
+        { \
+            return true; \
+        } \
+        \
+        size_t capacity = array->capacity * (GROWTH) / 100; \
+        capacity = capacity > size ? capacity : size; \
+        return prefix##_reallocate(array, capacity > ARRAY_MIN_CAPACITY ? capacity : ARRAY_MIN_CAPACITY, file, line); \
+    } \
+    \
+    /* Releases the capacity beyond the size (moving the elements back inline if they fit). */ \
+    static inline bool prefix##_shrink_to_fit(Name* array, const char* file, int line) \
+    { \
+        if (array->size == 0 && array->data != INLINE_DATA) \
+        { \
+            prefix##_release(array); \
+            return true; \
+        } \
+        \
+        return array->size == array->capacity || prefix##_reallocate(array, array->size, file, line); \
+    } \
+    \
+    /* Appends 'value' to the end of the array. */ \
+    static inline bool prefix##_push(Name* array, TYPE value, const char* file, int line) \
+    { \
+        if (!prefix##_grow(array, array->size + 1, file, line)) \
+        { \
+            return false; \
+        } \
+        \
+        array->data[array->size++] = value; \
+        return true; \
+    } \
+    \
+    /* \
+      Inserts 'count' elements before 'index' (at most the size), shifting the following ones. \
+      The elements are copied from 'values', or left undefined if it is 'NULL'. \
+    */ \
+    static inline bool prefix##_insert(Name* array, size_t index, TYPE const* values, size_t count, const char* file, int line) \
+    { \
+        if (count == 0) \
+        { \
+            return true; \
+        } \
+        \
+        if (!prefix##_grow(array, array->size + count, file, line)) \
+        { \
+            return false; \
+        } \
+        \
+        memmove(array->data + index + count, array->data + index, (array->size - index) * sizeof(TYPE)); \
+        \
+        if (values != NULL) \
+        { \
+            memcpy(array->data + index, values, count * sizeof(TYPE)); \
+        } \
+        \
+        array->size += count; \
+        return true; \
+    } \
+    \
+    /* Removes the 'count' elements starting at 'index' (the range must be within the array), shifting the following ones. */ \
+    static inline void prefix##_erase(Name* array, size_t index, size_t count) \
+    { \
+        memmove(array->data + index, array->data + index + count, (array->size - index - count) * sizeof(TYPE)); \
+        array->size -= count; \
+    } \
+    \
+    /* Sets the size of the array. New elements are zeroed. */ \
+    static inline bool prefix##_resize(Name* array, size_t size, const char* file, int line) \
+    { \
+        if (!prefix##_grow(array, size, file, line)) \
+        { \
+            return false; \
+        } \
+        \
+        if (size > array->size) \
+        { \
+            memset(array->data + array->size, 0, (size - array->size) * sizeof(TYPE)); \
+        } \
+        \
+        array->size = size; \
+        return true; \
+    } \
+    \
+    /* Removes every element, keeping the capacity. */ \
+    static inline void prefix##_clear(Name* array) \
+    { \
+        array->size = 0; \
+    }
+
+#endif // Array_H
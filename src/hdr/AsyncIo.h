@@ -0,0 +1,53 @@
+#ifndef AsyncIo_H
+#define AsyncIo_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+  Asynchronous reads and writes of files at explicit offsets, on io_uring (driven through the raw system calls).
+  Up to 'depth' requests are in flight at a time; each carries a tag that is returned with its completion.
+  Requests are queued until 'async_io_submit' or 'async_io_wait', so consecutive ones are submitted in a single call.
+  A short transfer is continued until the request is complete or the end of the file is reached.
+  Without io_uring (an old kernel, or one where it is disabled), every request is carried out right away
+  with a blocking 'pread' or 'pwrite', and its completion is returned by the next 'async_io_wait'.
+  An 'AsyncIo' object must only be used by one thread at a time.
+*/
+
+/* Opaque type definition of 'AsyncIo'. */
+typedef struct AsyncIo AsyncIo;
+
+/*
+  Constructor of an 'AsyncIo' object with room for 'depth' requests in flight. With 'is_ring_allowed' false,
+  io_uring is not even tried (the blocking fallback is used). Returns 'NULL' upon failure.
+*/
+AsyncIo* async_io_construct(size_t depth, bool is_ring_allowed);
+
+/* Destructor of an 'AsyncIo' object. Every request must have completed. Accepts NULL. */
+void async_io_destroy(AsyncIo* io);
+
+/* Returns whether the requests go through io_uring (rather than the blocking fallback). */
+bool async_io_is_ring(const AsyncIo* const io);
+
+/*
+  Queues a read of 'size' bytes of 'file' at 'offset' to 'buffer', which must stay valid until it completes.
+  Returns false if 'depth' requests are in flight already.
+*/
+bool async_io_read(AsyncIo* io, int file, void* buffer, size_t size, unsigned long long offset, size_t tag);
+
+/* Queues a write of 'size' bytes of 'buffer' to 'file' at 'offset', like 'async_io_read'. */
+bool async_io_write(AsyncIo* io, int file, const void* buffer, size_t size, unsigned long long offset, size_t tag);
+
+/* Submits the queued requests without waiting for them. */
+void async_io_submit(AsyncIo* io);
+
+/*
+  Submits the queued requests and waits for one to complete. Writes its tag and the number of bytes transferred
+  (less than requested only at the end of the file) or '-errno' to 'result'. Returns false if none is in flight.
+*/
+bool async_io_wait(AsyncIo* io, size_t* tag, long long* result);
+
+/* Returns the number of requests in flight. */
+size_t async_io_get_pending(const AsyncIo* const io);
+
+#endif // AsyncIo_H
@@ -0,0 +1,86 @@
+#ifndef History_H
+#define History_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "String.h"
+#include "Vector.h"
+
+/* Default upper limit of the memory held by the undo/redo history (in bytes). */
+#define DEFAULT_HISTORY_BUDGET (16 * 1024 * 1024)
+
+/*
+  Opaque type definition of 'History'.
+  The history stores deltas (index + detached 'String' pointers) instead of copies of the database.
+  Deltas are grouped into steps; a step is the unit of undo and redo (usually one command).
+*/
+typedef struct History History;
+
+/*
+  Constructor of a 'History' object. Returns 'NULL' upon failure.
+  When the strings held by the history exceed 'memory_budget', the oldest steps are discarded.
+  A budget of 0 disables the history altogether.
+*/
+History* history_construct(size_t memory_budget);
+
+/* Destructor of a 'History' object. Destroys every string owned by the history. */
+void history_destroy(History* history);
+
+/* Starts a new step. Clears the redo history, since it can no longer be applied. */
+void history_begin_step(History* history);
+
+/*
+  Records that a string was inserted at the specified index. The string is owned by the vector.
+  Returns false if there was not enough memory, in which case the caller should revert the insertion.
+*/
+bool history_record_insert(History* history, size_t index);
+
+/*
+  Records that the string at the specified index was replaced. The history takes ownership of 'old_string',
+  unless it returns false (not enough memory), in which case the caller should put it back.
+*/
+bool history_record_edit(History* history, size_t index, String* old_string);
+
+/*
+  Records that 'count' strings were removed starting at the specified index.
+  The history takes ownership of both the 'strings' array (allocated by 'ALLOCATE_ARRAY') and its elements.
+  If the change cannot be recorded (not enough memory), the whole history is forgotten, since the older steps
+  no longer apply to the vector; the same holds for 'history_record_reorder'.
+*/
+void history_record_remove(History* history, size_t index, String** strings, size_t count);
+
+/*
+  Records that the strings of the vector were rearranged (see 'vector_permute'). 'order' holds the previous order
+  of every string of the vector. The history takes ownership of the array (allocated by 'ALLOCATE_ARRAY'), but not of the strings.
+*/
+void history_record_reorder(History* history, String** order, size_t count);
+
+/* Reverts at most 'steps' steps on the vector. Returns the number of steps reverted. */
+size_t history_undo(History* history, Vector* vector, size_t steps);
+
+/* Re-applies at most 'steps' reverted steps on the vector. Returns the number of steps re-applied. */
+size_t history_redo(History* history, Vector* vector, size_t steps);
+
+/* Marks the current state as the one that matches the saved file. */
+void history_mark_saved(History* history);
+
+/* Returns an identifier of the current state, e.g. for 'history_mark_saved_state' once a save started now is done. */
+unsigned long history_get_state(const History* const history);
+
+/* Marks the state identified by 'state' (see 'history_get_state') as the one that matches the saved file. */
+void history_mark_saved_state(History* history, unsigned long state);
+
+/* Returns whether the current state matches the saved file. */
+bool history_is_at_saved(const History* const history);
+
+/* Returns the number of steps that can be undone. */
+size_t history_get_undo_count(const History* const history);
+
+/* Returns the number of steps that can be redone. */
+size_t history_get_redo_count(const History* const history);
+
+/* Returns the number of bytes held by the history. */
+size_t history_get_memory_usage(const History* const history);
+
+#endif // History_H
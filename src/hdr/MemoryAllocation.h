@@ -1,10 +1,60 @@
 #ifndef MemoryAllocation_H
 #define MemoryAllocation_H
 
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Statistics.h"
+
 #define DEFAULT_BUFFER_SIZE 32
+#define OUTPUT_BUFFER_SIZE (1 << 18)
+
+/*
+  If 'MEMORY_ACCOUNTING' is defined as 1 (make MEMORY_ACCOUNTING=1), each allocation made via the macros below
+  is tracked: live and peak bytes, and the number of allocations per call site. Leaks are reported at exit.
+  Memory obtained via these macros must be released via 'DEALLOCATE'.
+  The accounting is serialised by a mutex, so memory may be allocated and released from any thread.
+  The '_AT' variants account the allocation to the given 'file' and 'line' instead, for helpers that allocate
+  on behalf of their caller (see Array.h).
+*/
+#ifndef MEMORY_ACCOUNTING
+#define MEMORY_ACCOUNTING 0
+#endif
+
+#if MEMORY_ACCOUNTING
+#define ALLOCATE(TYPE) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)memory_allocate(1, sizeof(TYPE), __FILE__, __LINE__))
+#define ALLOCATE_ARRAY(TYPE, size) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)memory_allocate((size), sizeof(TYPE), __FILE__, __LINE__))
+#define DOUBLE_ARRAY(array, capacity, TYPE) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)memory_reallocate((array), (capacity) * (2) * sizeof(TYPE), __FILE__, __LINE__))
+#define RESIZE_ARRAY(array, capacity, TYPE) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)memory_reallocate((array), (capacity) * sizeof(TYPE), __FILE__, __LINE__))
+#define ALLOCATE_ARRAY_AT(TYPE, size, file, line) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)memory_allocate((size), sizeof(TYPE), (file), (line)))
+#define RESIZE_ARRAY_AT(array, capacity, TYPE, file, line) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)memory_reallocate((array), (capacity) * sizeof(TYPE), (file), (line)))
+#define DEALLOCATE(pointer) memory_deallocate(pointer)
+#else
+#define ALLOCATE(TYPE) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)calloc(1, sizeof(TYPE)))
+#define ALLOCATE_ARRAY(TYPE, size) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)calloc(size, sizeof(TYPE)))
+#define DOUBLE_ARRAY(array, capacity, TYPE) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)realloc((array), (capacity) * (2) * sizeof(TYPE)))
+#define RESIZE_ARRAY(array, capacity, TYPE) (STATISTICS_COUNT_ALLOCATION(), (TYPE *)realloc((array), (capacity) * sizeof(TYPE)))
+#define ALLOCATE_ARRAY_AT(TYPE, size, file, line) ((void)(file), (void)(line), ALLOCATE_ARRAY(TYPE, size))
+#define RESIZE_ARRAY_AT(array, capacity, TYPE, file, line) ((void)(file), (void)(line), RESIZE_ARRAY(array, capacity, TYPE))
+#define DEALLOCATE(pointer) free(pointer)
+#endif
+
+/* Zero-initialised allocation of 'count' elements of 'size' bytes, accounted to 'file':'line'. */
+void* memory_allocate(size_t count, size_t size, const char* file, int line);
+
+/* Resizes an allocation made by 'memory_allocate'. A 'NULL' pointer results in a new allocation. */
+void* memory_reallocate(void* pointer, size_t size, const char* file, int line);
+
+/* Releases an allocation made by 'memory_allocate' or 'memory_reallocate'. */
+void memory_deallocate(void* pointer);
+
+/* Returns the number of bytes currently allocated (excluding the bookkeeping headers). */
+size_t memory_get_live_bytes(void);
+
+/* Returns the highest number of bytes that were allocated at the same time. */
+size_t memory_get_peak_bytes(void);
 
-#define ALLOCATE(TYPE) (TYPE *)calloc(1, sizeof(TYPE))
-#define ALLOCATE_ARRAY(TYPE, size) (TYPE *)calloc(size, sizeof(TYPE))
-#define DOUBLE_ARRAY(array, capacity, TYPE) (TYPE *)realloc((array), (capacity) * (2) * sizeof(TYPE))
+/* Prints out the totals and the allocations of each call site. Prints a notice if accounting is disabled. */
+void memory_print_report(FILE* output);
 
 #endif // MemoryAllocation_H
\ No newline at end of file
@@ -18,6 +18,8 @@
 /* Structure for POSIX message queue. */
 typedef struct MessageQueue {
     long mtype;
+    // index (0 or 1) of the poem in 'mtext' among the poems sent to the child
+    long choice;
     char mtext[MSQUEUE_BUFFER];
 } MessageQueue;
 
@@ -0,0 +1,76 @@
+#ifndef Reload_H
+#define Reload_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Vector.h"
+#include "History.h"
+
+/*
+  Live reload of the shard files when they are changed by other programs.
+  The directory of each shard file is watched with inotify; the events are read without blocking
+  (one 'read' per poll when nothing has happened), so the watch can stay on permanently.
+  For each shard, the reloader keeps the 'base': the identifier and a hash of each poem as the file
+  last held them (when it was loaded, saved or reloaded), and how much of the file that covers.
+  - If the file has only grown and the end of the base is unchanged, only the new tail is read,
+    and the new poems are inserted at the end of the shard.
+  - Otherwise the whole file is read and diffed line by line against the base (Myers' algorithm,
+    after trimming the common prefix and suffix); the removed lines are removed from the vector and the
+    new ones inserted after the poem preceding them, wherever local edits have moved it.
+  A line removed from the file whose poem has been edited locally since is a conflict: the local version is
+  kept (and reported), next to the version of the file, if any. The changes are recorded in the history as
+  a single step, so a reload can be undone like any other command.
+*/
+
+/* Beyond this many differing lines (after the common prefix and suffix), the rest of the file counts as replaced. */
+#define RELOAD_MAX_DIFF 256
+
+/* Summary of the changes merged by 'reloader_apply'. */
+typedef struct ReloadResult {
+    // whether only the tail of the file had to be read
+    bool is_appended;
+    size_t inserted;
+    size_t removed;
+    size_t conflicts;
+} ReloadResult;
+
+/* Opaque type definition of 'Reloader'. */
+typedef struct Reloader Reloader;
+
+/* Constructor of a 'Reloader' object. Returns 'NULL' upon failure (e.g. inotify is not available). */
+Reloader* reloader_construct(void);
+
+/* Destructor of a 'Reloader' object. Accepts NULL. */
+void reloader_destroy(Reloader* reloader);
+
+/* Starts watching 'path', the file of the shard. Returns false upon failure. */
+bool reloader_watch(Reloader* reloader, size_t shard, const char* const path);
+
+/*
+  Sets the base of the shard to the poems of the shard in 'vector', which must be what its file holds now
+  (i.e. right after it was loaded or saved). Later events of the file that do not change it are ignored.
+*/
+void reloader_set_base(Reloader* reloader, const Vector* const vector, size_t shard);
+
+/*
+  Computes the base of the 'count' poems of 'poems' into 'ids' and 'hashes' (one entry per poem) for
+  'reloader_set_base_hashes' (the hashes also key the metadata, see 'selector_read_metadata'). Only reads the poems with 'string_copy_data', so it may run on any thread.
+  Returns false upon failure.
+*/
+bool reloader_hash_poems(String* const* poems, size_t count, PoemId* ids, unsigned long long* hashes);
+
+/* Sets the base of the shard computed by 'reloader_hash_poems', like 'reloader_set_base'. */
+void reloader_set_base_hashes(Reloader* reloader, size_t shard, const PoemId* ids, const unsigned long long* hashes,
+                              size_t count);
+
+/* Reads the pending events without blocking. Returns whether the file of any shard may have changed. */
+bool reloader_poll(Reloader* reloader);
+
+/*
+  Merges the changes of the file of the shard since its base (if it has changed) into 'vector'
+  and records them in 'history'. Returns false if there was nothing to merge.
+*/
+bool reloader_apply(Reloader* reloader, Vector* vector, History* history, size_t shard, ReloadResult* result);
+
+#endif // Reload_H
@@ -0,0 +1,96 @@
+#ifndef Selection_H
+#define Selection_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "Vector.h"
+
+/*
+  Policies that select the two poems of a sprinkle round.
+  The selector keeps its own index over the poems of each shard (a pool, a min-heap or an alias table,
+  depending on the policy), which is rebuilt lazily when the shard has changed (see 'vector_get_shard_version'),
+  so an edit of one shard does not rebuild the others. Between changes, each draw is O(1) (uniform, weighted)
+  or O(log n) (LRU), plus a pass over the shards when drawing from all of them.
+  Drawn poems are reserved until they are released, so that rounds in flight never share a poem.
+  The per-poem metadata (last use and score) is indexed by 'PoemId' and can be persisted next to each shard.
+*/
+
+/* Score of a poem that has not been scored. */
+#define DEFAULT_POEM_SCORE 1
+/* Shard argument of 'selector_draw' that draws from the poems of every shard. */
+#define SELECTION_ALL_SHARDS MAX_SHARDS
+
+typedef enum SelectionPolicy {
+    // uniform over the unused poems; each chosen poem is used up (the original behaviour)
+    SELECTION_UNIFORM,
+    // the least recently chosen poems; poems are never used up
+    SELECTION_LRU,
+    // proportional to the score of each poem; poems are never used up
+    SELECTION_WEIGHTED
+} SelectionPolicy;
+
+/* Opaque type definition of 'Selector'. */
+typedef struct Selector Selector;
+
+/* Constructor of a 'Selector' object. Returns 'NULL' upon failure. */
+Selector* selector_construct(SelectionPolicy policy);
+
+/* Destructor of a 'Selector' object. */
+void selector_destroy(Selector* selector);
+
+/* Returns the policy of the selector. */
+SelectionPolicy selector_get_policy(const Selector* const selector);
+
+/*
+  Draws two different poems of the shard of 'vector' that are not reserved and reserves them.
+  With 'SELECTION_ALL_SHARDS', the poems are drawn from every shard as if they were a single one.
+  Returns false (and reserves nothing) if there are fewer than two poems to draw from.
+*/
+bool selector_draw(Selector* selector, const Vector* const vector, size_t shard, PoemId drawn[2]);
+
+/*
+  Releases a poem reserved by 'selector_draw' when its round is over.
+  If 'is_chosen' is true, the last use of the poem is set to the current time.
+*/
+void selector_release(Selector* selector, const Vector* const vector, PoemId id, bool is_chosen);
+
+/* Sets the score of a poem of 'vector'. A poem with a score of 0 is never drawn by the weighted policy. */
+void selector_set_score(Selector* selector, const Vector* const vector, PoemId id, unsigned score);
+
+/* Returns the score of a poem. */
+unsigned selector_get_score(const Selector* const selector, PoemId id);
+
+/* Returns whether the metadata of the poems of the shard has changed since it was last read or written. */
+bool selector_is_dirty(const Selector* const selector, size_t shard);
+
+/* Marks the metadata of the shard as changed, e.g. after writing a copy of it has failed. */
+void selector_mark_dirty(Selector* selector, size_t shard);
+
+/*
+  Reads the metadata of the poems of the shard of 'vector' from 'source': one line per poem, each holding
+  a hash of the poem (hexadecimal), its last use (nanoseconds since the epoch, 0 if never) and its score.
+  Each line is given to the poem of the shard with the same hash, whose hashes (in the order of the vector)
+  are 'hashes' (see 'reloader_hash_poems'); among equal poems, in the order of the file. So a file that no longer
+  matches the shard (e.g. edited by other programs since) only loses the entries of the poems that changed.
+  Lines without a hash (or without 'hashes') are matched by their position, but only if there are exactly as many
+  as poems in the shard. Returns false if the file had to be ignored that way, or could not be read.
+*/
+bool selector_read_metadata(Selector* selector, const Vector* const vector, size_t shard,
+                            const unsigned long long* hashes, FILE* source);
+
+/*
+  Copies the metadata of the poems of the shard to 'last_used' and 'scores' (one entry per poem, in the order of the vector),
+  so that it can be written by 'selector_write_metadata' later, e.g. on another thread. The metadata counts as written.
+*/
+void selector_copy_metadata(Selector* selector, const Vector* const vector, size_t shard,
+                            unsigned long long* last_used, unsigned* scores);
+
+/*
+  Writes the metadata of 'count' poems copied by 'selector_copy_metadata' to 'destination' in the format read by
+  'selector_read_metadata', with the hash of each poem from 'hashes' (without hashes if it is 'NULL').
+*/
+void selector_write_metadata(const unsigned long long* hashes, const unsigned long long* last_used, const unsigned* scores,
+                             size_t count, FILE* destination);
+
+#endif // Selection_H
@@ -0,0 +1,46 @@
+#ifndef Sort_H
+#define Sort_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "String.h"
+
+/*
+  Stable, parallel merge sort over an array of strings.
+  The strings themselves are not moved: the sort computes the order in which they should follow each other.
+  Each element is sorted as a pair of a 64-bit key prefix and its original index, so comparisons never
+  dereference the strings. Ties are broken afterwards: each group of equal prefixes is sorted again by the
+  next prefix (the next 8 bytes of the contents, or the next key), so a string is read once per level.
+  The array is split into one run per thread; the runs are sorted, then merged pairwise, each merge
+  being split between the threads as well (the split points are found by binary search, so every thread
+  writes the same number of elements). The ties of the groups starting in the run of a thread are broken
+  by that thread. Small arrays are sorted on the calling thread.
+  The worker threads never allocate memory, so that the cost of the sort is the same with memory accounting.
+*/
+
+/* Minimum number of strings per thread. Below twice this number, the sort runs on the calling thread. */
+#define SORT_MIN_RUN_LENGTH (1 << 14)
+/* Upper limit of the number of threads of a single sort. Must be a power of two. */
+#define SORT_MAX_THREADS 64
+
+typedef enum SortKey {
+    // byte-wise order of the contents (see 'string_compare')
+    SORT_ALPHABETICAL,
+    // shorter poems first
+    SORT_LENGTH,
+    // unused poems first
+    SORT_USED,
+    // the shard of each poem, in shard order (see 'string_get_shard')
+    SORT_SHARD
+} SortKey;
+
+/*
+  Writes the order of 'strings' by 'keys' to 'order': 'order[k]' is the index (in 'strings') of the k-th string.
+  At least one key must be given. Later keys only break the ties of the earlier ones;
+  strings that are equal by every key keep their original order.
+  Returns false if the memory needed by the sort could not be allocated.
+*/
+bool sort_strings(String* const* strings, size_t count, const SortKey* keys, size_t key_count, size_t* order);
+
+#endif // Sort_H
@@ -0,0 +1,37 @@
+#ifndef SpillFile_H
+#define SpillFile_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+  Backing file of the poem bodies evicted from memory (see 'string_set_spill_file').
+  The file is created in a directory and unlinked right away, so it disappears with the process.
+  Bodies are appended through a buffer of 'SPILL_FILE_BUFFER_SIZE' bytes and never overwritten: a body that is
+  read back and evicted again keeps its place. Bodies still in the buffer are read from it.
+  Every function may be called from any thread.
+*/
+
+#define SPILL_FILE_BUFFER_SIZE (1 << 20)
+/* Name of the file (see 'mkstemp'), in the directory given to 'spill_file_construct'. */
+#define SPILL_FILE_TEMPLATE "bunny-spill-XXXXXX"
+
+/* Opaque type definition of 'SpillFile'. */
+typedef struct SpillFile SpillFile;
+
+/* Constructor of a 'SpillFile' object: creates the file in 'directory'. Returns 'NULL' upon failure. */
+SpillFile* spill_file_construct(const char* const directory);
+
+/* Destructor of a 'SpillFile' object. Accepts NULL. */
+void spill_file_destroy(SpillFile* file);
+
+/* Appends 'size' bytes to the file and writes their position to 'offset'. Returns false upon failure. */
+bool spill_file_append(SpillFile* file, const void* data, size_t size, unsigned long long* offset);
+
+/* Reads 'size' bytes at 'offset' (written by 'spill_file_append') to 'destination'. Returns false upon failure. */
+bool spill_file_read(SpillFile* file, unsigned long long offset, void* destination, size_t size);
+
+/* Returns the number of bytes appended to the file so far. */
+unsigned long long spill_file_get_size(SpillFile* file);
+
+#endif // SpillFile_H
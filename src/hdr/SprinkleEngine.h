@@ -0,0 +1,52 @@
+#ifndef SprinkleEngine_H
+#define SprinkleEngine_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "PosixUtils.h"
+
+/*
+  Thread-based alternative to the process model of the sprinkle round.
+  The bunnies are long-lived threads instead of forked processes. The parent hands work to a bunny
+  through the bunny's own single-producer/single-consumer queue, while every bunny replies through
+  a single multi-producer/single-consumer queue read by the parent. Both are bounded lock-free rings;
+  a semaphore only counts the messages, so that an idle thread sleeps instead of spinning.
+  Rounds are asynchronous: the parent starts a round and collects its result later, so several bunnies
+  may be busy at the same time. The poems are copied into buffers of the bunny when the round starts
+  (truncated to 'MSQUEUE_BUFFER' bytes, like in the process model), so the parent may change or release
+  them while the bunny reads its copies.
+  The bunnies never allocate memory, so a round does not contend with the parent for the allocator.
+*/
+
+/* Number of messages that fit into a single queue. Must be a power of two, and at least the number of bunnies. */
+#define SPRINKLE_QUEUE_CAPACITY 8
+
+/* Selects how the bunnies of a sprinkle round are run. */
+typedef enum SprinkleEngineType {
+    SPRINKLE_ENGINE_PROCESS,
+    SPRINKLE_ENGINE_THREAD
+} SprinkleEngineType;
+
+typedef struct SprinkleEngine SprinkleEngine;
+
+/* Starts 'bunnies' bunny threads. Returns NULL if the engine could not be started. */
+SprinkleEngine* sprinkle_engine_construct(size_t bunnies);
+
+/*
+  Starts a round with the idle bunny 'bunny' (in the range of [0..bunnies)): waits until the bunny
+  has arrived, then hands copies of 'poems' over to it. Prints the same messages as the process model.
+*/
+void sprinkle_engine_start(SprinkleEngine* engine, size_t bunny, const char* poems[2]);
+
+/*
+  Collects a finished round. Returns false if no round has finished, unless 'wait' is true,
+  in which case it waits for the next one (there must be a round in flight).
+  'bunny' is set to the bunny of the round and 'choice' to the index (0 or 1) of the chosen poem.
+*/
+bool sprinkle_engine_collect(SprinkleEngine* engine, bool wait, size_t* bunny, int* choice);
+
+/* Stops and joins the bunny threads, then releases the engine. Accepts NULL. */
+void sprinkle_engine_destroy(SprinkleEngine* engine);
+
+#endif // SprinkleEngine_H
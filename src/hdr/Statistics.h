@@ -0,0 +1,61 @@
+#ifndef Statistics_H
+#define Statistics_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+  Runtime statistics: per-category latency histograms and global counters.
+  The hooks below compile to nothing if 'STATISTICS_ENABLED' is defined as 0 (make STATISTICS=0).
+*/
+#ifndef STATISTICS_ENABLED
+#define STATISTICS_ENABLED 1
+#endif
+
+/* Maximum number of latency categories (e.g. one per command). */
+#define STATISTICS_MAX_CATEGORIES 32
+/* Each power of two is split into 2^STATISTICS_SUB_BUCKET_BITS linear buckets (HDR-style, ~6% precision). */
+#define STATISTICS_SUB_BUCKET_BITS 4
+
+#if STATISTICS_ENABLED
+#define STATISTICS_RECORD_LATENCY(category, nanoseconds) statistics_record_latency((category), (nanoseconds))
+#define STATISTICS_COUNT_ALLOCATION() statistics_count_allocation()
+#define STATISTICS_ADD_BYTES_READ(bytes) statistics_add_bytes_read(bytes)
+#define STATISTICS_ADD_BYTES_WRITTEN(bytes) statistics_add_bytes_written(bytes)
+#define STATISTICS_COUNT_SPRINKLE() statistics_count_sprinkle()
+#else
+#define STATISTICS_RECORD_LATENCY(category, nanoseconds) ((void)(category), (void)(nanoseconds))
+#define STATISTICS_COUNT_ALLOCATION() ((void)0)
+#define STATISTICS_ADD_BYTES_READ(bytes) ((void)(bytes))
+#define STATISTICS_ADD_BYTES_WRITTEN(bytes) ((void)(bytes))
+#define STATISTICS_COUNT_SPRINKLE() ((void)0)
+#endif
+
+/* Adds a latency sample (in nanoseconds) to the histogram of the specified category. */
+void statistics_record_latency(size_t category, unsigned long long nanoseconds);
+
+/* Increments the number of allocations performed via 'MemoryAllocation.h'. */
+void statistics_count_allocation(void);
+
+/* Increments the number of bytes read from the database file. */
+void statistics_add_bytes_read(size_t bytes);
+
+/* Increments the number of bytes written to the database file. */
+void statistics_add_bytes_written(size_t bytes);
+
+/* Increments the number of completed sprinkle rounds. */
+void statistics_count_sprinkle(void);
+
+/*
+  Returns the latency (in nanoseconds) below which 'percentile' percent of the samples of the category fall.
+  Returns 0 if the category has no samples.
+*/
+unsigned long long statistics_get_percentile(size_t category, double percentile);
+
+/* Prints out a human-readable table of the statistics. 'names[i]' is the name of category 'i'. */
+void statistics_print(FILE* output, const char* const* names, size_t category_count);
+
+/* Writes the statistics as a JSON object. 'names[i]' is the name of category 'i'. */
+void statistics_write_json(FILE* output, const char* const* names, size_t category_count);
+
+#endif // Statistics_H
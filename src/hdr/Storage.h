@@ -0,0 +1,93 @@
+#ifndef Storage_H
+#define Storage_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Vector.h"
+
+/*
+  Crash-safe storage of the shard files.
+  A file is saved to '<path>.tmp' with large sequential writes, followed by a footer line holding the CRC-32
+  of every 'STORAGE_BLOCK_SIZE' bytes of the poems before it. The temporary file is fsynced, the current file is
+  kept as the previous generation ('<path>.prev', a hard link) and the temporary file is renamed over the
+  current one, so 'path' holds either the old or the new database at any point, never a partial one.
+  Loading validates the blocks while the file is read (a single pass). Lines after the footer are poems
+  appended by other programs; a file without a footer (e.g. written by hand) is loaded unchecked.
+  The reads and writes go through io_uring (see 'AsyncIo.h'), 'STORAGE_PIPELINE_DEPTH' chunks at a time at
+  offsets aligned to 'STORAGE_BUFFER_SIZE', so that the disk works while the poems are parsed or copied.
+*/
+
+/* Number of bytes covered by each checksum of the footer. */
+#define STORAGE_BLOCK_SIZE (1 << 16)
+/* Size of the buffer of the reads and writes of a file. */
+#define STORAGE_BUFFER_SIZE (1 << 20)
+/* Number of buffers in flight while a file is read (ahead of the parsing) or written (behind the copying). */
+#define STORAGE_PIPELINE_DEPTH 4
+/* Beginning of the footer line. No poem may start with it ('i' and 'e' reject such poems). */
+#define STORAGE_FOOTER_MAGIC "#~bunny-checksums "
+/* Number of places of a file that 'storage_read_sample' reads from. */
+#define STORAGE_SAMPLE_PIECES 16
+#define STORAGE_TEMPORARY_SUFFIX ".tmp"
+#define STORAGE_PREVIOUS_SUFFIX ".prev"
+
+typedef enum StorageStatus {
+    // the checksums of the footer match
+    STORAGE_VALID,
+    // there is no footer to check
+    STORAGE_UNCHECKED,
+    // a checksum (or the size) recorded in the footer does not match
+    STORAGE_CORRUPT,
+    // the file could not be read
+    STORAGE_FAILED
+} StorageStatus;
+
+/* How the files are read and written. */
+typedef enum StorageBackend {
+    // asynchronous reads and writes on io_uring, or blocking ones where it is not available
+    STORAGE_BACKEND_URING,
+    // blocking reads and writes, one chunk at a time
+    STORAGE_BACKEND_BLOCKING
+} StorageBackend;
+
+/* Selects how the files are read and written from now on ('STORAGE_BACKEND_URING' by default). */
+void storage_set_backend(StorageBackend backend);
+
+/* Returns whether the line (not necessarily '\0'-terminated) is a footer rather than a poem. */
+bool storage_is_footer(const char* const line, size_t length);
+
+/*
+  Reads the poems of 'path' into a new array written to 'poems' (which the caller must deallocate), tagged with 'shard'.
+  The file is created if it does not exist. Empty lines and the footer are skipped.
+  If the file is corrupt, the poems are still returned, so that the caller can choose between generations.
+  The poems are made cold as they are read if compression or spilling is enabled (see 'string_admit').
+*/
+StorageStatus storage_load(const char* const path, size_t shard, String*** poems, size_t* count);
+
+/*
+  Reads whole lines of 'path' from 'STORAGE_SAMPLE_PIECES' places spread evenly over the file (or the whole file
+  if it is small enough) to 'buffer', up to 'size' bytes in total, e.g. to train a symbol table on.
+  The footer is not left out (see 'storage_is_footer'). Returns the number of bytes read (0 if the file cannot be read).
+*/
+size_t storage_read_sample(const char* const path, char* buffer, size_t size);
+
+/*
+  Writes the 'count' strings of 'poems' to 'path', one per line, as described above. The strings are only read
+  with 'string_copy_data', so the save may run on another thread while they stay alive.
+  With 'is_previous_kept', the current file is replaced without becoming the previous generation, which is left
+  as it is (e.g. when the current file is known to be corrupt).
+  Returns false upon failure, in which case 'path' is left untouched and 'errno' tells the reason.
+*/
+bool storage_save(String* const* poems, size_t count, const char* const path, bool is_previous_kept);
+
+/* Opens '<path>.tmp' for writing the contents of 'path' through 'storage_commit'. Returns 'NULL' upon failure. */
+FILE* storage_open_temporary(const char* const path);
+
+/*
+  Flushes, fsyncs and closes 'file' (opened by 'storage_open_temporary'), then renames it over 'path'.
+  Returns false upon failure (removing the temporary file), in which case 'errno' tells the reason.
+*/
+bool storage_commit(FILE* file, const char* const path);
+
+#endif // Storage_H
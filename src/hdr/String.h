@@ -4,24 +4,68 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+#include "SymbolTable.h"
+#include "SpillFile.h"
+
 /* Opaque type definition of 'String'. */
 typedef struct String String;
 
+/* Stable identifier of a poem. It survives removals and edits, unlike the index. */
+typedef unsigned long PoemId;
+#define NO_POEM_ID (PoemId)0
+
 /* Constructor of a 'String' object. Returns 'NULL' upon failure. */
 String* string_construct(const char* const str);
 
-/* Destructor of a 'String' object. */
+/*
+  Destructor of a 'String' object. Releases one reference: the object is destroyed with the last one.
+  Each owner (the vector, the history or a snapshot taken by 'string_retain') calls it exactly once.
+*/
 void string_destroy(String* str);
 
+/*
+  Takes an additional reference to the string and returns it. The string stays alive
+  (and must not be modified) until the reference is released with 'string_destroy'.
+  References are not atomic: only the thread owning the database may take or release them.
+*/
+String* string_retain(String* const string);
+
+/* Returns the identifier of the poem stored in the string, or 'NO_POEM_ID' if it has none yet. */
+PoemId string_get_id(const String* const string);
+
+/* Sets the identifier of the poem stored in the string. Assigned by the 'Vector'. */
+void string_set_id(String* const string, PoemId id);
+
+/* Returns the shard (collection) the string belongs to. Strings belong to shard 0 unless set otherwise. */
+size_t string_get_shard(const String* const string);
+
+/* Sets the shard (collection) the string belongs to. */
+void string_set_shard(String* const string, size_t shard);
+
 /* Returns the length of the string. Does not include the '\0' character. */
 size_t string_get_length(const String* const string);
 
 /* Returns the size of the string, which includes the special '\0' character. */
 size_t string_get_size(const String* const string);
 
-/* Returns the string in pure C-style form. */
+/* Returns the number of bytes occupied by the string on the heap, including the object itself. */
+size_t string_get_footprint(const String* const string);
+
+/*
+  Returns the string in pure C-style form. A compressed (or spilled) string is decompressed (or read back)
+  and stays so until it is made cold again by 'string_trim_hot'. Two threads must not decompress the same string at once:
+  only the thread owning the database and the threads it waits for (e.g. those of a sort) call it.
+*/
 const char* string_get_data(const String* const string);
 
+/*
+  Copies the contents (without the '\0' character) to 'destination', which holds 'capacity' bytes (at least the length),
+  decompressing them (or reading them back) if needed, but without keeping the result. Meant for passes over every string
+  (e.g. saving). Another thread may copy a string it holds a reference to (see 'string_retain') while this one accesses it.
+  Returns the length of the string.
+*/
+size_t string_copy_data(const String* const string, char* destination, size_t capacity);
+
 /* Returns whether the string was used in the 'sprinkling' process */
 bool string_get_is_used(const String* const string);
 
@@ -43,6 +87,54 @@ bool string_are_equal_c(const String* const left, const char* const right);
 /* Modifies the string object so that each alphabetical letter is capitalised. */
 void string_transform_to_upper(String* const string);
 
+/* Counters of the cold strings (see 'string_set_symbol_table' and 'string_set_spill_file'). */
+typedef struct StringCacheStatistics {
+    // strings holding a compressed form, its total size and the total length of those strings
+    size_t packed_count;
+    size_t packed_bytes;
+    size_t packed_length;
+    // strings currently decompressed and their total size
+    size_t hot_count;
+    size_t hot_bytes;
+    // strings with a copy in the spill file, and the bodies read back from it
+    size_t spilled_count;
+    size_t spill_reads;
+    // accesses to a cold string that was already decompressed, and those that decompressed (or read back) it
+    size_t hits;
+    size_t misses;
+} StringCacheStatistics;
+
+/*
+  Enables the compression of cold strings with 'table' (see 'SymbolTable.h'), or disables it if 'table' is 'NULL'.
+  While enabled, every string whose body is decompressed counts as hot, and 'string_trim_hot' compresses
+  all but 'hot_capacity' of them. The table must outlive every compressed string; it is disabled after they are destroyed.
+*/
+void string_set_symbol_table(const SymbolTable* const table, size_t hot_capacity);
+
+/*
+  Enables the spilling of cold strings to 'file', or disables it if 'file' is 'NULL'. While enabled, 'string_trim_hot'
+  moves the bodies of the least recently accessed strings to the file until the hot ones take at most 'budget' bytes
+  ('hot_capacity' is ignored); they are read back when accessed. With a symbol table, the bodies are spilled compressed.
+  The file must outlive every spilled string; it is disabled after they are destroyed.
+*/
+void string_set_spill_file(SpillFile* const file, size_t budget);
+
+/*
+  Makes a new string (e.g. one just loaded) cold right away: it is compressed if compression is enabled, and spilled
+  if the spill budget is already used up. Several threads may admit different strings at once.
+*/
+void string_admit(String* const string);
+
+/*
+  Makes the least recently accessed hot strings cold (CLOCK) until at most 'hot_capacity' (or 'budget' bytes) are left.
+  Pointers returned by 'string_get_data' may be invalidated: it must only be called by the thread owning the
+  database between commands. Strings with several references (e.g. snapshots of a sprinkle round) are left alone.
+*/
+void string_trim_hot(void);
+
+/* Writes the counters of the cold strings to 'statistics'. */
+void string_get_cache_statistics(StringCacheStatistics* statistics);
+
 /*
   Reads input of arbitrary length and creates a 'String' object out of it.
   If 'stdin' is passed in, the input is read from the console.
@@ -0,0 +1,53 @@
+#ifndef SymbolTable_H
+#define SymbolTable_H
+
+#include <stddef.h>
+
+/*
+  Compression of short strings with a static symbol table, in the manner of FSST.
+  The table maps each one-byte code to a symbol of 1 to 'SYMBOL_TABLE_MAX_SYMBOL_LENGTH' bytes; the code
+  'SYMBOL_TABLE_ESCAPE' is followed by a literal byte. The table is trained once on a sample of the poems:
+  each generation compresses the sample with the current table, counts how often each symbol (and each pair
+  of consecutive symbols) is used, and keeps the 255 symbols (single ones or concatenated pairs) that save the most bytes.
+  As the poems share most of their words, a trained table covers whole words and word pairs.
+  Every string is compressed on its own, so a single poem can be decompressed without touching any other.
+  A trained table is read-only: any number of threads may use it at once.
+*/
+
+#define SYMBOL_TABLE_MAX_SYMBOL_LENGTH 8
+#define SYMBOL_TABLE_ESCAPE 255
+/* Number of training rounds. */
+#define SYMBOL_TABLE_GENERATIONS 5
+/* Upper limit of the number of bytes the table is trained on. */
+#define SYMBOL_TABLE_SAMPLE_SIZE (1 << 20)
+
+/* Opaque type definition of 'SymbolTable'. */
+typedef struct SymbolTable SymbolTable;
+
+/*
+  Trains a table on the 'count' strings of 'samples' ('lengths[i]' bytes each, not necessarily '\0'-terminated).
+  Returns 'NULL' upon failure.
+*/
+SymbolTable* symbol_table_train(const char* const* samples, const size_t* lengths, size_t count);
+
+/* Destructor of a 'SymbolTable' object. Accepts NULL. */
+void symbol_table_destroy(SymbolTable* table);
+
+/* Returns the number of symbols of the table (at most 255). */
+size_t symbol_table_get_symbol_count(const SymbolTable* const table);
+
+/*
+  Compresses the 'length' bytes of 'data' to 'destination', which must hold at least '2 * length' bytes.
+  Returns the size of the compressed form.
+*/
+size_t symbol_table_compress(const SymbolTable* const table, const char* data, size_t length, unsigned char* destination);
+
+/*
+  Decompresses the 'size' bytes of 'packed' to 'destination', which holds 'capacity' bytes (at least the length of
+  the original string; with a few more, whole symbols are copied at once). Returns the length of the original string.
+  No '\0' character is appended.
+*/
+size_t symbol_table_decompress(const SymbolTable* const table, const unsigned char* packed, size_t size,
+                               char* destination, size_t capacity);
+
+#endif // SymbolTable_H
@@ -0,0 +1,78 @@
+#ifndef Trace_H
+#define Trace_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+  Lightweight tracing of the phases of a sprinkle round.
+  The parent and each bunny slot (a forked child or a bunny thread) write their events into their own
+  single-producer ring buffer that lives in memory shared across 'fork'. No locks are taken:
+  the writer publishes each event by advancing the ring's head. When a round is completed,
+  the parent merges its own ring and the ring of the round's slot into the trace log,
+  which can be exported in Chrome's trace-event format.
+*/
+
+/* Number of events that fit into the ring of a single process. Older events are overwritten. */
+#define TRACE_RING_CAPACITY 64
+/* Number of bunny slots, i.e. of rounds that may be in flight at the same time. */
+#define TRACE_MAX_SLOTS 4
+
+typedef enum TracePhase {
+    TRACE_ROUND,
+    TRACE_MSGGET,
+    TRACE_PIPE,
+    TRACE_FORK,
+    TRACE_SIGNAL_WAIT,
+    TRACE_PIPE_WRITE,
+    TRACE_MSGRCV,
+    TRACE_WAITPID,
+    TRACE_CHILD,
+    TRACE_SIGNAL_SEND,
+    TRACE_PIPE_READ,
+    TRACE_MSGSND,
+    // thread engine (see 'SprinkleEngine.h')
+    TRACE_WAKE,
+    TRACE_ARRIVAL_WAIT,
+    TRACE_POEMS_PUSH,
+    TRACE_CHOICE_POP,
+    TRACE_BUNNY,
+    TRACE_ARRIVAL_PUSH,
+    TRACE_POEMS_POP
+} TracePhase;
+
+/* Enables tracing. Returns false if the shared rings could not be allocated. */
+bool trace_enable(void);
+
+/* Returns whether tracing is enabled. */
+bool trace_is_enabled(void);
+
+/* Returns the current time of the monotonic clock, in nanoseconds. */
+unsigned long long trace_now(void);
+
+/* Resets the ring of 'slot'. Must be called by the parent before the round of 'slot' is started. */
+void trace_begin_round(size_t slot);
+
+/*
+  Switches the calling process or thread to the ring of 'slot'.
+  Must be called by the child right after 'fork', or once by a bunny thread when it starts.
+*/
+void trace_enter_child(size_t slot);
+
+/* Records a phase that started at 'start' (see 'trace_now') and ends now. */
+void trace_record(TracePhase phase, unsigned long long start);
+
+/*
+  Merges the ring of the parent and the ring of 'slot' into the trace log, then resets the parent's ring.
+  Must be called after the round of 'slot' has finished.
+*/
+void trace_end_round(size_t slot);
+
+/* Writes the trace log in Chrome's trace-event JSON format (chrome://tracing, Perfetto). */
+void trace_write_chrome_json(FILE* output);
+
+/* Releases the trace log and the shared rings. */
+void trace_destroy(void);
+
+#endif // Trace_H
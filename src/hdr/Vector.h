@@ -5,6 +5,13 @@
 
 #include "String.h"
 
+/*
+  Maximum number of shards (collections) the strings of a vector can belong to (see 'string_get_shard').
+  The strings of each shard are kept next to each other, in the order of the shards: a string must be
+  inserted into the range of its shard (see 'vector_get_shard_start'), which every function below preserves.
+*/
+#define MAX_SHARDS 64
+
 /* Opaque type definition of 'Vector'. */
 typedef struct Vector Vector;
 
@@ -14,12 +21,53 @@ Vector* vector_construct(void);
 /* Destructor for a 'Vector' object. Returns 'NULL' upon failure. */
 void vector_destroy(Vector* vector);
 
+/*
+  Makes room for 'capacity' strings at once, e.g. before appending a known number of them.
+  Otherwise the room grows geometrically as strings are added. Returns false upon failure.
+*/
+bool vector_reserve(Vector* vector, size_t capacity);
+
 /* Returns the number of elements stored in the vector. */
 size_t vector_get_size(const Vector* const vector);
 
+/*
+  Returns a counter that changes whenever a string is added, removed or replaced.
+  Marking a string as used does not change it.
+*/
+size_t vector_get_version(const Vector* const vector);
+
+/* Returns the number of strings of the shard. */
+size_t vector_get_shard_size(const Vector* const vector, size_t shard);
+
+/* Returns the index of the first string of the shard. */
+size_t vector_get_shard_start(const Vector* const vector, size_t shard);
+
+/* Returns a counter that changes whenever a string of the shard is added, removed, replaced or moved. */
+size_t vector_get_shard_version(const Vector* const vector, size_t shard);
+
 /* Returns the number of strings that were used at some point in the vector. */
 size_t vector_get_used_count(const Vector* const vector);
 
+/*
+  The lengths and the 'used' flags of the strings are also kept in dense arrays (one bit per string for the flags),
+  so the functions below do not touch the strings themselves.
+*/
+
+/* Returns the number of used strings in the range [from..to), counting 64 of them at a time. */
+size_t vector_count_used(const Vector* const vector, size_t from, size_t to);
+
+/* Returns the index of the first unused string in the range [from..to), or 'to' if every one of them is used. */
+size_t vector_find_unused(const Vector* const vector, size_t from, size_t to);
+
+/* Returns the total length of the strings of the vector. */
+size_t vector_get_text_length(const Vector* const vector);
+
+/* Returns the length of the string at the specified index (0 if the index is out of range). */
+size_t vector_get_length_at(const Vector* const vector, size_t index);
+
+/* Returns whether the string at the specified index is used (false if the index is out of range). */
+bool vector_is_used_at(const Vector* const vector, size_t index);
+
 /*
   Returns the C-style form of the string at the specified index.
   A shortcut to calling 'string_get_data(vector_get_string_at(...))'.
@@ -38,6 +86,27 @@ void vector_set_at(Vector* vector, size_t index, String* const string);
 /* Prints out each element of the vector in a formatted way. */
 void vector_print(const Vector* const vector);
 
+/*
+  Selects how the listings reach 'stdout'. By default, they are written straight to its file descriptor
+  (after flushing 'stdout'); with 'is_buffered', e.g. when 'stdout' is fully buffered in batch mode,
+  they go through its stdio buffer and are flushed with the rest of the output.
+*/
+void vector_set_buffered_output(bool is_buffered);
+
+/*
+  Prints out the elements in the range [from..to) in a formatted way.
+  The entries are formatted into a large buffer that is written to 'stdout' in a few system calls
+  (or to its stdio buffer, see 'vector_set_buffered_output').
+  The range is clipped to the size of the vector.
+*/
+void vector_print_range(const Vector* const vector, size_t from, size_t to);
+
+/*
+  Prints out the elements in the range [from..to) of the shard (relative to the start of the shard)
+  the same way as 'vector_print_range', but numbered as 'label:index'. The range is clipped to the size of the shard.
+*/
+void vector_print_shard_range(const Vector* const vector, size_t shard, size_t label, size_t from, size_t to);
+
 /* Appends a string to the end of the vector. Similar to 'push_back' in C++ */
 void vector_append(Vector* vector, String* const string);
 
@@ -47,7 +116,48 @@ void vector_append(Vector* vector, String* const string);
 */
 void vector_remove_at(Vector* vector, size_t index);
 
+/*
+  Removes 'count' strings starting at the specified index and shifts the remaining elements
+  to fill the gap. If the range does not fit into the vector, it does nothing.
+*/
+void vector_remove_range(Vector* vector, size_t index, size_t count);
+
+/*
+  Inserts 'count' strings before the specified index, shifting the following elements.
+  If the index is greater than the size of the vector, it does nothing.
+*/
+void vector_insert_range(Vector* vector, size_t index, String* const* strings, size_t count);
+
+/*
+  Removes 'count' strings starting at the specified index WITHOUT destroying them.
+  The removed strings are written to 'destination'. If the range does not fit into the vector, it does nothing.
+*/
+void vector_detach_range(Vector* vector, size_t index, size_t count, String** destination);
+
+/*
+  Replaces the string stored at the specified index and returns the previous one WITHOUT destroying it.
+  If the index is out of range, it returns 'NULL'.
+*/
+String* vector_replace_at(Vector* vector, size_t index, String* const string);
+
+/*
+  Rearranges the strings of the vector to the order of 'order', which must hold each string of the vector exactly once.
+  The previous order is written back to 'order', so calling it again restores it.
+  The strings keep their identifiers, so the version of the vector does not change.
+*/
+void vector_permute(Vector* vector, String** order);
+
 /* Sets the specified string as 'used'. */
 void vector_set_used(Vector* vector, size_t index);
 
+/*
+  Returns the string currently holding the poem 'id', or 'NULL' if the poem is not in the vector
+  (e.g. it was removed). Every string gets an identifier when it is first added to the vector;
+  a string replacing another one (see 'vector_replace_at') inherits the identifier of the poem it replaces.
+*/
+String* vector_get_string_by_id(const Vector* const vector, PoemId id);
+
+/* Sets the poem 'id' as 'used'. Returns false if the poem is not in the vector. */
+bool vector_set_used_by_id(Vector* vector, PoemId id);
+
 #endif // Vector_H
\ No newline at end of file
@@ -9,11 +9,8 @@ int main(int argc, char **argv)
 {
     signal(SIGUSR1, signal_handler_from_child);
 
-    // to avoid compiler warnings
-    (void)argc;
-
     // actual program initialisation and execution
     Application app;
-    application_initialise(&app, argv[0]);
+    application_initialise(&app, argc, argv);
     return application_run(&app);
 }
\ No newline at end of file